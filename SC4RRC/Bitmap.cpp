@@ -0,0 +1,71 @@
+/******************************************************************************
+ *	file: Bitmap.cpp
+ *
+ *	Copyright (c) 2007, Benjamin Schug
+ *
+ *	This file is part of the SimCity 4 Random Region Creator (SC4RRC).
+ *
+ *	Sim City is a registered trademark of Electronic Arts.
+ *	This program is in no way associated with Maxis or Electronic Arts.
+ *
+ *	SC4RRC is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	SC4RRC is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#define SC4RRC_LIB
+
+#include "Bitmap.h"
+#include "BmpWriter.h"
+#include "LogManager.h"
+
+//-----------------------------------------------------------------------------
+
+Bitmap::Bitmap()
+: width(0),height(0),bits(8),row_bytes(0)
+{
+}
+
+//-----------------------------------------------------------------------------
+
+Bitmap::Bitmap(int width, int height, int bits)
+{
+	create(width,height,bits);
+}
+
+//-----------------------------------------------------------------------------
+
+void Bitmap::create(int width, int height, int bits)
+{
+	this->width = width;
+	this->height = height;
+	this->bits = bits;
+	row_bytes = BmpWriter::getRowBytes(width,bits);
+
+	// assign() keeps the capacity of the vector
+	data.assign( size_t(row_bytes) * height, 0 );
+}
+
+//-----------------------------------------------------------------------------
+
+bool Bitmap::save(const char* filename) const
+{
+	SC4_PROFILE("save");
+	BmpWriter file;
+	if( !file.open(filename,width,height,bits) )
+		return false;
+
+	// the rows are already in the order of the file
+	bool ok = file.writeRows(0,height,&data[0]);
+	return file.close() && ok;
+}
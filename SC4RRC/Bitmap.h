@@ -0,0 +1,92 @@
+/******************************************************************************
+ *	file: Bitmap.h
+ *
+ *	Copyright (c) 2007, Benjamin Schug
+ *
+ *	This file is part of the SimCity 4 Random Region Creator (SC4RRC).
+ *
+ *	Sim City is a registered trademark of Electronic Arts.
+ *	This program is in no way associated with Maxis or Electronic Arts.
+ *
+ *	SC4RRC is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	SC4RRC is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#ifndef SC4RRC__BITMAP_H
+#define SC4RRC__BITMAP_H
+
+#include <vector>
+
+#include <SDL/SDL_types.h>
+
+#include "config.hpp"
+
+
+/**	An image in memory that is laid out exactly like the pixels of a BMP
+ *	file: the rows are stored bottom-up and padded to a multiple of four
+ *	bytes. getPixels() still points to the upper left pixel, and getPitch()
+ *	is negative, so pixel (x|y) is at getPixels() + x + y*getPitch() just
+ *	like in any other image.
+ *	That way, save() writes the whole image with a single call, without
+ *	flipping or copying a single row.
+ */
+class SC4RRC_API Bitmap
+{
+	int width;
+	int height;
+	int bits;
+	int row_bytes;				///< bytes per row, including the padding
+	std::vector<Uint8> data;	///< the rows in the order of the file
+
+	// not copyable
+	Bitmap(const Bitmap&);
+	Bitmap& operator=(const Bitmap&);
+
+public:
+	/** Creates an empty image. Call create() before using it. */
+	Bitmap();
+
+	/** @see create() */
+	Bitmap(int width, int height, int bits);
+
+	/**	Changes the size of the image. The memory of the old image is reused
+	 *	if it is large enough, so the same bitmap can hold many images one 
+	 *	after another without allocating memory each time.
+	 *	@param bits		8 for a grayscale image with one byte per pixel, or
+	 *					24 for a color image with the bytes blue, green and
+	 *					red per pixel. All pixels are 0 at first.
+	 */
+	void create(int width, int height, int bits);
+
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+	int getBits() const { return bits; }
+
+	/** Returns the number of bytes from one row to the next one below it. */
+	int getPitch() const { return -row_bytes; }
+
+	/** Returns the upper left pixel. */
+	Uint8* getPixels() { return &data[0] + size_t(height-1) * row_bytes; }
+	const Uint8* getPixels() const 
+	{ 
+		return &data[0] + size_t(height-1) * row_bytes; 
+	}
+
+	/**	Writes the image to a BMP file.
+	 *	@return	false if the file couldn't be written.
+	 */
+	bool save(const char* filename) const;
+};
+
+#endif // SC4RRC__BITMAP_H
@@ -0,0 +1,367 @@
+/******************************************************************************
+ *	file: BmpWriter.cpp
+ *
+ *	Copyright (c) 2007, Benjamin Schug
+ *
+ *	This file is part of the SimCity 4 Random Region Creator (SC4RRC).
+ *
+ *	Sim City is a registered trademark of Electronic Arts.
+ *	This program is in no way associated with Maxis or Electronic Arts.
+ *
+ *	SC4RRC is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	SC4RRC is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#define SC4RRC_LIB
+
+#include <string.h>
+#include <vector>
+
+#include "BmpWriter.h"
+#include "LogManager.h"
+
+/** Size of the file header plus the BITMAPINFOHEADER. */
+static const int HEADER_SIZE = 14 + 40;
+
+/** Moves to a position in a file that may be larger than 2 GB. */
+static int seek(FILE* file, Sint64 offset)
+{
+#ifdef _WIN32
+	return _fseeki64( file, offset, SEEK_SET );
+#else
+	return fseeko( file, off_t(offset), SEEK_SET );
+#endif
+}
+
+/** Stores a value in little endian byte order. */
+static void put(Uint8* dst, Uint32 value, int bytes)
+{
+	for( int i=0; i<bytes; i++ )
+		dst[i] = Uint8( value >> (8*i) );
+}
+
+/** Compresses a row with BI_RLE8 and appends it to out. */
+static void encodeRow(const Uint8* row, int width, std::vector<Uint8>& out)
+{
+	int x = 0;
+	while( x < width )
+	{
+		int run = 1;
+		while( x+run < width && run < 255 && row[x+run] == row[x] )
+			run++;
+
+		// runs of three or more pixels are encoded as count and value
+		if( run >= 3 )
+		{
+			out.push_back( Uint8(run) );
+			out.push_back( row[x] );
+			x += run;
+			continue;
+		}
+
+		// the pixels up to the next run are stored as they are
+		int end = x;
+		while( end < width && end-x < 255 && 
+			   !( end+2 < width && row[end] == row[end+1] 
+				  && row[end] == row[end+2] ) )
+			end++;
+
+		int count = end - x;
+		if( count < 3 )
+		{
+			// absolute mode needs at least three pixels
+			for( ; x < end; x++ )
+			{
+				out.push_back( 1 );
+				out.push_back( row[x] );
+			}
+			continue;
+		}
+
+		out.push_back( 0 );
+		out.push_back( Uint8(count) );
+		out.insert( out.end(), row+x, row+end );
+		if( count & 1 )
+			out.push_back( 0 );		// absolute runs are padded to words
+		x = end;
+	}
+
+	// end of line
+	out.push_back( 0 );
+	out.push_back( 0 );
+}
+
+//-----------------------------------------------------------------------------
+
+BmpWriter::BmpWriter()
+: file(NULL),width(0),height(0),bits(0),row_bytes(0),data_offset(0),
+  failed(false),compress(false),next_row(0),data_size(0),spill(NULL),spill_size(0)
+{
+}
+
+//-----------------------------------------------------------------------------
+
+BmpWriter::~BmpWriter()
+{
+	close();
+}
+
+//-----------------------------------------------------------------------------
+
+bool BmpWriter::open( const char* filename, int width, int height, int bits,
+					  const Uint8* palette, bool compress )
+{
+	close();
+
+	file = fopen(filename,"wb");
+	if( !file )
+	{
+		SC4_LOG( "couldn't create " << filename );
+		return false;
+	}
+
+	// the blocks are large enough, buffering them would only copy them
+	setvbuf( file, NULL, _IONBF, 0 );
+
+	this->width = width;
+	this->height = height;
+	this->bits = bits;
+	this->compress = compress && bits == 8;
+	row_bytes = getRowBytes(width,bits);
+	next_row = height;
+	data_size = 0;
+	failed = false;
+	spill_name = std::string(filename) + ".tmp";
+
+	// 8-bit images have a palette
+	int colors = bits == 8 ? 256 : 0;
+	data_offset = HEADER_SIZE + 4*colors;
+
+	// the size of compressed data is filled in by close()
+	Uint32 image_size = this->compress ? 0 
+									   : Uint32(row_bytes) * Uint32(height);
+
+	// the header and the palette are written at once
+	std::vector<Uint8> buffer( data_offset );
+	Uint8* header = &buffer[0];
+	header[0] = 'B';
+	header[1] = 'M';
+	put( header+2, Uint32(data_offset) + image_size, 4 );
+	put( header+10, Uint32(data_offset), 4 );
+	put( header+14, 40, 4 );			// size of the info header
+	put( header+18, Uint32(width), 4 );
+	put( header+22, Uint32(height), 4 );	// positive: rows are bottom-up
+	put( header+26, 1, 2 );				// planes
+	put( header+28, Uint32(bits), 2 );
+	put( header+30, this->compress ? 1 : 0, 4 );	// BI_RLE8 or BI_RGB
+	put( header+34, image_size, 4 );
+	put( header+46, Uint32(colors), 4 );
+
+	for( int i=0; i<colors; i++ )
+	{
+		Uint8* entry = header + HEADER_SIZE + 4*i;
+		if( palette )
+		{
+			entry[0] = palette[3*i];
+			entry[1] = palette[3*i+1];
+			entry[2] = palette[3*i+2];
+		}
+		else
+		{
+			entry[0] = entry[1] = entry[2] = Uint8(i);
+		}
+	}
+
+	if( fwrite( header, 1, buffer.size(), file ) != buffer.size() )
+	{
+		SC4_LOG( "couldn't write the header of " << filename );
+		this->compress = false;
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+
+bool BmpWriter::writeRows(int y0, int count, const Uint8* rows)
+{
+	if( !file ) return false;
+	if( count <= 0 ) return true;
+
+	if( compress )
+	{
+		encodeRows(count,rows);
+
+		// blocks that are next in the file are appended right away
+		if( y0 + count == next_row )
+		{
+			next_row = y0;
+			if( !appendEncoded( &encoded[0], encoded.size() ) 
+				|| !appendBlocks() )
+			{
+				failed = true;
+				return false;
+			}
+			return true;
+		}
+
+		if( !spill )
+			spill = fopen( spill_name.c_str(), "w+b" );
+
+		Block block = { y0, count, spill_size, encoded.size() };
+		if( !spill || seek( spill, spill_size ) 
+			|| fwrite( &encoded[0], 1, block.size, spill ) != block.size )
+		{
+			SC4_LOG( "couldn't write rows " << y0 << " to " << y0+count-1
+					 << " to " << spill_name );
+			failed = true;
+			return false;
+		}
+		blocks.push_back(block);
+		spill_size += block.size;
+		return true;
+	}
+
+	// the last row of the block is the first one in the file
+	size_t size = size_t(count) * row_bytes;
+	if( seek( file, data_offset + Sint64(height - y0 - count) * row_bytes ) 
+		|| fwrite( rows, 1, size, file ) != size )
+	{
+		SC4_LOG( "couldn't write rows " << y0 << " to " << y0+count-1 );
+		failed = true;
+		return false;
+	}
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+
+void BmpWriter::encodeRows(int count, const Uint8* rows)
+{
+	encoded.clear();
+	for( int i=0; i<count; i++ )
+		encodeRow( rows + size_t(i) * row_bytes, width, encoded );
+}
+
+//-----------------------------------------------------------------------------
+
+bool BmpWriter::appendEncoded(const Uint8* data, size_t size)
+{
+	// the compressed rows are only ever appended
+	if( seek( file, data_offset + data_size ) 
+		|| fwrite( data, 1, size, file ) != size )
+	{
+		LogManager::log("couldn't write compressed rows",true);
+		return false;
+	}
+	data_size += size;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+
+bool BmpWriter::appendBlocks()
+{
+	std::vector<Uint8> data;
+	bool found = true;
+	while( found )
+	{
+		found = false;
+		for( size_t i=0; i<blocks.size(); i++ )
+		{
+			Block block = blocks[i];
+			if( block.y0 + block.count != next_row )
+				continue;
+
+			data.resize( block.size );
+			if( seek( spill, block.offset ) 
+				|| fread( &data[0], 1, block.size, spill ) != block.size )
+			{
+				SC4_LOG( "couldn't read rows " << block.y0 << " to " 
+						 << block.y0 + block.count - 1 << " from " 
+						 << spill_name );
+				return false;
+			}
+			if( !appendEncoded( &data[0], data.size() ) )
+				return false;
+
+			next_row = block.y0;
+			blocks.erase( blocks.begin() + i );
+			found = true;
+			break;
+		}
+	}
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+
+bool BmpWriter::finishCompressed()
+{
+	if( next_row > 0 )
+	{
+		SC4_LOG( "rows 0 to " << next_row-1 << " of the compressed image "
+				 "are missing" );
+		return false;
+	}
+
+	// end of bitmap
+	const Uint8 end[2] = { 0, 1 };
+	if( !appendEncoded( end, 2 ) )
+		return false;
+
+	Uint8 file_size[4];
+	Uint8 image_size[4];
+	put( file_size, Uint32(data_offset + data_size), 4 );
+	put( image_size, Uint32(data_size), 4 );
+	if( seek( file, 2 ) || fwrite( file_size, 1, 4, file ) != 4 ||
+		seek( file, 34 ) || fwrite( image_size, 1, 4, file ) != 4 )
+	{
+		LogManager::log("couldn't write the size of the compressed image",
+						true);
+		return false;
+	}
+
+	SC4_DBG( "compressed " << Sint64(row_bytes) * height << " bytes to "
+			 << data_size << " bytes" );
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+
+bool BmpWriter::close()
+{
+	bool ok = !failed;
+	if( file )
+	{
+		if( compress )
+			ok = finishCompressed() && ok;
+		if( fclose(file) != 0 )
+			ok = false;
+		file = NULL;
+	}
+	failed = false;
+
+	if( spill )
+	{
+		fclose(spill);
+		remove( spill_name.c_str() );
+		spill = NULL;
+	}
+	spill_size = 0;
+	blocks.clear();
+	return ok;
+}
@@ -0,0 +1,140 @@
+/******************************************************************************
+ *	file: BmpWriter.h
+ *
+ *	Copyright (c) 2007, Benjamin Schug
+ *
+ *	This file is part of the SimCity 4 Random Region Creator (SC4RRC).
+ *
+ *	Sim City is a registered trademark of Electronic Arts.
+ *	This program is in no way associated with Maxis or Electronic Arts.
+ *
+ *	SC4RRC is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	SC4RRC is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#ifndef SC4RRC__BMPWRITER_H
+#define SC4RRC__BMPWRITER_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include <SDL/SDL_types.h>
+
+#include "config.hpp"
+
+
+/**	Writes a BMP file in blocks of rows.
+ *	The header is written when the file is opened, and the rows can then be
+ *	written in any order, so an image can be saved band by band without ever
+ *	keeping all of it in memory.
+ *	BMP files store the rows bottom-up, so the rows of a block must be
+ *	passed in file order: the lowest row of the block comes first.
+ *	The file is not buffered: every block goes straight from the memory of
+ *	the caller to the operating system in a single write, so large images
+ *	are never copied.
+ *
+ *	8-bit images can be compressed with BI_RLE8. The compressed rows must
+ *	be stored bottom-up as well, but their size isn't known in advance, so
+ *	blocks that arrive before the blocks below them are kept in a temporary
+ *	file next to the image until close() puts them in place.
+ */
+class SC4RRC_API BmpWriter
+{
+	/** A compressed block that waits in the temporary file. */
+	struct Block
+	{
+		int y0;
+		int count;
+		Sint64 offset;
+		size_t size;
+	};
+
+	FILE* file;
+	int width;
+	int height;
+	int bits;
+	int row_bytes;		///< bytes per row in the file, including padding
+	Sint64 data_offset;	///< position of the first pixel in the file
+	bool failed;		///< some rows couldn't be written
+
+	bool compress;
+	int next_row;		///< the compressed rows from next_row on are written
+	Sint64 data_size;	///< bytes of compressed rows in the file
+	std::vector<Uint8> encoded;
+
+	std::string spill_name;
+	FILE* spill;		///< the compressed blocks that are out of order
+	Sint64 spill_size;
+	std::vector<Block> blocks;
+
+	/** Compresses count rows in file order into encoded. */
+	void encodeRows(int count, const Uint8* rows);
+
+	/** Appends the compressed rows to the image file. */
+	bool appendEncoded(const Uint8* data, size_t size);
+
+	/** Moves the blocks that are next in file order out of the spill file. */
+	bool appendBlocks();
+
+	/** Writes the end of the compressed data and the final sizes. */
+	bool finishCompressed();
+
+	// not copyable
+	BmpWriter(const BmpWriter&);
+	BmpWriter& operator=(const BmpWriter&);
+
+public:
+	BmpWriter();
+
+	/** Closes the file if it is still open. */
+	~BmpWriter();
+
+	/**	Creates the file and writes the header.
+	 *	@param bits		8 for an image with one byte per pixel, or 24 for a
+	 *					color image with the bytes blue, green and red per
+	 *					pixel.
+	 *	@param palette	Blue, green and red of the 256 colors of an 8-bit
+	 *					image, or NULL for shades of gray.
+	 *	@param compress	true for compressing an 8-bit image with BI_RLE8.
+	 *	@return	false if the file couldn't be created.
+	 */
+	bool open( const char* filename, int width, int height, int bits,
+			   const Uint8* palette = NULL, bool compress = false );
+
+	/**	Writes the rows y0 to y0+count-1.
+	 *	@param rows		count rows of getRowBytes() bytes each, starting with
+	 *					row y0+count-1 and ending with row y0.
+	 *	@return	false if the rows couldn't be written.
+	 */
+	bool writeRows(int y0, int count, const Uint8* rows);
+
+	/**	Closes the file. A compressed image must have received all of its
+	 *	rows by then.
+	 *	@return	false if the file couldn't be completed, or if writeRows()
+	 *			failed since the file was opened.
+	 */
+	bool close();
+
+	/** Returns the number of bytes of a row, including the padding. */
+	int getRowBytes() const { return row_bytes; }
+
+	/** Returns the number of bytes of a row for an image of this width. */
+	static int getRowBytes(int width, int bits) 
+	{ 
+		return (width * (bits/8) + 3) & ~3; 
+	}
+};
+
+#endif // SC4RRC__BMPWRITER_H
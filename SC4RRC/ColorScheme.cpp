@@ -0,0 +1,74 @@
+/******************************************************************************
+ *	file: ColorScheme.cpp
+ *
+ *	Copyright (c) 2007, Benjamin Schug
+ *
+ *	This file is part of the SimCity 4 Random Region Creator (SC4RRC).
+ *
+ *	Sim City is a registered trademark of Electronic Arts.
+ *	This program is in no way associated with Maxis or Electronic Arts.
+ *
+ *	SC4RRC is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	SC4RRC is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#define SC4RRC_LIB
+
+#include "ColorScheme.h"
+
+//-----------------------------------------------------------------------------
+
+void ColorScheme::createPalette(Uint8 palette[3*256]) const
+{
+	for( int h=0; h<256; h++ )
+	{
+		Uint8 r,g,b;
+		getColor(Uint8(h),r,g,b);
+		palette[3*h] = b;
+		palette[3*h+1] = g;
+		palette[3*h+2] = r;
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+HeightColorScheme::HeightColorScheme(int sea_level)
+: sea_level(sea_level)
+{
+	// there has to be at least one height of water and one of land
+	if( this->sea_level < 1 ) this->sea_level = 1;
+	if( this->sea_level > 254 ) this->sea_level = 254;
+}
+
+//-----------------------------------------------------------------------------
+
+void HeightColorScheme::getColor(Uint8 h, Uint8& r, Uint8& g, Uint8& b) const
+{
+	if(h <= sea_level)
+	{
+		// water is blue - the deeper, the darker
+		r = (100*h)/sea_level;
+		g = (100*h)/sea_level;
+		b = 150 + (100*h)/sea_level;
+	}
+	else
+	{
+		// land color goes from green (low) to red (mountains)
+		int land = 255 - sea_level;
+		h -= sea_level;
+		r = 80 + (40*h)/land;
+		g = 120 - (40*h)/land;
+		b = 30;
+	}
+}
@@ -0,0 +1,71 @@
+/******************************************************************************
+ *	file: ColorScheme.h
+ *
+ *	Copyright (c) 2007, Benjamin Schug
+ *
+ *	This file is part of the SimCity 4 Random Region Creator (SC4RRC).
+ *
+ *	Sim City is a registered trademark of Electronic Arts.
+ *	This program is in no way associated with Maxis or Electronic Arts.
+ *
+ *	SC4RRC is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	SC4RRC is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#ifndef SC4RRC__COLORSCHEME_H
+#define SC4RRC__COLORSCHEME_H
+
+#include <SDL/SDL_types.h>
+
+#include "config.hpp"
+
+
+/**	Chooses the colors of the preview image.
+ *	The color of a pixel only depends on its height, so the preview is the
+ *	heightmap itself, saved with the colors of all 256 heights as its
+ *	palette.
+ */
+class SC4RRC_API ColorScheme
+{
+public:
+	virtual ~ColorScheme() { }
+
+	/** Returns the color of a height value. */
+	virtual void getColor(Uint8 height, Uint8& r, Uint8& g, Uint8& b) const = 0;
+
+	/**	Stores the colors of all height values in the byte order of a BMP
+	 *	palette.
+	 *	@param palette	Receives blue, green and red of every height value.
+	 */
+	void createPalette(Uint8 palette[3*256]) const;
+};
+
+
+/**	The colors of the previews of all versions so far: water is blue, the
+ *	deeper the darker, and land goes from green (low) to red (mountains).
+ */
+class SC4RRC_API HeightColorScheme : public ColorScheme
+{
+	int sea_level;
+
+public:
+	/**	@param sea_level	The highest height value that is under water.
+	 *						83 is the sea level of SimCity 4.
+	 */
+	explicit HeightColorScheme(int sea_level = 83);
+
+	void getColor(Uint8 height, Uint8& r, Uint8& g, Uint8& b) const;
+};
+
+#endif // SC4RRC__COLORSCHEME_H
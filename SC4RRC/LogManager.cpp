@@ -26,16 +26,137 @@
 #define SC4RRC_LIB
 
 #include <assert.h>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
 #include <iostream>
 
 #include <SDL/SDL_thread.h>
 #include <SDL/SDL_timer.h>
 
+#ifdef _WIN32
+#	define WIN32_LEAN_AND_MEAN
+#	include <windows.h>
+#	include <psapi.h>
+#else
+#	include <sys/resource.h>
+#	include <time.h>
+#endif
+
 #include "LogManager.h"
 
 
+/** The calls of one phase that was entered inside the same parent phase. */
+struct ProfileNode
+{
+	std::string name;
+	ProfileNode* parent;
+	std::vector<ProfileNode*> children;
+
+	unsigned long calls;
+	unsigned long long time, cpu_time, peak_memory;
+
+	ProfileNode(const std::string& name, ProfileNode* parent)
+	: name(name),parent(parent),calls(0),time(0),cpu_time(0),peak_memory(0)
+	{ }
+
+	~ProfileNode()
+	{
+		for( size_t i=0; i<children.size(); i++ )
+			delete children[i];
+	}
+
+	ProfileNode* getChild(const char* name)
+	{
+		for( size_t i=0; i<children.size(); i++ )
+			if( children[i]->name == name )
+				return children[i];
+		children.push_back( new ProfileNode(name,this) );
+		return children.back();
+	}
+};
+
+/** The trace keeps the first calls, so a long run can't fill the memory. */
+const size_t MAX_TRACE_EVENTS = 1000000;
+
+/** One entry of the log, or a free place in the ring buffer. */
+struct LogRecord
+{
+	/** Equal to the write position if the record is free, one more if it
+	 *	holds an entry.
+	 */
+	volatile long sequence;
+
+	Uint32 ticks;
+	bool timestamp;
+	std::string text;
+};
+
+/** Number of entries the ring buffer can hold, a power of two. */
+const long LOG_RECORDS = 4096;
+
+/** How long the background thread waits between writing batches, in ms. */
+const Uint32 FLUSH_INTERVAL = 10;
+
+//-----------------------------------------------------------------------------
+
+// Atomic operations with a full memory barrier. SDL 1.2 doesn't have them.
+#ifdef _WIN32
+__inline long atomicAdd(volatile long* value, long add)
+{
+	return InterlockedExchangeAdd(value,add);
+}
+
+__inline bool atomicCompareAndSwap(volatile long* value, long old, long now)
+{
+	return InterlockedCompareExchange(value,now,old) == old;
+}
+
+__inline void atomicSet(volatile long* value, long now)
+{
+	InterlockedExchange(value,now);
+}
+#else
+__inline long atomicAdd(volatile long* value, long add)
+{
+	return __sync_fetch_and_add(value,add);
+}
+
+__inline bool atomicCompareAndSwap(volatile long* value, long old, long now)
+{
+	return __sync_bool_compare_and_swap(value,old,now);
+}
+
+__inline void atomicSet(volatile long* value, long now)
+{
+	// __sync_lock_test_and_set() is only an acquire barrier, but the record
+	// has to be written before its sequence number, so this exchanges the 
+	// value with a full barrier
+	long old = __sync_fetch_and_add(value,0);
+	for(;;)
+	{
+		long seen = __sync_val_compare_and_swap(value,old,now);
+		if( seen == old )
+			break;
+		old = seen;
+	}
+}
+#endif
+
+__inline long atomicGet(volatile long* value)
+{
+	return atomicAdd(value,0);
+}
+
+/** a - b for positions that may have wrapped around. */
+__inline long distance(long a, long b)
+{
+	return long( (unsigned long)(a) - (unsigned long)(b) );
+}
+
 LogManager* LogManager::singleton = NULL;
 bool LogManager::fullreport = false;
+bool LogManager::profiling = false;
 
 //-----------------------------------------------------------------------------
 
@@ -61,6 +182,25 @@ LogManager::LogManager()
 	file << "\n";
 
 	mutex = SDL_CreateMutex();
+
+	records = new LogRecord[LOG_RECORDS];
+	for( long i=0; i<LOG_RECORDS; i++ )
+		records[i].sequence = i;
+	record_mask = LOG_RECORDS - 1;
+	write_position = 0;
+	read_position = 0;
+	dropped_records = 0;
+
+	stopped = 0;
+	writer = SDL_CreateThread(writerMain,this);
+	if( !writer )
+		atomicSet(&stopped,1);
+
+	profile_mutex = SDL_CreateMutex();
+	profile = new ProfileNode("total",NULL);
+	dropped_events = 0;
+	profile_start = getTime();
+	profile_cpu_start = getCpuTime();
 }
 
 //-----------------------------------------------------------------------------
@@ -69,6 +209,7 @@ LogManager::~LogManager()
 {
 	_endl();
 	_log("Unloading Log Manager.");
+	shutdown();
 
 	assert( singleton );
 	singleton = NULL;
@@ -76,27 +217,391 @@ LogManager::~LogManager()
 	file.close();
 
 	SDL_DestroyMutex(mutex);
+	SDL_DestroyMutex(profile_mutex);
+	delete[] records;
+	delete profile;
 }
 
 //-----------------------------------------------------------------------------
 
 void LogManager::_log(const std::string &descr)
 {
-	std::cerr << descr << "\n";
-
-	SDL_mutexP(mutex);
-	file << SDL_GetTicks() << "\t" << descr << "\n";
-	SDL_mutexV(mutex);
+	push(descr,true);
 }
 
 //-----------------------------------------------------------------------------
 
 void LogManager::_endl()
 {
-	std::cerr << "\n";
+	push("",false);
+}
+
+//-----------------------------------------------------------------------------
+
+void LogManager::push(const std::string& text, bool timestamp)
+{
+	// Claim the record at the write position, unless another thread was
+	// faster. If the record still holds an entry, the ring is full.
+	long position = atomicGet(&write_position);
+	LogRecord* record;
+	for(;;)
+	{
+		record = &records[position & record_mask];
+		long difference = distance( atomicGet(&record->sequence), position );
+		if( difference == 0 )
+		{
+			if( atomicCompareAndSwap(&write_position,position,position+1) )
+				break;
+			position = atomicGet(&write_position);
+		}
+		else if( difference < 0 )
+		{
+			atomicAdd(&dropped_records,1);
+			return;
+		}
+		else
+		{
+			position = atomicGet(&write_position);
+		}
+	}
+
+	// the string keeps its memory, so this usually doesn't allocate
+	record->ticks = SDL_GetTicks();
+	record->timestamp = timestamp;
+	record->text.assign(text);
+	atomicSet(&record->sequence,position+1);
 
+	// nobody else will write it
+	if( atomicGet(&stopped) )
+		flush();
+}
+
+//-----------------------------------------------------------------------------
+
+void LogManager::flush()
+{
 	SDL_mutexP(mutex);
-	file << "\n";
+
+	std::string console, log_file;
+	std::ostringstream o;
+	for(;;)
+	{
+		LogRecord& record = records[read_position & record_mask];
+		if( distance( atomicGet(&record.sequence), read_position+1 ) < 0 )
+			break;
+
+		console += record.text;
+		console += '\n';
+		if( record.timestamp )
+		{
+			o.str("");
+			o << record.ticks << '\t';
+			log_file += o.str();
+		}
+		log_file += record.text;
+		log_file += '\n';
+
+		record.text.clear();
+		atomicSet(&record.sequence,read_position+LOG_RECORDS);
+		read_position++;
+	}
+
+	long dropped = atomicGet(&dropped_records);
+	if( dropped > 0 )
+	{
+		atomicAdd(&dropped_records,-dropped);
+		o.str("");
+		o << "the log was full, " << dropped << " entries were left out";
+		console += o.str() + '\n';
+		o.str("");
+		o << SDL_GetTicks() << '\t' << "the log was full, " << dropped 
+		  << " entries were left out\n";
+		log_file += o.str();
+	}
+
+	if( !console.empty() )
+	{
+		std::cerr << console;
+		file << log_file;
+		file.flush();
+	}
+
 	SDL_mutexV(mutex);
 }
 
+//-----------------------------------------------------------------------------
+
+int LogManager::writerMain(void* self)
+{
+	LogManager* log_manager = (LogManager*)self;
+	while( !atomicGet(&log_manager->stopped) )
+	{
+		log_manager->flush();
+		SDL_Delay(FLUSH_INTERVAL);
+	}
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+
+void LogManager::shutdown()
+{
+	if( singleton==NULL )
+		return;
+
+	if( singleton->writer )
+	{
+		atomicSet(&singleton->stopped,1);
+		SDL_WaitThread(singleton->writer,NULL);
+		singleton->writer = NULL;
+	}
+	singleton->flush();
+}
+
+
+//-----------------------------------------------------------------------------
+
+void LogManager::enableProfiling(const std::string& trace_file)
+{
+	if(singleton==NULL) singleton = new LogManager();
+
+	SDL_mutexP(singleton->profile_mutex);
+	singleton->trace_file = trace_file;
+	singleton->profile_start = getTime();
+	singleton->profile_cpu_start = getCpuTime();
+	SDL_mutexV(singleton->profile_mutex);
+
+	if( !profiling )
+		atexit(writeProfileAtExit);
+	profiling = true;
+}
+
+//-----------------------------------------------------------------------------
+
+unsigned long long LogManager::getTime()
+{
+#ifdef _WIN32
+	LARGE_INTEGER counter, frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	// split up, so the multiplication can't overflow
+	unsigned long long seconds = counter.QuadPart / frequency.QuadPart;
+	unsigned long long rest = counter.QuadPart % frequency.QuadPart;
+	return seconds * 1000000000ULL + rest * 1000000000ULL / frequency.QuadPart;
+#else
+	timespec time;
+	clock_gettime(CLOCK_MONOTONIC,&time);
+	return time.tv_sec * 1000000000ULL + time.tv_nsec;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+
+unsigned long long LogManager::getCpuTime()
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	if( !GetProcessTimes( GetCurrentProcess(), 
+						  &creation, &exit, &kernel, &user ) )
+		return 0;
+	// in units of 100 ns
+	unsigned long long k = 
+		(unsigned long long)(kernel.dwHighDateTime) << 32 | kernel.dwLowDateTime;
+	unsigned long long u = 
+		(unsigned long long)(user.dwHighDateTime) << 32 | user.dwLowDateTime;
+	return (k + u) * 100;
+#else
+	timespec time;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID,&time);
+	return time.tv_sec * 1000000000ULL + time.tv_nsec;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+
+unsigned long long LogManager::getPeakMemory()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if( !GetProcessMemoryInfo( GetCurrentProcess(), 
+							   &counters, sizeof(counters) ) )
+		return 0;
+	return counters.PeakWorkingSetSize;
+#else
+	rusage usage;
+	if( getrusage(RUSAGE_SELF,&usage) != 0 )
+		return 0;
+#	ifdef __APPLE__
+	return usage.ru_maxrss;
+#	else
+	// in kilobytes
+	return usage.ru_maxrss * 1024ULL;
+#	endif
+#endif
+}
+
+//-----------------------------------------------------------------------------
+
+ProfileNode* LogManager::_beginPhase(const char* name)
+{
+	SDL_mutexP(profile_mutex);
+
+	std::map<unsigned int,ThreadState>::iterator thread = 
+		threads.find( SDL_ThreadID() );
+	if( thread == threads.end() )
+	{
+		ThreadState state;
+		state.index = int(threads.size());
+		state.current = profile;
+		thread = threads.insert( std::make_pair(SDL_ThreadID(),state) ).first;
+	}
+
+	ProfileNode* node = thread->second.current->getChild(name);
+	thread->second.current = node;
+
+	SDL_mutexV(profile_mutex);
+	return node;
+}
+
+//-----------------------------------------------------------------------------
+
+void LogManager::_endPhase( ProfileNode* node, unsigned long long start, 
+							unsigned long long cpu_start )
+{
+	unsigned long long end = getTime();
+	unsigned long long cpu_time = getCpuTime() - cpu_start;
+	unsigned long long peak_memory = getPeakMemory();
+
+	SDL_mutexP(profile_mutex);
+
+	ThreadState& thread = threads[ SDL_ThreadID() ];
+	thread.current = node->parent;
+
+	node->calls++;
+	node->time += end - start;
+	node->cpu_time += cpu_time;
+	if( peak_memory > node->peak_memory )
+		node->peak_memory = peak_memory;
+
+	if( !trace_file.empty() )
+	{
+		if( trace.size() < MAX_TRACE_EVENTS )
+		{
+			TraceEvent event;
+			event.name = node->name.c_str();
+			event.thread = thread.index;
+			event.start = start > profile_start ? start - profile_start : 0;
+			event.duration = end - start;
+			trace.push_back(event);
+		}
+		else
+		{
+			dropped_events++;
+		}
+	}
+
+	SDL_mutexV(profile_mutex);
+}
+
+//-----------------------------------------------------------------------------
+
+/** Adds the table rows of a phase and the phases inside it. */
+static void writePhase( std::ostream& out, const ProfileNode* node, 
+						int depth, double total )
+{
+	std::string name = std::string(2*depth,' ') + node->name;
+	if( name.size() < 32 )
+		name.resize(32,' ');
+
+	out << name << std::setw(8) << node->calls 
+		<< std::setw(12) << node->time / 1e6 
+		<< std::setw(8) << (total > 0.0 ? 100.0 * node->time / total : 0.0)
+		<< std::setw(12) << node->cpu_time / 1e6;
+	if( node->peak_memory > 0 )
+		out << std::setw(10) << node->peak_memory / (1024.0*1024.0);
+	else
+		out << std::setw(10) << "-";
+	out << "\n";
+
+	for( size_t i=0; i<node->children.size(); i++ )
+		writePhase( out, node->children[i], depth+1, total );
+}
+
+//-----------------------------------------------------------------------------
+
+/** Replaces the characters that JSON strings can't contain. */
+static std::string jsonString(const std::string& text)
+{
+	std::string result;
+	for( size_t i=0; i<text.size(); i++ )
+	{
+		if( text[i]=='"' || text[i]=='\\' ) 
+			result += '\\';
+		if( (unsigned char)text[i] >= ' ' ) 
+			result += text[i];
+	}
+	return result;
+}
+
+//-----------------------------------------------------------------------------
+
+void LogManager::_writeProfile()
+{
+	SDL_mutexP(profile_mutex);
+
+	// the phases of the first level run one after another in each thread
+	profile->calls = 1;
+	profile->time = getTime() - profile_start;
+	profile->cpu_time = getCpuTime() - profile_cpu_start;
+	profile->peak_memory = getPeakMemory();
+
+	std::ostringstream table;
+	table << std::fixed << std::setprecision(1) 
+		  << "phase                              calls     wall ms  "
+			 "%total      cpu ms   peak MB\n";
+	writePhase( table, profile, 0, double(profile->time) );
+
+	std::string lines = table.str();
+	lines.erase( lines.size()-1 );
+	_endl();
+	_log("profile");
+	push(lines,false);
+
+	if( !trace_file.empty() )
+	{
+		FILE* out = fopen(trace_file.c_str(),"w");
+		if( out )
+		{
+			fprintf(out,"{\"traceEvents\":[");
+			for( size_t i=0; i<trace.size(); i++ )
+				fprintf( out, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,"
+						 "\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", 
+						 i ? "," : "", jsonString(trace[i].name).c_str(), 
+						 trace[i].thread, trace[i].start / 1000.0,
+						 trace[i].duration / 1000.0 );
+			fprintf(out,"\n],\"displayTimeUnit\":\"ms\"}\n");
+			fclose(out);
+
+			std::ostringstream o;
+			o << "wrote " << trace.size() << " phases to " << trace_file;
+			if( dropped_events > 0 )
+				o << ", left out " << dropped_events << " more";
+			_log(o.str());
+		}
+		else
+		{
+			_log("couldn't write " + trace_file);
+		}
+	}
+
+	SDL_mutexV(profile_mutex);
+	flush();
+}
+
+//-----------------------------------------------------------------------------
+
+void LogManager::writeProfileAtExit()
+{
+	if( singleton && profiling )
+		singleton->_writeProfile();
+}
@@ -29,27 +29,59 @@
 #include <string>
 #include <sstream>
 #include <fstream>
+#include <map>
+#include <vector>
 
 #include "config.hpp"
 
 // forward declaration
 struct SDL_mutex;
+struct SDL_Thread;
+struct ProfileNode;
+struct LogRecord;
 
-#define SC4_DBG(msg) \
-{ \
-    std::ostringstream o; \
-    o << msg; \
-    LogManager::log (o.str(), false); \
-    o.str (""); \
-}
+/**	Log entries above this level are removed by the compiler: 0 removes all
+ *	entries, 1 keeps the entries that are always written and 2 also keeps
+ *	the detailed entries of LogManager::log(const std::string&,bool).
+ */
+#ifndef SC4_LOG_LEVEL
+#	define SC4_LOG_LEVEL 2
+#endif
 
-#define SC4_LOG(msg) \
-{ \
-    std::ostringstream o; \
-    o << msg; \
-    LogManager::log (o.str(), true); \
-    o.str (""); \
-}
+// The message is only put together if it is going to be written.
+#if SC4_LOG_LEVEL >= 2
+#	define SC4_DBG(msg) \
+	{ \
+		if( LogManager::isEnabled(false) ) \
+		{ \
+			std::ostringstream o; \
+			o << msg; \
+			LogManager::log (o.str(), false); \
+		} \
+	}
+#else
+#	define SC4_DBG(msg) { }
+#endif
+
+#if SC4_LOG_LEVEL >= 1
+#	define SC4_LOG(msg) \
+	{ \
+		std::ostringstream o; \
+		o << msg; \
+		LogManager::log (o.str(), true); \
+	}
+#else
+#	define SC4_LOG(msg) { }
+#endif
+
+#define SC4_PROFILE_NAME2(line) profile_scope_##line
+#define SC4_PROFILE_NAME(line) SC4_PROFILE_NAME2(line)
+
+/**	Measures the rest of the enclosing block as a phase with the given name.
+ *	Phases nest like the blocks do, see LogManager::enableProfiling().
+ */
+#define SC4_PROFILE(name) \
+	ProfileScope SC4_PROFILE_NAME(__LINE__) (name)
 
 
 /**	This singleton manages all access to the log file. 
@@ -64,7 +96,18 @@ struct SDL_mutex;
  *				SDL_mutex* SDL_CreateMutex() \n
  *				void SDL_mutexP(SDL_mutex*) \n
  *				void SDL_mutexV(SDL_mutex*) \n
- *				int SDL_GetTicks()
+ *				int SDL_GetTicks() \n
+ *				Uint32 SDL_ThreadID() \n
+ *				SDL_Thread* SDL_CreateThread(int (*)(void*), void*) \n
+ *				void SDL_WaitThread(SDL_Thread*, int*) \n
+ *				void SDL_Delay(Uint32)
+ *
+ *	The entries are not written by the thread that logs them. They are put
+ *	into a ring buffer without locking, and a background thread writes them
+ *	in batches, so logging never waits for the console or the disk. If the
+ *	buffer is full, entries are left out and the number of missing entries
+ *	is logged. Call LogManager::shutdown() before the program exits, so the
+ *	last entries are written, e.g. with atexit().
  */
 class SC4RRC_API LogManager 
 {
@@ -77,12 +120,57 @@ private:
 	 */
 	static bool fullreport;
 
-	/** Mutex for multi-threaded applications. */
+	/** Only one thread at a time writes to the console and the file. */
 	SDL_mutex* mutex;
 
+	/** The entries that haven't been written yet. The size of the ring is a
+	 *	power of two. The positions only grow, and every record has a 
+	 *	sequence number that tells if it is free or if it holds an entry.
+	 */
+	LogRecord* records;
+	long record_mask;
+	volatile long write_position;
+	long read_position;
+	volatile long dropped_records;
+
+	/** The background thread, it runs until stopped is 1. Only accessed
+	 *	atomically.
+	 */
+	SDL_Thread* writer;
+	volatile long stopped;
+
 	std::string filename;
 	std::ofstream file;
 
+	/** If this is true, phases are measured. */
+	static bool profiling;
+
+	/** One phase of a completed call, for the trace. */
+	struct TraceEvent
+	{
+		const char* name;
+		int thread;
+		unsigned long long start, duration;
+	};
+
+	/** The phase a thread is in, and its number in the trace. */
+	struct ThreadState
+	{
+		int index;
+		ProfileNode* current;
+	};
+
+	/** The phases of all threads. The first phase of a thread is a child
+	 *	of the root, so the same phases of different threads are merged.
+	 */
+	SDL_mutex* profile_mutex;
+	ProfileNode* profile;
+	std::map<unsigned int,ThreadState> threads;
+	std::vector<TraceEvent> trace;
+	size_t dropped_events;
+	std::string trace_file;
+	unsigned long long profile_start, profile_cpu_start;
+
 	/** For internal use only.
 	 *	You can't create a LogManager object by yourself.
 	 *	The LogManager::log() method will do that if necessary.
@@ -94,6 +182,19 @@ private:
 	void _log(const std::string &descr);
 	void _endl();
 
+	/** Puts an entry into the ring buffer, or counts it as left out. */
+	void push(const std::string& text, bool timestamp);
+
+	/** Writes all entries in the ring buffer. */
+	void flush();
+	static int writerMain(void* self);
+
+	ProfileNode* _beginPhase(const char* name);
+	void _endPhase( ProfileNode* node, unsigned long long start, 
+					unsigned long long cpu_start );
+	void _writeProfile();
+	static void writeProfileAtExit();
+
 public:
 	/**	Writes a string to the log file.
 	 *	@param	descr	The text that should be written to the log file.
@@ -104,9 +205,7 @@ public:
 	 */
 	static inline void log(const std::string &descr, bool always=false)
 	{
-#ifndef _DEBUG
-		if(always || fullreport)
-#endif
+		if( isEnabled(always) )
 		{
 			if(singleton==NULL) singleton = new LogManager();
 			singleton->_log(descr);
@@ -117,19 +216,42 @@ public:
 	 *	This works basically just like LogManager::log(const std::string&,bool)
 	 *	but it also resets the stream so you can reuse it for creating new log
 	 *	entries.
-	 *	@param descr	This must be a pointer to a ostringstream that was 
-	 *					created on the heap because it will be destroyed and
-	 *					recreated after logging. This seems to be the only way
-	 *					to clean the content of the stream.
+	 *	@param descr	The stream, which is emptied after logging.
 	 *	@see LogManager::log(const std::string&, bool)
 	 */
+	static inline void log( std::ostringstream& descr, bool always=false )
+	{
+		log(descr.str(),always);
+		descr.str("");
+		descr.clear();
+	}
+
+	/**	Same as LogManager::log(std::ostringstream&,bool), for streams that
+	 *	are kept on the heap. The caller still owns the stream.
+	 */
 	static inline void log( std::ostringstream* &descr, bool always=false )
 	{
-		log(descr->str(),always);
-		delete descr;
-		descr = new std::ostringstream;
+		log(*descr,always);
+	}
+
+	/**	@return	true if entries with this value of the always parameter of
+	 *			LogManager::log(const std::string&,bool) are written.
+	 */
+	static inline bool isEnabled(bool always)
+	{
+#ifdef _DEBUG
+		return SC4_LOG_LEVEL >= 2 || (always && SC4_LOG_LEVEL >= 1);
+#else
+		return (fullreport && SC4_LOG_LEVEL >= 2) || 
+			   (always && SC4_LOG_LEVEL >= 1);
+#endif
 	}
 
+	/**	Writes the entries that are still waiting and stops the background
+	 *	thread. Entries that are logged afterwards are written right away.
+	 */
+	static void shutdown();
+
 	/**	Writes an empty line to the log file.
 	 *
 	 *	@note	Every entry in the log file starts in a new line so you don't
@@ -152,6 +274,83 @@ public:
         fullreport = b; 
         log ("detailed logging enabled");
     }
+
+	/**	Starts measuring the phases marked with SC4_PROFILE().
+	 *	When the program exits, a table of all phases is logged, with the
+	 *	number of calls, the wall clock time, the CPU time of the whole
+	 *	process and the peak memory usage at the end of the phase. Phases
+	 *	that are entered inside other phases are listed below them.
+	 *	@param	trace_file	Every call of a phase is also written to this
+	 *						file, in the trace event format of Chrome 
+	 *						(chrome://tracing). Nothing is written if this 
+	 *						is empty.
+	 */
+	static void enableProfiling(const std::string& trace_file);
+
+	/** @return	true if phases are being measured. */
+	static bool isProfiling() { return profiling; }
+
+	/** @return	A monotonic time in nanoseconds. */
+	static unsigned long long getTime();
+
+	/** @return	The CPU time of all threads of the process in nanoseconds. */
+	static unsigned long long getCpuTime();
+
+	/** @return	The most memory the process ever used, in bytes, or 0 if
+	 *			this is unknown on this platform.
+	 */
+	static unsigned long long getPeakMemory();
+
+	/**	Enters a phase in the current thread.
+	 *	Use SC4_PROFILE() instead of calling this directly.
+	 *	@return	The phase, which must be passed to endPhase().
+	 */
+	static ProfileNode* beginPhase(const char* name)
+	{
+		if(singleton==NULL) singleton = new LogManager();
+		return singleton->_beginPhase(name);
+	}
+
+	/**	Leaves the phase that the current thread entered last.
+	 *	@param	start, cpu_start	The times at the beginning of the phase.
+	 */
+	static void endPhase( ProfileNode* node, unsigned long long start, 
+						  unsigned long long cpu_start )
+	{
+		singleton->_endPhase(node,start,cpu_start);
+	}
+};
+
+//-----------------------------------------------------------------------------
+
+/**	Measures a phase from its construction to its destruction, if profiling
+ *	is enabled.
+ *	@see SC4_PROFILE
+ */
+class ProfileScope
+{
+	ProfileNode* node;
+	unsigned long long start, cpu_start;
+
+	// not copyable
+	ProfileScope(const ProfileScope&);
+	ProfileScope& operator=(const ProfileScope&);
+
+public:
+	/** @param name	This must stay valid until the program exits. */
+	explicit ProfileScope(const char* name)
+	: node(NULL)
+	{
+		if( !LogManager::isProfiling() ) return;
+		node = LogManager::beginPhase(name);
+		cpu_start = LogManager::getCpuTime();
+		start = LogManager::getTime();
+	}
+
+	~ProfileScope()
+	{
+		if( node ) LogManager::endPhase(node,start,cpu_start);
+	}
 };
 
 #endif
@@ -0,0 +1,185 @@
+/******************************************************************************
+ *	file: PacketTraversal.h
+ *
+ *	Copyright (c) 2007, Benjamin Schug
+ *
+ *	This file is part of the SimCity 4 Random Region Creator (SC4RRC).
+ *
+ *	Sim City is a registered trademark of Electronic Arts.
+ *	This program is in no way associated with Maxis or Electronic Arts.
+ *
+ *	SC4RRC is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	SC4RRC is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+
+#ifndef SC4RRC__PACKETTRAVERSAL_H
+#define SC4RRC__PACKETTRAVERSAL_H
+
+#include <SDL/SDL_types.h>
+
+#include "TriangleRasterizer.h"
+
+
+/**	Renders a dynamic triangle grid in packets of neighbouring pixels that
+ *	descend from the base triangles together.
+ *	Neighbouring pixels take the same way down the triangles until the 
+ *	triangles get about as small as the packet, so the packet splits every 
+ *	triangle on its way only once for all of its pixels, like a ray packet
+ *	in a ray tracer. Where the pixels choose different sub-triangles, the
+ *	packet falls apart into one packet per sub-triangle, each of which only
+ *	carries on with its own pixels.
+ *
+ *	Every pixel chooses its triangles on its own with the same tests as the 
+ *	per-pixel path, so the result is exactly the same.
+ *
+ *	The Generator must provide these members:
+ *	- a type Point, the position of a pixel on the current triangle
+ *	- Point getPoint(int x, int y), the pixel (x|y) on the base triangle ABD
+ *	- BaseTriangle chooseBaseTriangle(Point& p), which chooses the base 
+ *	  triangle of p and moves p onto it
+ *	- SubTriangle chooseSubTriangle(Point& p, const V& a, const V& b, 
+ *	  const V& c), which does the same for the sub-triangles of abc
+ *	- void splitTriangle(const V& a, const V& b, const V& c,
+ *	  V& ab, V& ac, V& bc), which creates the edge midpoints of abc
+ *	- Uint8 getPixel(int x, int y, const V& a, const V& b, const V& c), the
+ *	  height value of pixel (x|y) on the triangle abc
+ *
+ *	@param WIDTH	The number of pixels in a packet: 4 for packets of 2x2 
+ *					pixels, 8 for 4x2 and 16 for 4x4.
+ */
+template<class Generator, class V, int WIDTH>
+class PacketTraversal
+{
+	typedef typename Generator::Point Point;
+
+	enum
+	{
+		ROWS = WIDTH >= 16 ? 4 : 2,
+		COLUMNS = WIDTH / ROWS
+	};
+
+	Generator& generator;
+	Uint8* image;
+	int pitch;
+
+	/** The pixels of the current packet, one per lane. */
+	int x[WIDTH];
+	int y[WIDTH];
+	Point points[WIDTH];
+
+	/**	Renders the pixels of the lanes that are set in the mask on the 
+	 *	triangle abc.
+	 *	@param depth	How often abc has to be split.
+	 */
+	void descend( const V& a, const V& b, const V& c, int depth, 
+				  Uint32 lanes )
+	{
+		if( depth == 0 )
+		{
+			for( int i=0; i<WIDTH; i++ )
+				if( lanes & (1u<<i) )
+					image[ x[i] + y[i]*pitch ] = 
+						generator.getPixel(x[i],y[i],a,b,c);
+			return;
+		}
+
+		Uint32 children[4] = { 0, 0, 0, 0 };
+		for( int i=0; i<WIDTH; i++ )
+			if( lanes & (1u<<i) )
+				children[ generator.chooseSubTriangle(points[i],a,b,c) ] 
+					|= 1u<<i;
+
+		V ab, ac, bc;
+		generator.splitTriangle(a,b,c,ab,ac,bc);
+
+		if( children[SUB_A] )
+			descend(a,ab,ac,depth-1,children[SUB_A]);
+		if( children[SUB_B] )
+			descend(ab,b,bc,depth-1,children[SUB_B]);
+		if( children[SUB_C] )
+			descend(ac,bc,c,depth-1,children[SUB_C]);
+		if( children[SUB_MIDDLE] )
+			descend(ab,ac,bc,depth-1,children[SUB_MIDDLE]);
+	}
+
+	// not copyable
+	PacketTraversal(const PacketTraversal&);
+	PacketTraversal& operator=(const PacketTraversal&);
+
+public:
+	/**	@param image	Points to the pixel (0|0) of an 8-bit image.
+	 *	@param pitch	Number of bytes from one row to the next, negative
+	 *					if the rows are stored bottom-up.
+	 */
+	PacketTraversal(Generator& generator, Uint8* image, int pitch)
+	: generator(generator),image(image),pitch(pitch) { }
+
+	/**	Renders the pixels from (x0|y0) up to, but not including, (x1|y1) of
+	 *	the map with the corners A,B,C,D.
+	 *	@param depth	How often the base triangles have to be split.
+	 */
+	void render( const V& A, const V& B, const V& C, const V& D, int depth,
+				 int x0, int y0, int x1, int y1 )
+	{
+		for( int py=y0; py<y1; py+=ROWS )
+			for( int px=x0; px<x1; px+=COLUMNS )
+			{
+				// packets at the right and bottom edges may be incomplete
+				Uint32 base[2] = { 0, 0 };
+				for( int i=0; i<WIDTH; i++ )
+				{
+					x[i] = px + i % COLUMNS;
+					y[i] = py + i / COLUMNS;
+					if( x[i] >= x1 || y[i] >= y1 )
+						continue;
+
+					points[i] = generator.getPoint(x[i],y[i]);
+					base[ generator.chooseBaseTriangle(points[i]) ] |= 1u<<i;
+				}
+
+				if( base[BASE_ABD] )
+					descend(A,B,D,depth,base[BASE_ABD]);
+				if( base[BASE_CDB] )
+					descend(C,D,B,depth,base[BASE_CDB]);
+			}
+	}
+};
+
+/**	Renders the pixels from (x0|y0) up to, but not including, (x1|y1) with
+ *	a PacketTraversal of the given width: 4, 8 or 16. Other widths use 8.
+ */
+template<class Generator, class V>
+void renderPackets( int width, Generator& generator, Uint8* image, int pitch,
+					const V& A, const V& B, const V& C, const V& D, 
+					int depth, int x0, int y0, int x1, int y1 )
+{
+	switch( width )
+	{
+	case 4:
+		PacketTraversal<Generator,V,4>(generator,image,pitch)
+			.render(A,B,C,D,depth,x0,y0,x1,y1);
+		break;
+	case 16:
+		PacketTraversal<Generator,V,16>(generator,image,pitch)
+			.render(A,B,C,D,depth,x0,y0,x1,y1);
+		break;
+	default:
+		PacketTraversal<Generator,V,8>(generator,image,pitch)
+			.render(A,B,C,D,depth,x0,y0,x1,y1);
+		break;
+	}
+}
+
+#endif // SC4RRC__PACKETTRAVERSAL_H
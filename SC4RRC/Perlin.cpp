@@ -40,12 +40,12 @@ using std::numeric_limits;
 
 #include <SDL/SDL.h>
 
+#include "Bitmap.h"
 #include "Perlin.h"
+#include "PerlinKernels.h"
 #include "LogManager.h"
-#include "postprocessing.h"
-
-__inline float randf() { return float(rand()-(RAND_MAX/2)) / float(RAND_MAX); }
-__inline float randf(float min, float max) { return min + fabs(randf()) * (max - min); }
+#include "PostProcessor.h"
+#include "ThreadPool.h"
 
 __inline int MAX(int a, int b) { return a>b?a:b; }
 __inline int MIN(int a, int b) { return a<b?a:b; }
@@ -55,9 +55,12 @@ __inline int MIN(int a, int b) { return a<b?a:b; }
 
 
 Perlin::Perlin( int width, int height, int level, int blur, uint seed,
-				int detail, float roughness, int bottom, int peak, float water )
- :	SC4Landscape(width,height,level,blur), detail(detail), 
-	roughness(roughness), bottom(bottom), peak(peak), water(water)
+				int detail, float roughness, int bottom, int peak, float water,
+				RandomMode random_mode )
+ :	SC4Landscape(width,height,level,blur,random_mode), detail(detail), 
+	roughness(roughness), bottom(bottom), peak(peak), water(water),
+	seed(seed), terrace_mode(TERRACES_PLATEAU), world(false), world_x(0),
+	world_y(0), band_min(0.0f), band_max(0.0f)
 {
 	if(bottom < 0 || bottom > 255)
 	{
@@ -76,31 +79,36 @@ Perlin::Perlin( int width, int height, int level, int blur, uint seed,
 	}
 	
 
-	std::ostringstream* o = new std::ostringstream;
+	std::ostringstream o;
 	LogManager::endl();
 	LogManager::log("Perlin Noise Terrain Generator",true);
 	LogManager::log("Settings:",true);
-	(*o) << "  map size: " << width << " x " << height;
+	o << "  map size: " << width << " x " << height;
+	LogManager::log(o,true);
+	o << "  minimal terrain height: " << bottom;
 	LogManager::log(o,true);
-	(*o) << "  minimal terrain height: " << bottom;
+	o << "  maximal terrain height: " << peak;
 	LogManager::log(o,true);
-	(*o) << "  maximal terrain height: " << peak;
+	o << "  water percentage: " << water;
 	LogManager::log(o,true);
-	(*o) << "  water percentage: " << water;
+	o << "  blur amount: " << blur;
 	LogManager::log(o,true);
-	(*o) << "  blur amount: " << blur;
+	o << "  roughness: " << roughness;
 	LogManager::log(o,true);
-	(*o) << "  roughness: " << roughness;
+	o << "  detail level: " << detail;
 	LogManager::log(o,true);
-	(*o) << "  detail level: " << detail;
+	o << "  seed: " << seed;
 	LogManager::log(o,true);
-	(*o) << "  seed: " << seed;
+	o << "  random: " << (random_mode==HASH_RANDOM ? "HASH" : "LEGACY");
 	LogManager::log(o,true);
 	LogManager::endl();
 
-	LogManager::log("Initializing pseudorandom number generator");
+	// Older versions left the last row and column of the image empty.
+	map_width = random_mode==HASH_RANDOM ? this->width+1 : this->width;
+	map_height = random_mode==HASH_RANDOM ? this->height+1 : this->height;
 
-	srand(seed);
+	// the largest grid cell covers the whole map by default
+	world_size = MAX(this->width,this->height);
 }
 
 //-----------------------------------------------------------------------------
@@ -111,155 +119,452 @@ Perlin::~Perlin()
 
 //-----------------------------------------------------------------------------
 
-void Perlin::writeImage(const char *filename)
+void Perlin::setWorld(int x, int y, int size)
+{
+	if(random_mode != HASH_RANDOM)
+	{
+		LogManager::log("World positions need the hash random mode. "
+						"Ignoring them.",true);
+		return;
+	}
+	if(size <= 0)
+	{
+		LogManager::log("Invalid world grid size. Ignoring the world "
+						"position.",true);
+		return;
+	}
+
+	world = true;
+	world_x = x*64;
+	world_y = y*64;
+	world_size = size*64;
+
+	SC4_LOG( "  world position: " << x << " | " << y << ", grid size: " 
+			 << size );
+}
+
+//-----------------------------------------------------------------------------
+
+bool Perlin::writeImage(const char *filename)
 {
-	// 8-bit grayscale surface for the heightmap
-	SDL_Surface* image = SDL_CreateRGBSurface(SDL_SWSURFACE,width+1,height+1,8,
-											  0x000000ff,0x000000ff,0x000000ff,0);
-	// 32-bit color surface for the preview image
-	SDL_Surface* preview = SDL_CreateRGBSurface(SDL_SWSURFACE,width+1,height+1,
-												32,0,0,0,0);
+	BandResult bands = memory_budget > 0 ? writeBands(filename) 
+										 : BANDS_UNSUPPORTED;
+	if( bands != BANDS_UNSUPPORTED )
+		return bands == BANDS_WRITTEN;
 
-	SDL_LockSurface(image);
-	SDL_LockSurface(preview);
+	// the bitmap is laid out like the file, so it is saved directly
+	Bitmap& image = createImage();
 
 	LogManager::log("creating heightmap",true);
-	float* heightmap = buildHeightmap();
+	std::vector<Octave> octaves;
+	float* heightmap;
+	{
+		SC4_PROFILE("heightmap");
+		heightmap = buildHeightmap(octaves);
+	}
 
-	LogManager::log("adjusting heightmap");
-	adjustHeightmap(heightmap);
+	PostProcessor postprocessor(&image);
+	configure(postprocessor);
+	postprocessor.setWaterPercentage(water);
+	postprocessor.setLevels(terrace_mode,seed);
 
-	// build the actual heightmap image
-	for(int y=0; y<height; y++)
+	LogManager::log("adjusting heightmap");
 	{
-		for(int x=0; x<width; x++)
+		SC4_PROFILE("height range");
+		float min, max;
+		if(world)
 		{
-			Uint8 h = MIN( 255, MAX( 0, int(heightmap[x+y*width]) ) );
-
-			int ofs = x + y * image->pitch;
-			((Uint8*)image->pixels)[ofs] = h;
+			Uint32 histogram[256];
+			findRange(octaves,0,0,world_size,world_size,min,max,histogram);
+			postprocessor.setHistogram(histogram);
 		}
+		else
+		{
+			findMinMax(heightmap,min,max);
+		}
+		adjustMinMax(heightmap,map_width*map_height,min,max);
 	}
+	std::vector<Octave>().swap(octaves);
+
+	postprocessor.run(heightmap,map_width,map_height);
 
 	// the temporary heightmap is not needed anymore
 	delete[] heightmap;
 
-	blurImage(image,blur);
-    adjustWaterPercentage (image, water);
-    adjustLevels (image);
+	bool written = image.save(filename);
+	return writePreview(image) && written;
+}
 
-	LogManager::log("creating preview",true);
+//-----------------------------------------------------------------------------
 
-	for(int y=0; y<height+1; y++)
-		for(int x=0; x<width+1; x++)
-		{
-			// get height value from the grayscale heightmap
-			int ofs = x + y * image->pitch;
-			Uint8 h = ((Uint8*)image->pixels)[ofs];
+void Perlin::createSteps( int frequency, int size, 
+						  std::vector<int>& cell, std::vector<float>& weight )
+{
+	// how far you move on the gridmap for each step on the heightmap
+	float step = float(frequency) / float(size);
+
+	// The position is summed up step by step, just like it always was, 
+	// so the weights don't change by a rounding error.
+	cell.resize(size);
+	weight.resize(size);
+	float g = 0.0f;
+	for(int i=0; i<size; i++)
+	{
+		cell[i] = intfloor(g);
+		weight[i] = smooth(g - cell[i]);
+		g += step;
+	}
+}
 
-			// choose color depending on terrain height
-			Uint8 r,g,b;
-			if(h <= 83)
-			{
-				// water is blue - the deeper, the darker
-				r = (100*h)/83;
-				g = (100*h)/83;
-				b = 150 + (100*h)/83;
-			}
-			else
-			{
-				// land color goes from green (low) to red (mountains)
-				h -= 83;
-				r = 80 + (40*h)/172;
-				g = 120 - (40*h)/172;
-				b = 30;
-			}
-			ofs = x + y * preview->pitch / 4;
-			((Uint32*)preview->pixels)[ofs] = SDL_MapRGB(preview->format,r,g,b);
-		}
+//-----------------------------------------------------------------------------
+
+void Perlin::createWorldSteps( int frequency, int origin, int size, 
+							   std::vector<int>& cell, 
+							   std::vector<float>& weight )
+{
+	// The position is computed from the world position of every pixel, so
+	// a pixel gets the same weight on every map it is part of.
+	double scale = double(frequency) / double(world_size);
+	int first = int( floor( double(origin) * scale ) );
+
+	cell.resize(size);
+	weight.resize(size);
+	for(int i=0; i<size; i++)
+	{
+		double g = double(origin + i) * scale;
+		double c = floor(g);
+		cell[i] = int(c) - first;
+		weight[i] = smooth( float(g - c) );
+	}
+}
 
-	SDL_UnlockSurface(image);
-	SDL_UnlockSurface(preview);
+//-----------------------------------------------------------------------------
 
-	SDL_SaveBMP(image,filename);
-	SDL_SaveBMP(preview,"preview.bmp");
+void Perlin::createOctave( Octave& octave, int index, int frequency, 
+						   float amplitude, LegacyRandom& legacy )
+{
+	octave.frequency = frequency;
+	octave.amplitude = amplitude;
+	octave.seed = hashSeed(seed,index);
 
-	SDL_FreeSurface(image);
-	SDL_FreeSurface(preview);
+	if(random_mode == HASH_RANDOM)
+	{
+		createWorldSteps(frequency,world_x,map_width,
+						 octave.cell,octave.weight);
+		createWorldSteps(frequency,world_y,map_height,
+						 octave.row_cell,octave.row_weight);
+
+		// the rows are counted from the top of the world
+		int first_row = int( floor( double(world_y) * frequency / world_size ) );
+		for(int y=0; y<map_height; y++)
+			octave.row_cell[y] += first_row;
+
+		octave.first_column = int( floor( double(world_x) * frequency 
+										  / world_size ) );
+		octave.columns = octave.cell[map_width-1] + 2;
+		return;
+	}
+
+	octave.gridmap.resize((frequency+1)*(frequency+1));
+	for(int i=0; i<(frequency+1)*(frequency+1); i++)
+	{
+		// a random value between -0.5 and 0.5
+		float r = float(legacy.next() - LEGACY_RAND_MAX/2) 
+				/ float(LEGACY_RAND_MAX);
+		octave.gridmap[i] = r * amplitude;
+	}
+
+	octave.first_column = 0;
+	octave.columns = frequency+1;
+	createSteps(frequency,map_width,octave.cell,octave.weight);
+	createSteps(frequency,map_height,octave.row_cell,octave.row_weight);
 }
 
 //-----------------------------------------------------------------------------
 
-void Perlin::addFrequency(float *heightmap, int frequency, float amplitude)
+/** Adds up the octaves for a band of rows of the heightmap. */
+class Perlin::Renderer : public ParallelTask
 {
-	float* gridmap = new float[(frequency+1)*(frequency+1)];
-	for(int i=0; i<(frequency+1)*(frequency+1); i++)
+	const Perlin* perlin;
+	const std::vector<Octave>& octaves;
+	float* heightmap;	///< receives the rows from first_row to last_row
+	int first_row;
+	int last_row;
+	int band_height;
+
+	OctaveRowKernel addOctaveRow;
+
+	/** Computes a row of grid values of an octave in HASH_RANDOM mode. */
+	void createGridRow(const Octave& octave, int row, float* values)
 	{
-		gridmap[i] = randf() * amplitude;
+		for(int i=0; i<octave.columns; i++)
+			values[i] = perlin->getGridValue(octave,octave.first_column+i,row);
 	}
 
-	// current position on the gridmap
-	float gx = 0.0f;
-	float gy = 0.0f;
+public:
+	Renderer( const Perlin* perlin, const std::vector<Octave>& octaves,
+			  float* heightmap, int first_row, int last_row, 
+			  int band_height, OctaveRowKernel kernel )
+	: perlin(perlin),octaves(octaves),heightmap(heightmap),
+	  first_row(first_row),last_row(last_row),band_height(band_height),
+	  addOctaveRow(kernel) { }
 
-	// how far you move on the gridmap for each step on the heightmap
-	float x_step = float(frequency) / float(width);
-	float y_step = float(frequency) / float(height);
+	/** Returns the number of bands between first_row and last_row. */
+	int getNrOfBands() const
+	{
+		return (last_row - first_row + band_height - 1) / band_height;
+	}
 
-	for(int y=0; y<height; y++)
+	void execute(int band)
 	{
-		for(int x=0; x<width; x++)
+		int width = perlin->map_width;
+		int y0 = first_row + band * band_height;
+		int y1 = MIN( y0 + band_height, last_row );
+		bool hash = perlin->random_mode == HASH_RANDOM;
+
+		// In HASH_RANDOM mode, every band computes the two grid rows
+		// around its current row of every octave. Most rows of pixels 
+		// share them with the row above.
+		std::vector< std::vector<float> > grid_rows(octaves.size());
+		std::vector<int> current(octaves.size());
+		if(hash)
 		{
-			heightmap[x+y*width] += getValue(gridmap,frequency+1,gx,gy);
-			gx += x_step;
+			for(size_t d=0; d<octaves.size(); d++)
+			{
+				grid_rows[d].resize(2*octaves[d].columns);
+				current[d] = octaves[d].row_cell[y0] - 2;
+			}
+		}
+
+		for(int y=y0; y<y1; y++)
+		{
+			// The row is small enough to stay in the cache while all
+			// frequencies are added to it.
+			float* row = heightmap + (y-first_row)*width;
+			for(int x=0; x<width; x++)
+				row[x] = 0.0f;
+
+			for(size_t d=0; d<octaves.size(); d++)
+			{
+				const Octave& octave = octaves[d];
+				int pitch = octave.columns;
+				int grid_row = octave.row_cell[y];
+
+				// the grid rows above and below the current row
+				const float* above;
+				if(hash)
+				{
+					float* values = &grid_rows[d][0];
+					if(grid_row == current[d]+1)
+					{
+						memcpy(values,values+pitch,pitch*sizeof(float));
+						createGridRow(octave,grid_row+1,values+pitch);
+					}
+					else if(grid_row != current[d])
+					{
+						createGridRow(octave,grid_row,values);
+						createGridRow(octave,grid_row+1,values+pitch);
+					}
+					current[d] = grid_row;
+					above = values;
+				}
+				else
+				{
+					above = &octave.gridmap[grid_row*pitch];
+				}
+				const float* below = above + pitch;
+
+				addOctaveRow( row, width, above, below, &octave.cell[0], 
+							  &octave.weight[0], octave.row_weight[y] );
+			}
 		}
-		gx = 0.0f;
-		gy += y_step;
 	}
-}
+};
 
 //-----------------------------------------------------------------------------
 
-float* Perlin::buildHeightmap()
+void Perlin::createOctaves(std::vector<Octave>& octaves)
 {
-	// temporary heightmap for accumulating the different frequencies
-	float* heightmap = new float[width*height];
-	for(int i=0; i<width*height; i++)
-		heightmap[i] = 0.0f;
-
-	// add all the frequencies together
+	// In legacy mode, the random values are created in the same order as 
+	// they always were, so that a seed still gives the same heightmap.
+	LegacyRandom legacy(seed);
+	octaves.resize(detail);
 	int frequency = 1;
 	float amplitude = 1.0f;
 	for(int d=0; d<detail; d++)
 	{
-		addFrequency(heightmap,frequency,amplitude);
+		createOctave(octaves[d],d,frequency,amplitude,legacy);
 		frequency *= 2;
 		amplitude *= roughness;
 	}
+}
+
+//-----------------------------------------------------------------------------
+
+float* Perlin::buildHeightmap(std::vector<Octave>& octaves)
+{
+	Uint32 start = SDL_GetTicks();
+
+	createOctaves(octaves);
+	float* heightmap = new float[map_width*map_height];
+
+	SimdLevel simd = getSimdLevel();
+	SC4_LOG( "adding octaves with instruction set: " << getSimdName(simd) );
+
+	// Every band of rows is written by exactly one thread, and every row is
+	// computed the same way no matter which band it is in, so the number of
+	// threads doesn't change the heightmap.
+	ThreadPool own_pool( thread_pool ? 1 : threads );
+	ThreadPool& pool = thread_pool ? *thread_pool : own_pool;
+	Renderer renderer(this,octaves,heightmap,0,map_height,BAND_HEIGHT,
+					  getOctaveRowKernel(simd));
+	pool.run(renderer,renderer.getNrOfBands());
+
+	Uint32 ticks = SDL_GetTicks() - start;
+	SC4_LOG( "built heightmap with " << detail << " octaves in " << ticks 
+			 << " ms (" << ticks * 1000000.0 
+						   / (double(map_width)*map_height*detail) 
+			 << " ns per pixel and octave) on " << pool.getNrOfThreads()
+			 << " threads" );
 
 	return heightmap;
 }
 
 //-----------------------------------------------------------------------------
 
-void Perlin::adjustMinMax(float *heightmap)
+float Perlin::getWorldValue( const std::vector<Octave>& octaves, 
+							 double x, double y )
 {
-	// find min and max
-	float min = std::numeric_limits<float>::max();
-	float max = std::numeric_limits<float>::min();
-	for(int i=0; i < width*height; i++)
+	float value = 0.0f;
+	for(size_t d=0; d<octaves.size(); d++)
+	{
+		const Octave& octave = octaves[d];
+		double scale = double(octave.frequency) / double(world_size);
+		double gx = x * scale;
+		double gy = y * scale;
+		int x1 = int(floor(gx));
+		int y1 = int(floor(gy));
+		float wx = smooth( float(gx - x1) );
+		float wy = smooth( float(gy - y1) );
+
+		value += lerp( lerp( getGridValue(octave,x1,y1),
+							 getGridValue(octave,x1+1,y1), wx ),
+					   lerp( getGridValue(octave,x1,y1+1),
+							 getGridValue(octave,x1+1,y1+1), wx ), wy );
+	}
+	return value;
+}
+
+//-----------------------------------------------------------------------------
+
+void Perlin::findMinMax(const float* heightmap, float& min, float& max)
+{
+	min = std::numeric_limits<float>::max();
+	max = std::numeric_limits<float>::min();
+	for(int i=0; i < map_width*map_height; i++)
 	{
 		min = heightmap[i] < min ? heightmap[i] : min;
 		max = heightmap[i] > max ? heightmap[i] : max;
 	}
+}
+
+//-----------------------------------------------------------------------------
+
+void Perlin::findRange( const std::vector<Octave>& octaves, int x0, int y0,
+						int size_x, int size_y, float& min, float& max, 
+						Uint32 histogram[256] )
+{
+	Uint32 start = SDL_GetTicks();
+
+	const int n = RANGE_SAMPLES;
+	std::vector<float> samples(n*n);
+	for(int y=0; y<n; y++)
+		for(int x=0; x<n; x++)
+			samples[x + y*n] = getWorldValue( octaves, 
+											  x0 + (x+0.5) * size_x / n,
+											  y0 + (y+0.5) * size_y / n );
+
+	// numeric_limits<float>::min() is the smallest positive value, so the
+	// range starts at the first sample instead
+	min = max = samples[0];
+	for(int i=1; i < n*n; i++)
+	{
+		min = samples[i] < min ? samples[i] : min;
+		max = samples[i] > max ? samples[i] : max;
+	}
+
+	// the same quantization as in the PostProcessor
+	adjustMinMax(&samples[0],n*n,min,max);
+	memset(histogram,0,256*sizeof(Uint32));
+	for(int i=0; i < n*n; i++)
+		histogram[ MIN( 255, MAX( 0, int(samples[i]) ) ) ]++;
 
+	SC4_LOG( "sampled range " << min << " to " << max << " in "
+			 << SDL_GetTicks() - start << " ms" );
+}
+
+//-----------------------------------------------------------------------------
+
+void Perlin::adjustMinMax(float* heightmap, int size, float min, float max)
+{
 	// bring values to desired range
 	float shift = min < 0 ? -min : 0;
 	float factor = float(peak) / (max-min);
-	for(int i=0; i < width*height; i++)
+	for(int i=0; i < size; i++)
 	{
 		heightmap[i] += shift;
 		heightmap[i] *= factor;
 		heightmap[i] += float(bottom);
 	}
 }
+
+//-----------------------------------------------------------------------------
+
+bool Perlin::prepareBands(PostProcessor& postprocessor)
+{
+	// the legacy random values only exist for the whole map at once
+	if(random_mode != HASH_RANDOM)
+		return false;
+
+	postprocessor.setWaterPercentage(water);
+	postprocessor.setLevels(terrace_mode,seed);
+
+	// The whole map is never in memory, so the range and the histogram are
+	// sampled. The samples miss the most extreme values, but those are
+	// clamped later anyway.
+	createOctaves(band_octaves);
+	Uint32 histogram[256];
+	if(world)
+		findRange( band_octaves, 0, 0, world_size, world_size, 
+				   band_min, band_max, histogram );
+	else
+		findRange( band_octaves, world_x, world_y, map_width, map_height,
+				   band_min, band_max, histogram );
+	postprocessor.setHistogram(histogram);
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+
+void Perlin::renderBand( ThreadPool& pool, Uint8* rows, int pitch, 
+						 int y0, int y1 )
+{
+	int size = map_width * (y1-y0);
+	band_values.resize(size);
+
+	Renderer renderer(this,band_octaves,&band_values[0],y0,y1,BAND_HEIGHT,
+					  getOctaveRowKernel(getSimdLevel()));
+	pool.run(renderer,renderer.getNrOfBands());
+
+	adjustMinMax(&band_values[0],size,band_min,band_max);
+
+	// the same quantization as in the PostProcessor
+	for(int y=y0; y<y1; y++)
+	{
+		const float* src = &band_values[(y-y0)*map_width];
+		Uint8* dst = rows + (y-y0)*pitch;
+		for(int x=0; x<map_width; x++)
+			dst[x] = Uint8( MIN( 255, MAX( 0, int(src[x]) ) ) );
+	}
+}
@@ -26,6 +26,8 @@
 #ifndef SC4RRC__PERLIN_H
 #define SC4RRC__PERLIN_H
 
+#include <vector>
+
 #include <SDL/SDL_types.h>
 
 #include "config.hpp"
@@ -41,59 +43,116 @@ __inline int intfloor(float f) { return f >= 0 ? int(f) : int(f)-1; }
  */
 class SC4RRC_API Perlin : public SC4Landscape
 {
-	/** Interpolates between two values.
+	/** Makes the transition between two grid points smooth.
+	 *	This is the Hermite Spline f(t) = 3t-2t
+	 */
+	__inline float smooth( float w )
+	{
+		return w*w*(3.0f-2.0f*w);
+	}
+
+	/** Interpolates linearly between two values.
 	 *	@param w	Weight of b. The heigher this is, the closer the result
 	 *				will be to b.
 	 */
-	__inline float interpolate( float a, float b, float w )
+	__inline float lerp( float a, float b, float w )
 	{
-		return interpolateHermite(a,b,w);
+		return (1.0f-w)*a + w*b;
 	}
 
-	/** Interpolates between four values. */
-	__inline float interpolate( float x1y1, float x2y1, float x1y2, float x2y2, 
-							    float w_x, float w_y )
+	/** The random values of a certain frequency. */
+	struct Octave
 	{
-		return interpolate( interpolate(x1y1,x2y1,w_x),
-							interpolate(x1y2,x2y2,w_x),
-							w_y );
-	}
+		/** Number of grid cells across the map in LEGACY_RANDOM mode, or 
+		 *	across world_size pixels in HASH_RANDOM mode.
+		 */
+		int frequency;
+		float amplitude;	///< strength of this frequency
+		Uint32 seed;		///< seed of the grid values in HASH_RANDOM mode
+
+		/** (frequency+1)*(frequency+1) random values, only in 
+		 *	LEGACY_RANDOM mode. In HASH_RANDOM mode, the values are computed
+		 *	when they are needed.
+		 */
+		std::vector<float> gridmap;
+
+		int first_column;	///< the grid column of the first pixel column
+		int columns;		///< number of grid columns the map touches
+
+		/** The grid column left of every pixel column, counted from
+		 *	first_column.
+		 */
+		std::vector<int> cell;
+
+		/** The smoothed weight of the right grid column for every pixel 
+		 *	column. The columns are the same in every row, so this is 
+		 *	computed only once.
+		 */
+		std::vector<float> weight;
 
-	/** Hermite Spline interpolation function. 
-	 *	f(t) = 3t-2t
+		/** The grid row above every pixel row. */
+		std::vector<int> row_cell;
+
+		/** The smoothed weight of the grid row below every pixel row. */
+		std::vector<float> row_weight;
+	};
+
+	/** Computes the grid cell and the weight of the next grid line for
+	 *	every pixel along one axis of a closed map, just like older versions.
+	 *	@param frequency	Number of grid cells along the axis
+	 *	@param size			Number of pixels along the axis
 	 */
-	__inline float interpolateHermite( float a, float b, float w )
-	{
-		w = w*w*(3.0f-2.0f*w);
-		return (1.0f-w)*a + w*b;
-	}
+	void createSteps( int frequency, int size, 
+					  std::vector<int>& cell, std::vector<float>& weight );
 
-	/** Adds random values of a certain frequency to the heightmap.
-	 *	@param heightmap	An array of size width*height
-	 *	@param frequency	Number of random grid points in x and y direction
+	/** Same as createSteps() for pixels at a position in the world.
+	 *	@param frequency	Number of grid cells per world_size pixels
+	 *	@param origin		World position of the first pixel
+	 *	@param size			Number of pixels along the axis
+	 */
+	void createWorldSteps( int frequency, int origin, int size, 
+						   std::vector<int>& cell, std::vector<float>& weight );
+
+	/** Creates the random values of a certain frequency.
+	 *	In HASH_RANDOM mode, only the seed of the octave is created, because
+	 *	every value only depends on that seed and its position on the grid.
+	 *	@param index		Number of the octave, starting at 0
+	 *	@param frequency	Number of grid cells in x and y direction
 	 *	@param factor		Strength of the current frequency
+	 *	@param legacy		The random sequence that is used in LEGACY_RANDOM
+	 *						mode. It is shared by all octaves.
 	 */
-	void addFrequency( float* heightmap, int frequency, float factor );
-
-	/** Takes a point on the gridmap and computes the interpolated value of
-	 *	its four neighbouring grid points.
-	 *	@param gridmap	The gridmap the values are taken from.
-	 *	@param pitch	width of the gridmap
-	 *	@param x		x coordinate of the point on the gridmap
-	 *	@param y		y coordinate of the point
+	void createOctave( Octave& octave, int index, int frequency, 
+					   float factor, LegacyRandom& legacy );
+
+	/** Returns the random value of an octave at a grid point in 
+	 *	HASH_RANDOM mode.
 	 */
-	__inline float getValue( float* gridmap, int pitch, float x, float y )
+	__inline float getGridValue( const Octave& octave, int x, int y ) const
 	{
-		int x1 = intfloor(x);
-		int y1 = intfloor(y);
-		int x2 = x1+1;
-		int y2 = y1+1;
-		float wx = x-x1;
-		float wy = y-y1;
-		return interpolate( gridmap[x1+y1*pitch], gridmap[x2+y1*pitch],
-							gridmap[x1+y2*pitch], gridmap[x2+y2*pitch], wx, wy );
+		return (hashRandf(hashLattice(octave.seed,x,y)) - 0.5f) 
+			   * octave.amplitude;
 	}
 
+	/** Returns the sum of all octaves at any position in the world.
+	 *	This is slower than building the heightmap row by row, but it 
+	 *	doesn't need any memory.
+	 */
+	float getWorldValue( const std::vector<Octave>& octaves, 
+						 double x, double y );
+
+	class Renderer;
+	friend class Renderer;
+
+	/** Number of rows the heightmap is split into for the threads. */
+	static const int BAND_HEIGHT = 64;
+
+	/** Number of samples in each direction that findRange() takes. */
+	static const int RANGE_SAMPLES = 256;
+
+	/** Creates the octaves for the current settings. */
+	void createOctaves(std::vector<Octave>& octaves);
+
 	/** Builds the heightmap.
 	 *	This is where the actual Perlin Noise algorithm sits.
 	 *	A grid with random heights and relatively large grid size is created
@@ -101,25 +160,41 @@ class SC4RRC_API Perlin : public SC4Landscape
 	 *	This is repeated multiple times with smaller grid sizes and ranges for
 	 *	the random values and all of these interpolated values are added 
 	 *	together.
+	 *	All octaves are added to a row before moving on to the next one, so
+	 *	the row stays in the cache and the heightmap is written only once.
+	 *	The rows don't depend on each other, so bands of rows are computed
+	 *	in parallel.
 	 *
-	 *	@return	An array of width*height float values.
+	 *	@param octaves	Receives the octaves, they are created in here.
+	 *	@return	An array of map_width*map_height float values.
 	 */
-	float* buildHeightmap();
+	float* buildHeightmap(std::vector<Octave>& octaves);
+
+	/** Finds the lowest and highest value of the heightmap. */
+	void findMinMax(const float* heightmap, float& min, float& max);
+
+	/** Finds the range of heights on a grid of RANGE_SAMPLES x 
+	 *	RANGE_SAMPLES points that covers a rectangle of the world, and their
+	 *	histogram after adjustMinMax().
+	 *	All maps of the same world use the square from the world origin to
+	 *	(world_size|world_size) instead of their own heights, so that their
+	 *	heights match where they meet.
+	 *	@param x0,y0			The upper left corner of the rectangle
+	 *	@param size_x,size_y	The size of the rectangle in pixels
+	 */
+	void findRange( const std::vector<Octave>& octaves, int x0, int y0,
+					int size_x, int size_y, float& min, float& max, 
+					Uint32 histogram[256] );
 
 	/** Adjusts the heightmap to fit into the desired range.
 	 *	The values in the heightmap are transformed in such a way that no
 	 *	point on the heightmap is higher than the peak value or lower than
-	 *	the bottom value and that exactly the desired percentage of the
-	 *	terrain is below the waterline.
+	 *	the bottom value.
 	 *	The general features of the heightmap should still be perserved.
+	 *	@param min	The lowest value on the heightmap
+	 *	@param max	The highest value on the heightmap
 	 */
-	__inline void adjustHeightmap(float* heightmap)
-	{
-		adjustMinMax(heightmap);
-	}
-
-	/** @see adjustHeightmap */
-	void adjustMinMax(float* heightmap);
+	void adjustMinMax(float* heightmap, int size, float min, float max);
 
 	float roughness;
 	int detail;
@@ -128,6 +203,36 @@ class SC4RRC_API Perlin : public SC4Landscape
 	int peak;
 	float water;
 
+	uint seed;
+	TerraceMode terrace_mode;
+
+	/** Size of the heightmap. In HASH_RANDOM mode, the last row and column
+	 *	of the image are part of the map as well, because they are the first
+	 *	ones of the neighbouring maps.
+	 */
+	int map_width;
+	int map_height;
+
+	bool world;		///< whether setWorld() has been called
+	int world_x;	///< world position of the upper left pixel
+	int world_y;
+	int world_size;	///< size of the largest grid cell in pixels
+
+	// state of writeBands()
+	std::vector<Octave> band_octaves;
+	std::vector<float> band_values;	///< the unadjusted heights of a band
+	float band_min;					///< the sampled range of the heights
+	float band_max;
+
+	/** Samples the range and the histogram of the map. This needs 
+	 *	HASH_RANDOM mode.
+	 */
+	bool prepareBands(PostProcessor& postprocessor);
+
+	int getBandBytesPerPixel() const { return sizeof(float); }
+
+	void renderBand( ThreadPool& pool, Uint8* rows, int pitch, 
+					 int y0, int y1 );
 
 public:
 	/** @param width	@see SC4Landscape::SC4Landscape
@@ -151,14 +256,33 @@ public:
 	 *					Must be greater or equal than bottom.
 	 *	@param water	Water Percentage. The amount of water the heightmap
 	 *					should contain.
+	 *	@param random_mode
+	 *		Use LEGACY_RANDOM to get the same landscape for a seed as older
+	 *		versions.
 	 */
 	Perlin( int width, int height, int level, int blur, uint seed,
 			int detail,	float roughness=0.5, int bottom=0, int peak=255,
-			float water = 0.2f );
+			float water = 0.2f, RandomMode random_mode = HASH_RANDOM );
 
 	virtual ~Perlin();
 
-	virtual void writeImage(const char* filename);
+	/** Selects the levels that are cut into the land. */
+	void setTerraceMode(TerraceMode mode) { terrace_mode = mode; }
+
+	/** Places the map in an unbounded world, so that maps of the same world
+	 *	fit together seamlessly. Maps at (x|y) and (x+width|y) share one 
+	 *	column of pixels, and that column is the same on both maps.
+	 *	The heights and the water level are adjusted for the whole world 
+	 *	instead of each map, so the water percentage is only reached on 
+	 *	average. This needs HASH_RANDOM mode.
+	 *	@param x	Position of the upper left corner in kilometers
+	 *	@param y	Position of the upper left corner in kilometers
+	 *	@param size	Width of the largest grid cell in kilometers. It must 
+	 *				be the same for all maps of a world.
+	 */
+	void setWorld(int x, int y, int size);
+
+	virtual bool writeImage(const char* filename);
 };
 
 
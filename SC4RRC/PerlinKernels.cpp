@@ -0,0 +1,153 @@
+/******************************************************************************
+ *	file: PerlinKernels.cpp
+ *
+ *	Copyright (c) 2007, Benjamin Schug
+ *
+ *	This file is part of the SimCity 4 Random Region Creator (SC4RRC).
+ *
+ *	Sim City is a registered trademark of Electronic Arts.
+ *	This program is in no way associated with Maxis or Electronic Arts.
+ *
+ *	SC4RRC is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	SC4RRC is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#define SC4RRC_LIB
+
+#include "PerlinKernels.h"
+#include "SimdTargets.h"
+
+//-----------------------------------------------------------------------------
+
+/** Interpolates linearly between two values.
+ *	@param w	Weight of b. The heigher this is, the closer the result
+ *				will be to b.
+ */
+__inline float lerp( float a, float b, float w )
+{
+	return (1.0f-w)*a + w*b;
+}
+
+/** The plain C++ version. The others use it for the last few pixels. */
+static void addOctaveRow( float* row, int width,
+						  const float* above, const float* below,
+						  const int* cell, const float* weight, float wy )
+{
+	for(int x=0; x<width; x++)
+	{
+		int x1 = cell[x];
+		float wx = weight[x];
+		row[x] += lerp( lerp(above[x1],above[x1+1],wx),
+						lerp(below[x1],below[x1+1],wx), wy );
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+#ifdef SC4RRC_X86
+
+/** Same as lerp(), for four values at once. */
+SC4RRC_TARGET_SSE2 static __inline __m128 lerp4( __m128 a, __m128 b, 
+												 __m128 w, __m128 one )
+{
+	return _mm_add_ps( _mm_mul_ps(_mm_sub_ps(one,w),a), _mm_mul_ps(w,b) );
+}
+
+/**	SSE2 has no gather instruction, so the grid values are loaded one by
+ *	one. The interpolation itself is done on four pixels at once.
+ */
+SC4RRC_TARGET_SSE2 static void addOctaveRowSSE2( float* row, int width,
+	const float* above, const float* below,
+	const int* cell, const float* weight, float wy )
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 wy4 = _mm_set1_ps(wy);
+
+	int x = 0;
+	for( ; x+4 <= width; x+=4)
+	{
+		const int* c = cell + x;
+		__m128 a0 = _mm_setr_ps( above[c[0]], above[c[1]], 
+								 above[c[2]], above[c[3]] );
+		__m128 a1 = _mm_setr_ps( above[c[0]+1], above[c[1]+1], 
+								 above[c[2]+1], above[c[3]+1] );
+		__m128 b0 = _mm_setr_ps( below[c[0]], below[c[1]], 
+								 below[c[2]], below[c[3]] );
+		__m128 b1 = _mm_setr_ps( below[c[0]+1], below[c[1]+1], 
+								 below[c[2]+1], below[c[3]+1] );
+		__m128 wx = _mm_loadu_ps(weight + x);
+
+		__m128 value = lerp4( lerp4(a0,a1,wx,one), lerp4(b0,b1,wx,one),
+							  wy4, one );
+		_mm_storeu_ps( row + x, _mm_add_ps(_mm_loadu_ps(row + x),value) );
+	}
+
+	addOctaveRow(row+x,width-x,above,below,cell+x,weight+x,wy);
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+
+#ifdef SC4RRC_AVX2
+
+/** Same as lerp(), for eight values at once. */
+SC4RRC_TARGET_AVX2 static __inline __m256 lerp8( __m256 a, __m256 b, 
+												 __m256 w, __m256 one )
+{
+	return _mm256_add_ps( _mm256_mul_ps(_mm256_sub_ps(one,w),a),
+						  _mm256_mul_ps(w,b) );
+}
+
+/** Loads the grid values of eight pixels with gather instructions. */
+SC4RRC_TARGET_AVX2 static void addOctaveRowAVX2( float* row, int width,
+	const float* above, const float* below,
+	const int* cell, const float* weight, float wy )
+{
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 wy8 = _mm256_set1_ps(wy);
+
+	int x = 0;
+	for( ; x+8 <= width; x+=8)
+	{
+		__m256i c = _mm256_loadu_si256( (const __m256i*)(cell + x) );
+		__m256 a0 = _mm256_i32gather_ps( above, c, 4 );
+		__m256 a1 = _mm256_i32gather_ps( above + 1, c, 4 );
+		__m256 b0 = _mm256_i32gather_ps( below, c, 4 );
+		__m256 b1 = _mm256_i32gather_ps( below + 1, c, 4 );
+		__m256 wx = _mm256_loadu_ps(weight + x);
+
+		__m256 value = lerp8( lerp8(a0,a1,wx,one), lerp8(b0,b1,wx,one),
+							  wy8, one );
+		_mm256_storeu_ps( row + x, 
+						  _mm256_add_ps(_mm256_loadu_ps(row + x),value) );
+	}
+
+	addOctaveRow(row+x,width-x,above,below,cell+x,weight+x,wy);
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+
+OctaveRowKernel getOctaveRowKernel(SimdLevel level)
+{
+#ifdef SC4RRC_AVX2
+	if( level >= SIMD_AVX2 ) return addOctaveRowAVX2;
+#endif
+#ifdef SC4RRC_X86
+	if( level >= SIMD_SSE2 ) return addOctaveRowSSE2;
+#endif
+	return addOctaveRow;
+}
@@ -0,0 +1,68 @@
+/******************************************************************************
+ *	file: PerlinKernels.h
+ *
+ *	Copyright (c) 2007, Benjamin Schug
+ *
+ *	This file is part of the SimCity 4 Random Region Creator (SC4RRC).
+ *
+ *	Sim City is a registered trademark of Electronic Arts.
+ *	This program is in no way associated with Maxis or Electronic Arts.
+ *
+ *	SC4RRC is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	SC4RRC is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+/** @file
+ *	The inner loop of the Perlin Noise generator, once in plain C++ and once
+ *	for every instruction set in SimdLevel.
+ *	All versions compute exactly the same values: they do the same 
+ *	multiplications and additions in the same order, and none of them uses 
+ *	fused multiply-add. So the instruction set only changes the speed, never
+ *	the heightmap.
+ *	This needs the plain C++ code to use scalar SSE math as well, which is
+ *	always the case on x64. 32 bit builds must not use the x87 FPU, whose
+ *	higher intermediate precision gives slightly different values: the
+ *	Win32 projects are built with /arch:SSE2, and GCC needs -msse2 
+ *	-mfpmath=sse there.
+ */
+
+#ifndef SC4RRC__PERLINKERNELS_H
+#define SC4RRC__PERLINKERNELS_H
+
+#include "config.hpp"
+#include "Simd.h"
+
+/**	Adds one octave to a row of the heightmap.
+ *	For every pixel x, the four grid values around it are interpolated
+ *	horizontally with weight[x] and then vertically with wy.
+ *	@param row		The row of the heightmap, width values.
+ *	@param width	Number of pixels in the row.
+ *	@param above	The grid row above the current row.
+ *	@param below	The grid row below the current row.
+ *	@param cell		The grid column left of every pixel column.
+ *	@param weight	The weight of the right grid column for every pixel
+ *					column.
+ *	@param wy		The weight of the grid row below.
+ */
+typedef void (*OctaveRowKernel)( float* row, int width,
+								 const float* above, const float* below,
+								 const int* cell, const float* weight,
+								 float wy );
+
+/**	Returns the version of the kernel that uses the given instruction set.
+ *	If that one isn't available in this build, the next best one is returned.
+ */
+SC4RRC_API OctaveRowKernel getOctaveRowKernel(SimdLevel level);
+
+#endif // SC4RRC__PERLINKERNELS_H
@@ -0,0 +1,451 @@
+/******************************************************************************
+ *	file: PostProcessor.cpp
+ *
+ *	Copyright (c) 2007, Benjamin Schug
+ *
+ *	This file is part of the SimCity 4 Random Region Creator (SC4RRC).
+ *
+ *	Sim City is a registered trademark of Electronic Arts.
+ *	This program is in no way associated with Maxis or Electronic Arts.
+ *
+ *	SC4RRC is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	SC4RRC is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#define SC4RRC_LIB
+
+#include <string.h>
+
+#include <SDL/SDL.h>
+
+#include "Bitmap.h"
+#include "BmpWriter.h"
+#include "LogManager.h"
+#include "PostProcessor.h"
+#include "PreviewWriter.h"
+
+/** The number of bytes the second pass tries to keep in the cache. */
+static const int BAND_BYTES = 256*1024;
+
+__inline int MIN(int a, int b) { return a<b?a:b; }
+__inline int MAX(int a, int b) { return a>b?a:b; }
+
+__inline double MB(double bytes) { return bytes / (1024.0*1024.0); }
+
+//-----------------------------------------------------------------------------
+
+PostProcessor::BlurStage::BlurStage(int w, BlurMode mode)
+: w(w),mode(mode),next_row(0),rows(3*w),out(2*w)
+{
+	if( mode == BLUR_SEPARABLE )
+		sums.resize(3*w);
+}
+
+//-----------------------------------------------------------------------------
+
+const Uint8* PostProcessor::BlurStage::push(const Uint8* row)
+{
+	int y = next_row++;
+
+	// the rows are kept in a ring buffer, row y is in slot y % 3
+	Uint8* current = &rows[(y%3)*w];
+	memcpy( current, row, w );
+
+	if( mode == BLUR_SEPARABLE )
+	{
+		blurSumRow( current, &sums[(y%3)*w], w );
+
+		// the first row is on the border, so it is not changed
+		if( y == 0 ) return current;
+		if( y == 1 ) return NULL;
+
+		// row y completes row y-1
+		const Uint8* center = &rows[((y-1)%3)*w];
+		Uint8* dst = &out[0];
+		dst[0] = center[0];
+		dst[w-1] = center[w-1];
+		blurAverageRows( &sums[((y-2)%3)*w], &sums[((y-1)%3)*w],
+						 &sums[(y%3)*w], dst, w );
+		return dst;
+	}
+	else
+	{
+		// Every row is blurred with the output of the row above, so the
+		// last two output rows are kept as well.
+		Uint8* dst = &out[(y%2)*w];
+		if( y == 0 )
+		{
+			memcpy( dst, current, w );
+			return dst;
+		}
+		if( y == 1 ) return NULL;
+
+		dst = &out[((y-1)%2)*w];
+		memcpy( dst, &rows[((y-1)%3)*w], w );
+		blurRowInPlace( &out[(y%2)*w], dst, current, w );
+		return dst;
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+const Uint8* PostProcessor::BlurStage::finish()
+{
+	// the last row is on the border, so it is not changed
+	return &rows[((next_row-1)%3)*w];
+}
+
+//-----------------------------------------------------------------------------
+
+PostProcessor::PostProcessor(Bitmap* image)
+: image(image),threads(0),thread_pool(NULL),
+  image_width(image ? image->getWidth() : 0),
+  image_height(image ? image->getHeight() : 0),
+  blur_amount(0),blur_mode(BLUR_SEPARABLE),adjust_water(false),water(0.0f),
+  adjust_levels(false),terrace_mode(TERRACES_PLATEAU),seed(0),
+  finished_rows(0),count_heights(false),fixed_histogram(false),
+  apply_table(false),band_height(1),image_file(NULL),preview(NULL)
+{
+	memset( &traffic, 0, sizeof(traffic) );
+}
+
+//-----------------------------------------------------------------------------
+
+void PostProcessor::setBlur(int amount, BlurMode mode)
+{
+	blur_amount = amount;
+	blur_mode = mode;
+}
+
+//-----------------------------------------------------------------------------
+
+void PostProcessor::setWaterPercentage(float percentage)
+{
+	adjust_water = true;
+	water = percentage;
+}
+
+//-----------------------------------------------------------------------------
+
+void PostProcessor::setLevels(TerraceMode mode, int seed)
+{
+	adjust_levels = true;
+	terrace_mode = mode;
+	this->seed = seed;
+}
+
+//-----------------------------------------------------------------------------
+
+void PostProcessor::setHistogram(const Uint32 histogram[256])
+{
+	fixed_histogram = true;
+	memcpy( this->histogram, histogram, sizeof(this->histogram) );
+}
+
+//-----------------------------------------------------------------------------
+
+void PostProcessor::run()
+{
+	run(NULL,0,0);
+}
+
+//-----------------------------------------------------------------------------
+
+void PostProcessor::run(const float* heightmap, int width, int height)
+{
+	SC4_PROFILE("post-processing");
+	double pixels = double(image_width) * double(image_height);
+
+	// Bytes that reading and writing the image in separate steps would 
+	// move, to show what the two passes save.
+	traffic.quantize = heightmap ? 4.0*width*height + pixels : 0.0;
+	traffic.blur = 2.0 * pixels * blur_amount;
+	traffic.water = adjust_water ? 3.0 * pixels : 0.0;
+	traffic.levels = adjust_levels ? 3.0 * pixels : 0.0;
+	traffic.pass1 = 0.0;
+	traffic.pass2 = 0.0;
+
+	SC4_DBG( "separate steps would move: quantize " << MB(traffic.quantize) 
+			 << " MB, blur " << MB(traffic.blur) << " MB, water " 
+			 << MB(traffic.water) << " MB, levels " << MB(traffic.levels) 
+			 << " MB" );
+
+	count_heights = (adjust_water || adjust_levels) && !fixed_histogram;
+
+	// first pass
+	if( heightmap || blur_amount > 0 || count_heights )
+	{
+		SC4_PROFILE("pass 1");
+		Uint32 start = SDL_GetTicks();
+		streamRows(heightmap,width,height);
+
+		// every row is read once and written once, unless it doesn't change
+		traffic.pass1 = (heightmap ? 4.0*width*height : 0.0) + pixels;
+		if( heightmap || blur_amount > 0 )
+			traffic.pass1 += pixels;
+
+		SC4_LOG( "post-processing pass 1 (" 
+				 << (heightmap ? "quantize, " : "") << blur_amount 
+				 << " blur passes" << (count_heights ? ", histogram" : "") 
+				 << "): " << MB(traffic.pass1) << " MB in " 
+				 << SDL_GetTicks() - start << " ms" );
+	}
+
+	createTable();
+
+	// second pass
+	if( apply_table )
+	{
+		SC4_PROFILE("pass 2");
+		Uint32 start = SDL_GetTicks();
+
+		int row_bytes = image_width * 2;
+		band_height = MAX( 1, BAND_BYTES / row_bytes );
+		int nr_of_bands = (image_height + band_height - 1) / band_height;
+
+		ThreadPool own_pool( thread_pool ? 1 : threads );
+		ThreadPool& pool = thread_pool ? *thread_pool : own_pool;
+		pool.run(*this,nr_of_bands);
+
+		traffic.pass2 = 2.0 * pixels;
+
+		SC4_LOG( "post-processing pass 2 (lookup table): " 
+				 << MB(traffic.pass2) << " MB in " << SDL_GetTicks() - start 
+				 << " ms, " << nr_of_bands << " bands of " << band_height 
+				 << " rows" );
+	}
+
+	SC4_LOG( "post-processing moved " << MB(traffic.pass1 + traffic.pass2) 
+			 << " MB instead of " << MB( traffic.quantize + traffic.blur 
+										 + traffic.water + traffic.levels ) 
+			 << " MB" );
+}
+
+//-----------------------------------------------------------------------------
+
+void PostProcessor::streamRows( const float* heightmap, 
+								int hm_width, int hm_height )
+{
+	int w = image_width;
+	int h = image_height;
+	Uint8* pixels = image ? image->getPixels() : NULL;
+
+	// images that are too small to have interior pixels aren't blurred
+	stages.clear();
+	if( w >= 3 && h >= 3 )
+		stages.resize( MAX(0,blur_amount), BlurStage(w,blur_mode) );
+
+	if( count_heights )
+		memset( histogram, 0, sizeof(histogram) );
+	finished_rows = 0;
+
+	std::vector<Uint8> quantized(w);
+	for( int y=0; y<h; y++ )
+	{
+		const Uint8* row = pixels + y * image->getPitch();
+
+		if( heightmap && y < hm_height )
+		{
+			memcpy( &quantized[0], row, w );
+			const float* src = heightmap + y * hm_width;
+			for( int x=0; x < MIN(w,hm_width); x++ )
+				quantized[x] = MIN( 255, MAX( 0, int(src[x]) ) );
+			row = &quantized[0];
+		}
+
+		pushRow(0,row);
+	}
+
+	// every stage returns its last row once it has received all rows
+	for( size_t i=0; i<stages.size(); i++ )
+		pushRow( i+1, stages[i].finish() );
+}
+
+//-----------------------------------------------------------------------------
+
+void PostProcessor::pushRow(size_t stage, const Uint8* row)
+{
+	if( stage < stages.size() )
+	{
+		const Uint8* out = stages[stage].push(row);
+		if( out ) pushRow(stage+1,out);
+		return;
+	}
+
+	// The rows leave the last stage in order. The stages keep copies of 
+	// the rows they still need, so the row can be stored in the image 
+	// right away.
+	if( image_file )
+	{
+		storeRow(finished_rows++,row);
+		return;
+	}
+
+	Uint8* dst = image->getPixels() + finished_rows * image->getPitch();
+	if( dst != row )
+		memcpy( dst, row, image_width );
+	finished_rows++;
+
+	if( count_heights )
+		for( int x=0; x < image_width; x++ )
+			histogram[row[x]]++;
+}
+
+//-----------------------------------------------------------------------------
+
+void PostProcessor::createTable()
+{
+	SC4_PROFILE("lookup table");
+	for( int i=0; i<256; i++ )
+		table[i] = Uint8(i);
+
+	if( adjust_water )
+	{
+		LogManager::log("adjusting water level",true);
+		createWaterTable(histogram,water,table);
+	}
+
+	if( adjust_levels )
+	{
+		LogManager::log("adjusting levels",true);
+
+		// the histogram the image would have after the water adjustment
+		Uint32 adjusted[256];
+		memset( adjusted, 0, sizeof(adjusted) );
+		for( int i=0; i<256; i++ )
+			adjusted[table[i]] += histogram[i];
+
+		Uint8 levels[256];
+		createLevelsTable(adjusted,terrace_mode,seed,levels);
+		for( int i=0; i<256; i++ )
+			table[i] = levels[table[i]];
+	}
+
+	apply_table = false;
+	for( int i=0; i<256; i++ )
+		apply_table = apply_table || table[i] != i;
+}
+
+//-----------------------------------------------------------------------------
+
+void PostProcessor::execute(int index)
+{
+	int y0 = index * band_height;
+	int y1 = MIN( y0 + band_height, image_height );
+
+	for( int y=y0; y<y1; y++ )
+	{
+		Uint8* row = image->getPixels() + y * image->getPitch();
+		for( int x=0; x < image_width; x++ )
+			row[x] = table[row[x]];
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+void PostProcessor::beginStream( int width, int height, int band_height, 
+								 BmpWriter* image_file, 
+								 PreviewWriter* preview )
+{
+	image_width = width;
+	image_height = height;
+	this->band_height = MAX( 1, band_height );
+	this->image_file = image_file;
+	this->preview = preview;
+
+	stages.clear();
+	if( width >= 3 && height >= 3 )
+		stages.resize( MAX(0,blur_amount), BlurStage(width,blur_mode) );
+
+	count_heights = false;
+	finished_rows = 0;
+	createTable();
+
+	image_band.resize( size_t(image_file->getRowBytes()) 
+					   * this->band_height );
+
+	SC4_LOG( "streaming " << width << " x " << height << " pixels in bands of "
+			 << this->band_height << " rows through " << stages.size() 
+			 << " blur passes" );
+}
+
+//-----------------------------------------------------------------------------
+
+void PostProcessor::pushRows(const Uint8* rows, int pitch, int count)
+{
+	for( int i=0; i<count; i++ )
+		pushRow( 0, rows + i*pitch );
+}
+
+//-----------------------------------------------------------------------------
+
+void PostProcessor::endStream()
+{
+	for( size_t i=0; i<stages.size(); i++ )
+		pushRow( i+1, stages[i].finish() );
+
+	image_file = NULL;
+	preview = NULL;
+	std::vector<Uint8>().swap(image_band);
+}
+
+//-----------------------------------------------------------------------------
+
+void PostProcessor::storeRow(int y, const Uint8* row)
+{
+	int y0 = y - y % band_height;
+	int count = MIN( band_height, image_height - y0 );
+
+	// the rows of a band are stored bottom-up, just like in the file
+	int slot = count-1 - (y-y0);
+	memcpy( &image_band[ slot * image_file->getRowBytes() ], row, 
+			image_width );
+
+	if( y == y0+count-1 )
+		writeBand(y0,count);
+}
+
+//-----------------------------------------------------------------------------
+
+void PostProcessor::writeBand(int y0, int count)
+{
+	int row_bytes = image_file->getRowBytes();
+
+	if( apply_table )
+		for( int i=0; i<count; i++ )
+		{
+			Uint8* row = &image_band[ i * row_bytes ];
+			for( int x=0; x < image_width; x++ )
+				row[x] = table[row[x]];
+		}
+
+	image_file->writeRows( y0, count, &image_band[0] );
+
+	// the top row of the band is the last one in memory
+	if( preview )
+		preview->pushRows( &image_band[ (count-1) * row_bytes ], -row_bytes,
+						   count );
+}
+
+//-----------------------------------------------------------------------------
+
+size_t PostProcessor::getStreamBytes(int width, int band_height) const
+{
+	// every blur pass keeps three input rows, their sums and two output rows
+	size_t stage_bytes = size_t(width) 
+					   * (blur_mode == BLUR_SEPARABLE ? 3+6+2 : 3+2);
+	size_t band_bytes = size_t(BmpWriter::getRowBytes(width,8));
+
+	return MAX(0,blur_amount) * stage_bytes + band_height * band_bytes;
+}
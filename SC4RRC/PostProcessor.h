@@ -0,0 +1,239 @@
+/******************************************************************************
+ *	file: PostProcessor.h
+ *
+ *	Copyright (c) 2007, Benjamin Schug
+ *
+ *	This file is part of the SimCity 4 Random Region Creator (SC4RRC).
+ *
+ *	Sim City is a registered trademark of Electronic Arts.
+ *	This program is in no way associated with Maxis or Electronic Arts.
+ *
+ *	SC4RRC is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	SC4RRC is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#ifndef SC4RRC__POSTPROCESSOR_H
+#define SC4RRC__POSTPROCESSOR_H
+
+#include <vector>
+
+#include <SDL/SDL_types.h>
+
+#include "config.hpp"
+#include "postprocessing.h"
+#include "ThreadPool.h"
+
+// forward declarations
+class Bitmap;
+class BmpWriter;
+class PreviewWriter;
+
+
+/**	Runs all post-processing steps on a heightmap in two passes.
+ *	Calling blurImage(), adjustWaterPercentage() and adjustLevels() one after
+ *	another walks through the whole image once for every step and every
+ *	blur pass. The PostProcessor does the same
+ *	work, with the same result, while reading every pixel only twice:
+ *
+ *	The first pass streams the rows of the heightmap through all blur passes
+ *	at once. Each pass only keeps the last three rows it has received, so
+ *	the rows stay in the cache until they are done. The finished rows are 
+ *	counted into a histogram.
+ *	The lookup tables of the water and level adjustments only depend on
+ *	that histogram, so they are combined into a single table.
+ *	The second pass applies that table in bands of rows that fit into the
+ *	L2 cache, on a ThreadPool.
+ *
+ *	Images that don't fit into memory can be streamed instead: the rows are
+ *	passed in with pushRows() and leave the blur passes in order, so both
+ *	passes run at once and every finished band of rows is written to the 
+ *	files right away. That needs the table before the first row arrives, so
+ *	the histogram has to come from a prepass of the generator.
+ */
+class SC4RRC_API PostProcessor : public ParallelTask
+{
+public:
+	/**	The bytes that run() read and wrote in its two passes, and the bytes
+	 *	that the same steps would move if each went over the whole image.
+	 */
+	struct Traffic
+	{
+		double pass1;		///< quantize, blur and histogram, 0 if skipped
+		double pass2;		///< the lookup table, 0 if skipped
+		double quantize;
+		double blur;
+		double water;
+		double levels;
+	};
+
+private:
+	/**	One pass of the blur.
+	 *	It receives the rows of its input one after another and returns each
+	 *	output row as soon as the rows around it have arrived.
+	 */
+	class BlurStage
+	{
+		int w;
+		BlurMode mode;
+
+		int next_row;				///< number of the next row to receive
+		std::vector<Uint8> rows;	///< the last three input rows
+		std::vector<Uint16> sums;	///< their horizontal sums
+		std::vector<Uint8> out;		///< the last two output rows
+
+	public:
+		BlurStage(int w, BlurMode mode);
+
+		/**	Receives the next input row.
+		 *	@return	The output row that has been completed by this row, or
+		 *			NULL. It is valid until the next call.
+		 */
+		const Uint8* push(const Uint8* row);
+
+		/** Returns the last output row after the last row has been pushed. */
+		const Uint8* finish();
+	};
+
+	Bitmap* image;
+	int threads;
+	ThreadPool* thread_pool;
+
+	int image_width;
+	int image_height;
+
+	int blur_amount;
+	BlurMode blur_mode;
+
+	bool adjust_water;
+	float water;
+
+	bool adjust_levels;
+	TerraceMode terrace_mode;
+	int seed;
+
+	std::vector<BlurStage> stages;
+	int finished_rows;		///< number of rows that left the last blur stage
+	bool count_heights;		///< whether the first pass builds the histogram
+	Uint32 histogram[256];
+
+	/** Whether the tables are created from the histogram that was passed
+	 *	to setHistogram() instead of the one of the image.
+	 */
+	bool fixed_histogram;
+
+	Uint8 table[256];		///< the combined water and level adjustments
+	bool apply_table;		///< false if the table doesn't change anything
+	int band_height;		///< number of rows per item of the second pass
+	Traffic traffic;		///< of the last run()
+
+	BmpWriter* image_file;		///< receives the heightmap when streaming
+	PreviewWriter* preview;		///< receives the preview when streaming
+
+	/** The band of rows that is being streamed, in the order of the file. */
+	std::vector<Uint8> image_band;
+
+	/**	Quantizes the heightmap, blurs it and counts the heights.
+	 *	@param heightmap	An array of hm_width x hm_height values, or NULL
+	 *						if the image already contains the heightmap.
+	 */
+	void streamRows(const float* heightmap, int hm_width, int hm_height);
+
+	/** Hands a row to a blur stage, or stores it if it has passed them all. */
+	void pushRow(size_t stage, const Uint8* row);
+
+	/** Builds the lookup table for the second pass from the histogram. */
+	void createTable();
+
+	/** Applies the table to one band of rows. */
+	void execute(int index);
+
+	/** Stores a row that is done in the current band when streaming. */
+	void storeRow(int y, const Uint8* row);
+
+	/** Applies the table to a streamed band and writes it. */
+	void writeBand(int y0, int count);
+
+public:
+	/**	@param image	The 8-bit heightmap, or NULL for streaming. */
+	explicit PostProcessor(Bitmap* image);
+
+	virtual ~PostProcessor() { }
+
+	/**	Sets the number of threads of the second pass. 0 means one thread 
+	 *	per CPU. This doesn't change the result.
+	 */
+	void setThreads(int threads) { this->threads = threads; }
+
+	/**	Makes the second pass run on an existing pool instead of creating
+	 *	threads of its own, or on its own threads again if this is NULL.
+	 */
+	void setThreadPool(ThreadPool* pool) { thread_pool = pool; }
+
+	/** @see blurImage */
+	void setBlur(int amount, BlurMode mode);
+
+	/** Enables the water adjustment. @see adjustWaterPercentage */
+	void setWaterPercentage(float percentage);
+
+	/** Enables the level adjustment. @see adjustLevels */
+	void setLevels(TerraceMode mode, int seed);
+
+	/**	Makes the water and level adjustments use the given histogram instead
+	 *	of the one of the image. Maps that are meant to fit together must be
+	 *	adjusted with the same tables, so they need the same histogram.
+	 */
+	void setHistogram(const Uint32 histogram[256]);
+
+	/** Processes the heightmap that is stored in the image. */
+	void run();
+
+	/**	Quantizes a heightmap into the image and processes it.
+	 *	Values outside of 0-255 are clamped. Pixels outside of the heightmap
+	 *	keep the value they have in the image.
+	 *	@param heightmap	An array of width x height values.
+	 */
+	void run(const float* heightmap, int width, int height);
+
+	/** Returns the bytes that the last run() moved. */
+	const Traffic& getTraffic() const { return traffic; }
+
+	/**	Starts streaming an image that is too large to keep in memory.
+	 *	The table is created right away, so if the water or level adjustment
+	 *	is enabled, setHistogram() must be called first.
+	 *	@param band_height	Number of rows that are written to the files at
+	 *						once.
+	 *	@param image_file	An open 8-bit file that receives the heightmap.
+	 *	@param preview		An open preview that receives the finished rows,
+	 *						or NULL.
+	 */
+	void beginStream( int width, int height, int band_height, 
+					  BmpWriter* image_file, PreviewWriter* preview );
+
+	/**	Passes the next rows of the streamed image in.
+	 *	@param rows		count rows of width height values, from top to
+	 *					bottom.
+	 *	@param pitch	Number of bytes per row.
+	 */
+	void pushRows(const Uint8* rows, int pitch, int count);
+
+	/** Writes the rows that are still in the blur passes. */
+	void endStream();
+
+	/**	Returns the number of bytes that streaming an image of this width
+	 *	with the current settings keeps in memory.
+	 */
+	size_t getStreamBytes(int width, int band_height) const;
+};
+
+#endif // SC4RRC__POSTPROCESSOR_H
@@ -0,0 +1,162 @@
+/******************************************************************************
+ *	file: PreviewWriter.cpp
+ *
+ *	Copyright (c) 2007, Benjamin Schug
+ *
+ *	This file is part of the SimCity 4 Random Region Creator (SC4RRC).
+ *
+ *	Sim City is a registered trademark of Electronic Arts.
+ *	This program is in no way associated with Maxis or Electronic Arts.
+ *
+ *	SC4RRC is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	SC4RRC is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+
+#define SC4RRC_LIB
+
+#include "ColorScheme.h"
+#include "LogManager.h"
+#include "PreviewWriter.h"
+
+/** The number of bytes of preview rows that are written at once. */
+static const int BAND_BYTES = 256*1024;
+
+__inline int MIN(int a, int b) { return a<b?a:b; }
+__inline int MAX(int a, int b) { return a>b?a:b; }
+
+//-----------------------------------------------------------------------------
+
+PreviewWriter::PreviewWriter()
+: width(0),height(0),scale(1),preview_width(0),preview_height(0),
+  next_row(0),band_height(1)
+{
+}
+
+//-----------------------------------------------------------------------------
+
+bool PreviewWriter::open( const char* filename, int width, int height, 
+						  int scale, bool compress, 
+						  const ColorScheme* scheme )
+{
+	this->width = width;
+	this->height = height;
+	this->scale = MAX( 1, scale );
+	preview_width = (width + this->scale - 1) / this->scale;
+	preview_height = (height + this->scale - 1) / this->scale;
+	next_row = 0;
+
+	HeightColorScheme default_scheme;
+	Uint8 palette[3*256];
+	(scheme ? scheme : &default_scheme)->createPalette(palette);
+
+	if( !file.open( filename, preview_width, preview_height, 8, palette, 
+					compress ) )
+		return false;
+
+	sums.assign( preview_width, 0 );
+	band_height = MAX( 1, MIN( preview_height, 
+							   BAND_BYTES / file.getRowBytes() ) );
+	band.assign( size_t(band_height) * file.getRowBytes(), 0 );
+
+	SC4_DBG( "writing a preview of " << preview_width << " x " 
+			 << preview_height << " pixels" 
+			 << (compress ? ", compressed" : "") );
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+
+bool PreviewWriter::pushRows(const Uint8* rows, int pitch, int count)
+{
+	if( count <= 0 ) return true;
+
+	// rows that are laid out like the file are written as they are
+	if( scale == 1 && pitch == -file.getRowBytes() )
+	{
+		bool ok = file.writeRows( next_row, count, rows + (count-1)*pitch );
+		next_row += count;
+		return ok;
+	}
+
+	bool ok = true;
+	for( int i=0; i<count; i++ )
+	{
+		addRow( rows + i*pitch );
+		next_row++;
+		if( next_row % scale == 0 || next_row == height )
+			ok = finishRow() && ok;
+	}
+	return ok;
+}
+
+//-----------------------------------------------------------------------------
+
+void PreviewWriter::addRow(const Uint8* row)
+{
+	for( int x=0; x < preview_width; x++ )
+	{
+		const Uint8* src = row + x*scale;
+		int count = MIN( scale, width - x*scale );
+
+		Uint32 sum = 0;
+		for( int i=0; i<count; i++ )
+			sum += src[i];
+		sums[x] += sum;
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+bool PreviewWriter::finishRow()
+{
+	int y = (next_row-1) / scale;
+	int rows = next_row - y*scale;
+
+	// the rows of a band are stored bottom-up, just like in the file
+	int y0 = y - y % band_height;
+	int count = MIN( band_height, preview_height - y0 );
+	Uint8* dst = &band[ size_t(count-1 - (y-y0)) * file.getRowBytes() ];
+
+	for( int x=0; x < preview_width; x++ )
+	{
+		// the squares on the right and bottom border may be smaller
+		Uint32 pixels = Uint32( rows * MIN( scale, width - x*scale ) );
+		dst[x] = Uint8( (sums[x] + pixels/2) / pixels );
+		sums[x] = 0;
+	}
+
+	if( y == y0+count-1 )
+		return file.writeRows( y0, count, &band[0] );
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+
+bool PreviewWriter::close()
+{
+	if( next_row != height )
+		SC4_LOG( "the preview received " << next_row << " of " << height 
+				 << " rows" );
+	return file.close();
+}
+
+//-----------------------------------------------------------------------------
+
+size_t PreviewWriter::getBytes(int width, int scale)
+{
+	int preview_width = (width + MAX(1,scale) - 1) / MAX(1,scale);
+	int row_bytes = BmpWriter::getRowBytes(preview_width,8);
+	return sizeof(Uint32) * preview_width + MAX( BAND_BYTES, row_bytes );
+}
@@ -0,0 +1,106 @@
+/******************************************************************************
+ *	file: PreviewWriter.h
+ *
+ *	Copyright (c) 2007, Benjamin Schug
+ *
+ *	This file is part of the SimCity 4 Random Region Creator (SC4RRC).
+ *
+ *	Sim City is a registered trademark of Electronic Arts.
+ *	This program is in no way associated with Maxis or Electronic Arts.
+ *
+ *	SC4RRC is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	SC4RRC is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+
+#ifndef SC4RRC__PREVIEWWRITER_H
+#define SC4RRC__PREVIEWWRITER_H
+
+#include <vector>
+
+#include <SDL/SDL_types.h>
+
+#include "BmpWriter.h"
+#include "config.hpp"
+
+// forward declarations
+class ColorScheme;
+
+
+/**	Writes the preview of a heightmap.
+ *	The preview is the finished heightmap with the colors of a ColorScheme
+ *	as its palette, so it is an 8-bit file that can be compressed with 
+ *	BI_RLE8. Water is flat, so large seas shrink to a few bytes per row.
+ *	The preview can be smaller than the heightmap: every pixel is then the
+ *	average height of a square of scale x scale pixels.
+ *	The rows of the heightmap are passed in from top to bottom, either all 
+ *	at once or in bands, so a preview of a streamed image is never kept in
+ *	memory either.
+ */
+class SC4RRC_API PreviewWriter
+{
+	BmpWriter file;
+	int width;				///< width of the heightmap
+	int height;				///< height of the heightmap
+	int scale;
+	int preview_width;
+	int preview_height;
+
+	int next_row;				///< next row of the heightmap
+	std::vector<Uint32> sums;	///< sums of the current preview row
+	int band_height;			///< preview rows that are written at once
+	std::vector<Uint8> band;	///< preview rows in the order of the file
+
+	/** Adds a row of the heightmap to the sums of its preview row. */
+	void addRow(const Uint8* row);
+
+	/** Stores the averages of the current preview row in the band. */
+	bool finishRow();
+
+	// not copyable
+	PreviewWriter(const PreviewWriter&);
+	PreviewWriter& operator=(const PreviewWriter&);
+
+public:
+	PreviewWriter();
+
+	/**	Creates the file.
+	 *	@param width, height	Size of the heightmap.
+	 *	@param scale		1 for a preview of the same size as the heightmap,
+	 *						n for 1/n of its width and height.
+	 *	@param compress		true for compressing the file with BI_RLE8.
+	 *	@param scheme		The colors, or NULL for the default colors.
+	 *	@return	false if the file couldn't be created.
+	 */
+	bool open( const char* filename, int width, int height, int scale, 
+			   bool compress, const ColorScheme* scheme );
+
+	/**	Passes the next rows of the finished heightmap in.
+	 *	@param rows		count rows of width heights, from top to bottom.
+	 *	@param pitch	Number of bytes from one row to the next one below
+	 *					it. It may be negative.
+	 *	@return	false if the preview couldn't be written.
+	 */
+	bool pushRows(const Uint8* rows, int pitch, int count);
+
+	/**	Closes the file after all rows have been passed in.
+	 *	@return	false if the file couldn't be completed.
+	 */
+	bool close();
+
+	/** Returns the number of bytes a preview writer keeps in memory. */
+	static size_t getBytes(int width, int scale);
+};
+
+#endif // SC4RRC__PREVIEWWRITER_H
@@ -0,0 +1,166 @@
+/******************************************************************************
+ *	file: Random.h
+ *
+ *	Copyright (c) 2007, Benjamin Schug
+ *
+ *	This file is part of the SimCity 4 Random Region Creator (SC4RRC).
+ *
+ *	Sim City is a registered trademark of Electronic Arts.
+ *	This program is in no way associated with Maxis or Electronic Arts.
+ *
+ *	SC4RRC is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	SC4RRC is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+/** @file
+ *	Pseudo random functions without global state.
+ *	The terrain generators need random values that only depend on a seed, so
+ *	they used to call srand(seed) followed by rand(). That modifies the global
+ *	state of the C runtime, can't be used from multiple threads at once and
+ *	gives different results with every C runtime.
+ *	The functions in here compute random values directly from the seed. There
+ *	are two sets of them: The legacy functions reproduce the values of older
+ *	versions, the hash functions are faster and have a much better 
+ *	distribution.
+ */
+
+#ifndef SC4RRC__RANDOM_H
+#define SC4RRC__RANDOM_H
+
+#include <SDL/SDL_types.h>
+
+/** Selects the pseudo random functions a terrain generator uses. */
+enum RandomMode
+{
+	LEGACY_RANDOM,	///< reproduces the maps of older versions
+	HASH_RANDOM		///< stateless hash functions
+};
+
+//-----------------------------------------------------------------------------
+//		legacy functions
+//-----------------------------------------------------------------------------
+
+/** The largest value legacyRand() can return. */
+const int LEGACY_RAND_MAX = 0x7fff;
+
+/**	Returns the first value of rand() after calling srand(seed).
+ *	This replicates the linear congruential generator of the Microsoft C
+ *	runtime that all released versions of the SC4RRC were built with, so
+ *	it produces the same maps as before on every platform.
+ */
+__inline int legacyRand(int seed)
+{
+	Uint32 holdrand = Uint32(seed) * 214013u + 2531011u;
+	return int((holdrand >> 16) & 0x7fff);
+}
+
+/** Same as legacyRand(), but scaled to the range [0,1]. */
+__inline float legacyRandf(int seed)
+{
+	return (float)legacyRand(seed) / (float)LEGACY_RAND_MAX;
+}
+
+/**	A sequence of random values, just like srand() and rand().
+ *	This is the same generator as legacyRand(), but it keeps its state in the
+ *	object instead of the C runtime.
+ */
+class LegacyRandom
+{
+	Uint32 holdrand;
+
+public:
+	explicit LegacyRandom(Uint32 seed) : holdrand(seed) { }
+
+	/** Returns the next value between 0 and LEGACY_RAND_MAX. */
+	int next()
+	{
+		holdrand = holdrand * 214013u + 2531011u;
+		return int((holdrand >> 16) & 0x7fff);
+	}
+};
+
+//-----------------------------------------------------------------------------
+//		hash functions
+//-----------------------------------------------------------------------------
+
+/**	Mixes the bits of a seed.
+ *	Every input bit affects every output bit, so even consecutive seeds give
+ *	completely unrelated values. This is the 32 bit finalizer that is also 
+ *	used by splitmix-style generators.
+ */
+__inline Uint32 hashSeed(Uint32 x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+/**	Returns the index-th value of the random sequence for a seed.
+ *	This is the counter-based equivalent of calling srand(seed) and then
+ *	calling rand() index+1 times.
+ */
+__inline Uint32 hashSeed(Uint32 seed, Uint32 index)
+{
+	return hashSeed(seed + 0x9e3779b9u * (index + 1));
+}
+
+/**	Creates a new seed from two other seeds.
+ *	The result doesn't depend on the order of the arguments, i.e.
+ *	hashSeeds(a,b) = hashSeeds(b,a) for all a,b.
+ */
+__inline Uint32 hashSeeds(Uint32 seed1, Uint32 seed2)
+{
+	Uint32 lo = seed1 < seed2 ? seed1 : seed2;
+	Uint32 hi = seed1 < seed2 ? seed2 : seed1;
+	return hashSeed(hashSeed(lo) + hi);
+}
+
+/**	Creates the seed of a point on an unbounded grid.
+ *	Neighbouring points get completely unrelated seeds.
+ */
+__inline Uint32 hashLattice(Uint32 seed, int x, int y)
+{
+	return hashSeed( hashSeed(seed,Uint32(x)), Uint32(y) );
+}
+
+/** Returns a value in the range [0,1) that only depends on the seed. */
+__inline float hashRandf(Uint32 seed)
+{
+	// 24 bits are exactly what a float can hold
+	return float(hashSeed(seed) >> 8) * (1.0f / 16777216.0f);
+}
+
+//-----------------------------------------------------------------------------
+
+/** Returns a value between 0 and 1 that only depends on the seed. */
+__inline float seedRandf(RandomMode mode, int seed)
+{
+	return mode == HASH_RANDOM ? hashRandf(Uint32(seed)) : legacyRandf(seed);
+}
+
+/**	Creates the seeds for the four corners of a map.
+ *	In legacy mode, these are the first four values of rand() after calling
+ *	srand(seed), just like in older versions.
+ */
+__inline void createCornerSeeds(int seed, RandomMode mode, int seeds[4])
+{
+	LegacyRandom legacy(seed);
+	for(int i=0; i<4; i++)
+		seeds[i] = mode == HASH_RANDOM ? int(hashSeed(seed,i)) : legacy.next();
+}
+
+#endif // SC4RRC__RANDOM_H
@@ -0,0 +1,190 @@
+/******************************************************************************
+ *	file: SC4Landscape.cpp
+ *
+ *	Copyright (c) 2007, Benjamin Schug
+ *
+ *	This file is part of the SimCity 4 Random Region Creator (SC4RRC).
+ *
+ *	Sim City is a registered trademark of Electronic Arts.
+ *	This program is in no way associated with Maxis or Electronic Arts.
+ *
+ *	SC4RRC is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	SC4RRC is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#define SC4RRC_LIB
+
+#include <math.h>
+#include <vector>
+
+#include <SDL/SDL.h>
+
+#include "Bitmap.h"
+#include "BmpWriter.h"
+#include "LogManager.h"
+#include "PreviewWriter.h"
+#include "SC4Landscape.h"
+
+__inline double MB(double bytes) { return bytes / (1024.0*1024.0); }
+
+//-----------------------------------------------------------------------------
+
+const float SC4Landscape::DEFAULT_MIN_TRIANGLE_SIZE = 0.0f;
+
+//-----------------------------------------------------------------------------
+
+SC4Landscape::~SC4Landscape()
+{
+	delete own_image;
+}
+
+//-----------------------------------------------------------------------------
+
+int SC4Landscape::getTriangleDepth(int detail) const
+{
+	if( min_triangle_size <= 0.0f )
+		return detail;
+
+	double edge = sqrt( double(width)*width + double(height)*height );
+	int depth = 0;
+	while( depth < detail && edge >= min_triangle_size )
+	{
+		edge *= 0.5;
+		depth++;
+	}
+	return depth;
+}
+
+//-----------------------------------------------------------------------------
+
+BandResult SC4Landscape::writeBands(const char* filename)
+{
+	int w = width+1;
+	int h = height+1;
+
+	PostProcessor postprocessor(NULL);
+	configure(postprocessor);
+
+	LogManager::log("preparing bands",true);
+	Uint32 start = SDL_GetTicks();
+	bool prepared;
+	{
+		SC4_PROFILE("prepass");
+		prepared = prepareBands(postprocessor);
+	}
+	if( !prepared )
+	{
+		LogManager::log("This generator can't render bands of rows. "
+						"Keeping the whole image in memory.",true);
+		return BANDS_UNSUPPORTED;
+	}
+	SC4_LOG( "prepass took " << SDL_GetTicks() - start << " ms" );
+
+	// Each row of a band is rendered, post-processed and written, and the
+	// blur passes need a few rows regardless of the band height.
+	size_t fixed_bytes = postprocessor.getStreamBytes(w,0)
+					   + PreviewWriter::getBytes(w,preview_scale);
+	size_t row_bytes = postprocessor.getStreamBytes(w,1) 
+					 - postprocessor.getStreamBytes(w,0)
+					 + size_t(w) * (1 + getBandBytesPerPixel());
+	size_t budget = size_t(memory_budget) * 1024 * 1024;
+	int band_height = 1;
+	if( budget > fixed_bytes + row_bytes )
+		band_height = int( (budget - fixed_bytes) / row_bytes );
+	if( band_height > h )
+		band_height = h;
+
+	SC4_LOG( "memory budget " << memory_budget << " MB: bands of " 
+			 << band_height << " rows, " 
+			 << MB( fixed_bytes + double(row_bytes) * band_height ) 
+			 << " MB for the images instead of " 
+			 << MB( double(w) * h * (1 + getBandBytesPerPixel()) ) 
+			 << " MB" );
+
+	BmpWriter image_file;
+	PreviewWriter preview;
+	if( !image_file.open(filename,w,h,8) || 
+		!preview.open( preview_file.c_str(), w, h, preview_scale, 
+					   compress_preview, color_scheme ) )
+		return BANDS_FAILED;
+
+	LogManager::log("creating heightmap",true);
+	start = SDL_GetTicks();
+
+	SC4_PROFILE("heightmap");
+	postprocessor.beginStream(w,h,band_height,&image_file,&preview);
+
+	ThreadPool own_pool( thread_pool ? 1 : threads );
+	ThreadPool& pool = thread_pool ? *thread_pool : own_pool;
+	std::vector<Uint8> band( size_t(w) * band_height );
+	for( int y0=0; y0<h; y0+=band_height )
+	{
+		int y1 = y0 + band_height < h ? y0 + band_height : h;
+		{
+			SC4_PROFILE("render band");
+			renderBand(pool,&band[0],w,y0,y1);
+		}
+		SC4_PROFILE("post-process band");
+		postprocessor.pushRows(&band[0],w,y1-y0);
+	}
+
+	postprocessor.endStream();
+	bool written = image_file.close();
+	written = preview.close() && written;
+	if( !written )
+	{
+		SC4_LOG( "couldn't finish " << filename << " and " << preview_file );
+		return BANDS_FAILED;
+	}
+
+	SC4_LOG( "wrote " << (h + band_height - 1) / band_height << " bands in " 
+			 << SDL_GetTicks() - start << " ms" );
+	return BANDS_WRITTEN;
+}
+
+//-----------------------------------------------------------------------------
+
+Bitmap& SC4Landscape::createImage()
+{
+	Bitmap* image = image_buffer;
+	if( !image )
+	{
+		if( !own_image ) own_image = new Bitmap();
+		image = own_image;
+	}
+
+	image->create(width+1,height+1,8);
+	return *image;
+}
+
+//-----------------------------------------------------------------------------
+
+bool SC4Landscape::writePreview(const Bitmap& image) const
+{
+	SC4_PROFILE("preview");
+	Uint32 start = SDL_GetTicks();
+
+	PreviewWriter preview;
+	if( !preview.open( preview_file.c_str(), image.getWidth(), 
+					   image.getHeight(), preview_scale, compress_preview, 
+					   color_scheme ) )
+		return false;
+
+	bool ok = preview.pushRows( image.getPixels(), image.getPitch(), 
+								image.getHeight() );
+	ok = preview.close() && ok;
+
+	SC4_LOG( "wrote the preview in " << SDL_GetTicks() - start << " ms" );
+	return ok;
+}
@@ -27,7 +27,33 @@
 #ifndef SC4LANDSCAPE_H
 #define SC4LANDSCAPE_H
 
+#include <string>
+
 #include "config.hpp"
+#include "ColorScheme.h"
+#include "PostProcessor.h"
+#include "Random.h"
+
+// forward declarations
+class Bitmap;
+
+
+/** Selects how the dynamic triangle grids compute the heightmap. */
+enum GenerationMode
+{
+	PER_PIXEL,	///< descend from the base triangles for every pixel
+	RASTERIZE,	///< split every triangle once and fill in its pixels
+	CACHE_TOP_LEVELS,	///< like PER_PIXEL, but look up the first splits in a table
+	PACKETS		///< descend with packets of neighbouring pixels together
+};
+
+/** Tells what SC4Landscape::writeBands() did. */
+enum BandResult
+{
+	BANDS_UNSUPPORTED,	///< the generator can't render bands, nothing was written
+	BANDS_WRITTEN,		///< the heightmap and the preview have been written
+	BANDS_FAILED		///< the bands were rendered, but a file couldn't be written
+};
 
 
 /**	Base class for fractal terrain generators. */
@@ -39,6 +65,55 @@ protected:
 	int level; 
 	int blur;
 
+	/** Number of threads used for generating the heightmap. 
+	 *	0 means one thread per CPU.
+	 */
+	int threads;
+
+	/** The pool that runs the threads, NULL for creating new threads for
+	 *	every heightmap.
+	 */
+	ThreadPool* thread_pool;
+
+	/** The pseudo random functions that are used for the terrain. */
+	RandomMode random_mode;
+
+	/** How the heightmap is computed. Not all generators support all modes. */
+	GenerationMode generation_mode;
+
+	/** The number of pixels that descend together with PACKETS. */
+	int packet_width;
+
+	/** The dynamic triangle grids don't split triangles whose edges are all
+	 *	shorter than this many pixels. 0 for always reaching the detail level.
+	 *	@see setMinTriangleSize()
+	 */
+	float min_triangle_size;
+
+	/** How the heightmap is blurred. */
+	BlurMode blur_mode;
+
+	/** The colors of the preview, NULL for the default colors. */
+	const ColorScheme* color_scheme;
+
+	/** Memory in megabytes that writeBands() may use, 0 for no limit. */
+	int memory_budget;
+
+	/** The preview is 1/preview_scale of the size of the heightmap. */
+	int preview_scale;
+
+	/** Whether the preview is compressed with BI_RLE8. */
+	bool compress_preview;
+
+	/** Name of the preview file. */
+	std::string preview_file;
+
+	/** The bitmap that createImage() returns, NULL for a new one. */
+	Bitmap* image_buffer;
+
+	/** The bitmap that createImage() has created, if any. */
+	Bitmap* own_image;
+
 	/** The absolute maximum height on the heightmap. */
 	static const int MAX_HEIGHT = 255;
 
@@ -47,21 +122,189 @@ protected:
 	 *	@param level	Average height above sea level. You can use this to
 	 *					shift the land up or down.
 	 *	@param blur		the amount of blur that should be added to the final heightmap
+	 *	@param random_mode	LEGACY_RANDOM if you want to reproduce the maps of 
+	 *						older versions.
 	 */
-	SC4Landscape( int width, int height, int level, int blur)
-	: width(width*64),height(height*64),level(level),blur(blur) 
+	SC4Landscape( int width, int height, int level, int blur,
+				  RandomMode random_mode = HASH_RANDOM )
+	: width(width*64),height(height*64),level(level),blur(blur),threads(0),
+	  thread_pool(NULL),
+	  random_mode(random_mode),generation_mode(PER_PIXEL),packet_width(8),
+	  min_triangle_size(DEFAULT_MIN_TRIANGLE_SIZE),blur_mode(BLUR_SEPARABLE),
+	  color_scheme(NULL),memory_budget(0),
+	  preview_scale(1),compress_preview(false),preview_file("preview.bmp"),
+	  image_buffer(NULL),own_image(NULL)
 	{ }
 
+	/**	Passes the settings of this generator that concern the 
+	 *	post-processing on to a PostProcessor.
+	 */
+	void configure(PostProcessor& postprocessor) const
+	{
+		postprocessor.setThreads(threads);
+		postprocessor.setThreadPool(thread_pool);
+		postprocessor.setBlur(blur,blur_mode);
+	}
+
+	/**	Returns how often the dynamic triangle grids split the base triangles:
+	 *	the detail level, or less if the triangles would get smaller than
+	 *	min_triangle_size. Every split halves the edges of all triangles, 
+	 *	starting with the diagonal of the map, so this is the same for every
+	 *	pixel.
+	 */
+	int getTriangleDepth(int detail) const;
+
+	/**	Returns an 8-bit bitmap of the size of the heightmap with all pixels
+	 *	set to 0. This is the image buffer if one has been set, otherwise a
+	 *	bitmap that is deleted along with the generator.
+	 */
+	Bitmap& createImage();
+
+	/**	Saves the preview of a finished heightmap.
+	 *	@return	false if the file couldn't be written.
+	 */
+	bool writePreview(const Bitmap& image) const;
+
+	/**	Generates the heightmap and the preview in bands of rows and writes
+	 *	every band to the files as soon as it is done, so that no more than
+	 *	memory_budget megabytes are used no matter how large the region is.
+	 *	Generators that support this call it from writeImage() if a budget
+	 *	has been set.
+	 *	@return	BANDS_UNSUPPORTED if the generator can't render bands, nothing
+	 *			has been written then. BANDS_FAILED if the heightmap or the 
+	 *			preview couldn't be created or written completely.
+	 */
+	BandResult writeBands(const char* filename);
+
+	/**	Prepares rendering bands of rows.
+	 *	This is the prepass of writeBands(): it enables the post-processing
+	 *	steps of the generator and passes the histogram of the whole map to
+	 *	the PostProcessor if they need one.
+	 *	@return	false if this generator can't render bands.
+	 */
+	virtual bool prepareBands(PostProcessor& /*postprocessor*/) 
+	{ 
+		return false; 
+	}
+
+	/**	Returns the number of bytes per pixel that renderBand() needs in
+	 *	addition to the rows it returns.
+	 */
+	virtual int getBandBytesPerPixel() const { return 0; }
+
+	/**	Renders the rows y0 up to, but not including, y1 of the heightmap.
+	 *	@param rows		Receives the rows, starting with row y0.
+	 *	@param pitch	Number of bytes per row.
+	 */
+	virtual void renderBand( ThreadPool& /*pool*/, Uint8* /*rows*/, 
+							 int /*pitch*/, int /*y0*/, int /*y1*/ ) { }
+
 public:
-	virtual ~SC4Landscape() { }
+	virtual ~SC4Landscape();
 
 	/**	Creates a heightmap and a preview map and saves them. 
 	 *	The heightmap is saved as an 8-Bit BMP file with the given filename.
 	 *	The preview map that is only meant to give you a feel of what the 
-	 *	region will look like in the game will be saved as a 32-Bit BMP file
-	 *	called preview.bmp.
+	 *	region will look like in the game will be saved as an 8-Bit BMP file
+	 *	with a color palette called preview.bmp, unless setPreviewFile()
+	 *	chooses another name.
+	 *	@return	false if one of the files couldn't be written.
+	 */
+	virtual bool writeImage(const char* filename) = 0;
+
+	/**	Sets the number of threads that are used for generating the 
+	 *	heightmap. This doesn't change the resulting heightmap.
+	 *	@param threads	The number of threads. If this is 0, one thread per
+	 *					CPU is used.
+	 */
+	void setThreads(int threads) { this->threads = threads; }
+
+	/**	Lets the generator run its threads on an existing pool instead of
+	 *	starting new threads for every heightmap, which saves the time for
+	 *	creating them when many heightmaps are generated one after another.
+	 *	The number of threads is then the one of the pool. The generator
+	 *	doesn't take ownership of the pool. NULL creates new threads again.
+	 */
+	void setThreadPool(ThreadPool* pool) { thread_pool = pool; }
+
+	/**	Sets how the heightmap is computed. This doesn't change the resulting
+	 *	heightmap either. Generators that don't support a mode ignore it.
+	 */
+	void setGenerationMode(GenerationMode mode) { generation_mode = mode; }
+
+	/**	Sets how many neighbouring pixels descend together with PACKETS: 4,
+	 *	8 or 16. Other numbers use 8.
+	 */
+	void setPacketWidth(int pixels) { packet_width = pixels; }
+
+	/**	Stops splitting the triangles of the dynamic triangle grids once they
+	 *	are smaller than a pixel. This makes high detail levels as fast as 
+	 *	the highest level that still matters for the size of the region. 
+	 *	Further splits only displace the vertices by fractions of a step, but
+	 *	these add up and the heights are rounded down, so some pixels end up
+	 *	a few steps higher or lower than with all levels. That's why this is
+	 *	off by default: a seed has to give the same map as before. Without 
+	 *	it, the triangle grid still skips the random numbers once they can't
+	 *	move a vertex by a whole step anymore, which gives the same map. The
+	 *	debug grid keeps fractional heights, so it has no such point. The other
+	 *	generators ignore it. The smooth triangle grid displaces its vertices
+	 *	by the length of the edges including their height difference, which
+	 *	doesn't shrink along with the triangles, so it always needs all 
+	 *	levels.
+	 *	@param pixels	The length of the longest edge below which triangles
+	 *					aren't split anymore. 0, the default, always splits 
+	 *					them as often as the detail level says.
+	 */
+	void setMinTriangleSize(float pixels) { min_triangle_size = pixels; }
+
+	/** The default of setMinTriangleSize(). */
+	static const float DEFAULT_MIN_TRIANGLE_SIZE;
+
+	/**	Sets how the heightmap is blurred. Use BLUR_IN_PLACE to get the same
+	 *	heightmaps as older versions.
+	 */
+	void setBlurMode(BlurMode mode) { blur_mode = mode; }
+
+	/**	Sets the colors of the preview image. The generator doesn't take
+	 *	ownership of the scheme, so it must exist until writeImage() returns.
+	 *	NULL selects the default colors.
+	 */
+	void setColorScheme(const ColorScheme* scheme) { color_scheme = scheme; }
+
+	/**	Limits the memory that is used for the images. If this is set, the
+	 *	generators that can render the heightmap in bands of rows never keep
+	 *	the whole image in memory, so regions can be larger than the RAM.
+	 *	The others ignore it.
+	 *	@param megabytes	The limit, 0 for keeping the whole image in 
+	 *						memory.
+	 */
+	void setMemoryBudget(int megabytes) { memory_budget = megabytes; }
+
+	/**	Sets the size and the compression of the preview. This doesn't
+	 *	change the heightmap.
+	 *	@param scale	1 for a preview of the same size as the heightmap,
+	 *					n for one pixel per square of n x n pixels.
+	 *	@param compress	true for compressing the preview with BI_RLE8.
+	 */
+	void setPreview(int scale, bool compress)
+	{
+		preview_scale = scale;
+		compress_preview = compress;
+	}
+
+	/** Sets the name of the preview file. */
+	void setPreviewFile(const std::string& filename) 
+	{ 
+		preview_file = filename; 
+	}
+
+	/**	Lets the generators that keep the whole heightmap in memory render
+	 *	it into this bitmap instead of allocating a new one. Generating many
+	 *	regions one after another with the same buffer saves allocating and
+	 *	clearing fresh memory for each of them. The generator doesn't take
+	 *	ownership of the bitmap. NULL makes it allocate its own again.
 	 */
-	virtual void writeImage(const char* filename) = 0;
+	void setImageBuffer(Bitmap* image) { image_buffer = image; }
 };
 
 #endif // SC4LANDSCAPE_H
\ No newline at end of file
@@ -0,0 +1,118 @@
+/******************************************************************************
+ *	file: Simd.cpp
+ *
+ *	Copyright (c) 2007, Benjamin Schug
+ *
+ *	This file is part of the SimCity 4 Random Region Creator (SC4RRC).
+ *
+ *	Sim City is a registered trademark of Electronic Arts.
+ *	This program is in no way associated with Maxis or Electronic Arts.
+ *
+ *	SC4RRC is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	SC4RRC is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#define SC4RRC_LIB
+
+#include "Simd.h"
+#include "SimdTargets.h"
+
+#if defined(SC4RRC_X86) && defined(_MSC_VER)
+#	include <intrin.h>
+#elif defined(SC4RRC_X86)
+#	include <cpuid.h>
+#endif
+
+//-----------------------------------------------------------------------------
+
+#ifdef SC4RRC_X86
+
+/** Executes the cpuid instruction. */
+static void cpuid(int leaf, int subleaf, unsigned int regs[4])
+{
+#ifdef _MSC_VER
+	int r[4];
+	__cpuidex(r,leaf,subleaf);
+	for( int i=0; i<4; i++ ) regs[i] = (unsigned int)r[i];
+#else
+	__cpuid_count(leaf,subleaf,regs[0],regs[1],regs[2],regs[3]);
+#endif
+}
+
+/** Returns the state components the operating system saves, see xgetbv. */
+static unsigned long long getEnabledStates()
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	unsigned int lo, hi;
+	__asm__ __volatile__( "xgetbv" : "=a"(lo), "=d"(hi) : "c"(0) );
+	return ((unsigned long long)hi << 32) | lo;
+#endif
+}
+
+/** Asks the CPU which instruction sets it supports. */
+static SimdLevel detectSimdLevel()
+{
+	unsigned int regs[4];
+	cpuid(0,0,regs);
+	int max_leaf = int(regs[0]);
+
+	cpuid(1,0,regs);
+	bool sse2 = (regs[3] & (1u << 26)) != 0;
+	bool osxsave = (regs[2] & (1u << 27)) != 0;
+	if( !sse2 ) return SIMD_NONE;
+
+#ifdef SC4RRC_AVX2
+	// AVX2 also needs an operating system that saves the YMM registers
+	if( osxsave && max_leaf >= 7 && (getEnabledStates() & 6) == 6 )
+	{
+		cpuid(7,0,regs);
+		if( regs[1] & (1u << 5) ) return SIMD_AVX2;
+	}
+#else
+	(void)osxsave; (void)max_leaf;
+#endif
+
+	return SIMD_SSE2;
+}
+
+#else
+
+static SimdLevel detectSimdLevel() { return SIMD_NONE; }
+
+#endif
+
+//-----------------------------------------------------------------------------
+
+SimdLevel getSimdLevel()
+{
+	// Detecting the same thing twice at the same time is harmless, so this
+	// needs no locking.
+	static int level = -1;
+	if( level < 0 ) level = detectSimdLevel();
+	return SimdLevel(level);
+}
+
+//-----------------------------------------------------------------------------
+
+const char* getSimdName(SimdLevel level)
+{
+	switch( level )
+	{
+	case SIMD_SSE2: return "SSE2";
+	case SIMD_AVX2: return "AVX2";
+	default:		return "none";
+	}
+}
@@ -0,0 +1,47 @@
+/******************************************************************************
+ *	file: Simd.h
+ *
+ *	Copyright (c) 2007, Benjamin Schug
+ *
+ *	This file is part of the SimCity 4 Random Region Creator (SC4RRC).
+ *
+ *	Sim City is a registered trademark of Electronic Arts.
+ *	This program is in no way associated with Maxis or Electronic Arts.
+ *
+ *	SC4RRC is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	SC4RRC is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#ifndef SC4RRC__SIMD_H
+#define SC4RRC__SIMD_H
+
+#include "config.hpp"
+
+/** The SIMD instruction sets that kernels can be written for. */
+enum SimdLevel
+{
+	SIMD_NONE,	///< plain C++
+	SIMD_SSE2,	///< 4 floats per instruction, every x86-64 CPU has this
+	SIMD_AVX2	///< 8 floats per instruction and gather loads
+};
+
+/**	Returns the best instruction set that both this CPU and this build 
+ *	support. The result is determined once and then cached.
+ */
+SC4RRC_API SimdLevel getSimdLevel();
+
+/** Returns the name of an instruction set for the log. */
+SC4RRC_API const char* getSimdName(SimdLevel level);
+
+#endif // SC4RRC__SIMD_H
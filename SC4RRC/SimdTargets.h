@@ -0,0 +1,64 @@
+/******************************************************************************
+ *	file: SimdTargets.h
+ *
+ *	Copyright (c) 2007, Benjamin Schug
+ *
+ *	This file is part of the SimCity 4 Random Region Creator (SC4RRC).
+ *
+ *	Sim City is a registered trademark of Electronic Arts.
+ *	This program is in no way associated with Maxis or Electronic Arts.
+ *
+ *	SC4RRC is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	SC4RRC is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+/** @file
+ *	Compiler specific macros for functions that use SIMD instruction sets
+ *	the rest of the program doesn't require. Such functions may only be 
+ *	called after getSimdLevel() has confirmed the CPU supports them.
+ *	This header is only meant for the source files that contain kernels.
+ */
+
+#ifndef SC4RRC__SIMDTARGETS_H
+#define SC4RRC__SIMDTARGETS_H
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#	define SC4RRC_X86
+#endif
+
+#ifdef SC4RRC_X86
+#	ifdef _MSC_VER
+		// MSVC allows all intrinsics in every function. AVX2 intrinsics
+		// came with Visual Studio 2012.
+#		define SC4RRC_TARGET_SSE2
+#		define SC4RRC_TARGET_AVX2
+#		if _MSC_VER >= 1700
+#			define SC4RRC_AVX2
+#		endif
+#	else
+		// GCC and Clang need to be told which functions may use them. FMA
+		// is left out on purpose, so that a*b+c is never fused and the
+		// kernels round exactly like the plain C++ code, as long as that
+		// doesn't use the x87 FPU (see PerlinKernels.h).
+#		define SC4RRC_TARGET_SSE2 __attribute__((target("sse2")))
+#		define SC4RRC_TARGET_AVX2 __attribute__((target("avx2")))
+#		define SC4RRC_AVX2
+#	endif
+#	include <emmintrin.h>
+#	ifdef SC4RRC_AVX2
+#		include <immintrin.h>
+#	endif
+#endif
+
+#endif // SC4RRC__SIMDTARGETS_H
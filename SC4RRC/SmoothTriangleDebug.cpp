@@ -30,21 +30,21 @@
 #include <SDL/SDL.h>
 #include <assert.h>
 
+#include "Bitmap.h"
 #include "LogManager.h"
+#include "PostProcessor.h"
 #include "SmoothTriangleDebug.h"
+#include "TileRenderer.h"
+#include "TriangleRasterizer.h"
 
 #pragma warning(disable:4244)
 
 namespace debugtriangle
 {
 
-__inline float randf() { return (float)rand() / (float)RAND_MAX; }
 __inline int MAX(int a, int b) { return a>b?a:b; }
 __inline int MIN(int a, int b) { return a<b?a:b; }
 
-const int COLORDEPTH = 32;
-const int BYTESPERPIXEL = 4;
-
 //-----------------------------------------------------------------------------
 
 const float DynamicTriangleGrid::MAX_HEIGHT = 255.0f;
@@ -53,11 +53,11 @@ const float DynamicTriangleGrid::MAX_HEIGHT = 255.0f;
 
 DynamicTriangleGrid::DynamicTriangleGrid(int width, int height, int level, 
 										 int blur, int detail, float steepness,
-										 int seed)
-: SC4Landscape(width,height,level,blur),steepness(steepness),detail(detail)
+										 int seed, RandomMode random_mode)
+: SC4Landscape(width,height,level,blur,random_mode),steepness(steepness),detail(detail)
 {
-	std::ostringstream* o = new std::ostringstream;
-	(*o) << "Settings: " << std::endl
+	std::ostringstream o;
+	o << "Settings: " << std::endl
 		 << "width = " << width << std::endl
 		 << "height = " << height << std::endl
 		 << "level = " << level << std::endl
@@ -65,15 +65,17 @@ DynamicTriangleGrid::DynamicTriangleGrid(int width, int height, int level,
 		 << "generator = DYNAMIC TRIANGLE GRID" << std::endl
 		 << "steepness = " << steepness << std::endl
 		 << "detail level = " << detail << std::endl << std::endl
-		 << "seed = " << seed << std::endl;
+		 << "seed = " << seed << std::endl
+		 << "random = " << (random_mode==HASH_RANDOM ? "HASH" : "LEGACY") << std::endl;
 	LogManager::log(o,true);
 
-	srand(seed);
+	int seeds[4];
+	createCornerSeeds(seed,random_mode,seeds);
 
-	A = Vertex(        0.f,         0.f, 0.f, rand() );
-	B = Vertex( width*64.f,         0.f, 0.f, rand() );
-	C = Vertex( width*64.f, height*64.f, 0.f, rand() );
-	D = Vertex(        0.f, height*64.f, 0.f, rand() );
+	A = Vertex(        0.f,         0.f, 0.f, seeds[0] );
+	B = Vertex( width*64.f,         0.f, 0.f, seeds[1] );
+	C = Vertex( width*64.f, height*64.f, 0.f, seeds[2] );
+	D = Vertex(        0.f, height*64.f, 0.f, seeds[3] );
 
 	A.pos.z = createHeight( A.seed, level, MAX_HEIGHT );
 	B.pos.z = createHeight( B.seed, level, MAX_HEIGHT );
@@ -85,8 +87,8 @@ DynamicTriangleGrid::DynamicTriangleGrid(int width, int height, int level,
 
 float DynamicTriangleGrid::createHeight( int seed, float base, float max )
 {
-	srand(seed);
-	float deviation = max * steepness * randf() - (max*steepness)/2.0f;
+	float deviation = max * steepness * seedRandf(random_mode,seed)
+					- (max*steepness)/2.0f;
 	return MAX(0.0f, MIN( MAX_HEIGHT, base + deviation ));
 }
 
@@ -95,14 +97,11 @@ float DynamicTriangleGrid::createHeight( int seed, float base, float max )
 float DynamicTriangleGrid::getHeightAt(float x, float y, int detail)
 {
 	// find out which top-level triangle the point is on
-	Vec2f u = B.pos2D()-A.pos2D();
-	Vec2f v = D.pos2D()-A.pos2D();
-	Vec2f p = Vec2f(x,y) - A.pos2D();
-
-	float lambda = (p.x*v.y-p.y*v.x)/(u.x*v.y-u.y*v.x);
-	float mue = (p.y*u.x-p.x*u.y)/(u.x*v.y-u.y*v.x);
+	float lambda, mue;
+	barycentric( x, y, A.pos.x, A.pos.y, B.pos.x, B.pos.y, D.pos.x, D.pos.y,
+				 lambda, mue );
 
-	if( lambda+mue <= 1 )
+	if( chooseBaseTriangle(lambda,mue) == BASE_ABD )
 	{
 		// triangle ABD
 		return _getHeightAt(x,y,A,B,D,detail);
@@ -120,12 +119,9 @@ float DynamicTriangleGrid::_getHeightAtTriangle(float x, float y,
 												Vertex a, Vertex b, Vertex c)
 {
 	// find position on triangle using barycentric coordinates
-	Vec2f u = b.pos2D()-a.pos2D();
-	Vec2f v = c.pos2D()-a.pos2D();
-	Vec2f p = Vec2f(x,y) - a.pos2D();
-
-	float lambda = (p.x*v.y-p.y*v.x)/(u.x*v.y-u.y*v.x);
-	float mue = (p.y*u.x-p.x*u.y)/(u.x*v.y-u.y*v.x);
+	float lambda, mue;
+	barycentric( x, y, a.pos.x, a.pos.y, b.pos.x, b.pos.y, c.pos.x, c.pos.y,
+				 lambda, mue );
 
 	// interpolate height values of the vertices
 	return (1-lambda-mue)*a.pos.z + lambda*b.pos.z + mue*c.pos.z;
@@ -138,44 +134,25 @@ float DynamicTriangleGrid::_getHeightAt(float x, float y,
 {
 	if(depth==0) return _getHeightAtTriangle(x,y,a,b,c);
 
-	Vec2f u = b.pos2D()-a.pos2D();
-	Vec2f v = c.pos2D()-a.pos2D();
-	Vec2f w = c.pos2D()-b.pos2D();
-	Vec2f p = Vec2f(x,y) - a.pos2D();
-
-	float ab_length = length(u);
-	float ac_length = length(v);
-	float bc_length = length(w);
-
-	float lambda = (p.x*v.y-p.y*v.x)/(u.x*v.y-u.y*v.x);
-	float mue = (p.y*u.x-p.x*u.y)/(u.x*v.y-u.y*v.x);
+	float lambda, mue;
+	barycentric( x, y, a.pos.x, a.pos.y, b.pos.x, b.pos.y, c.pos.x, c.pos.y,
+				 lambda, mue );
 
-	// create seeds at edge midpoints
-	float s_ab = interpolateSeeds(a.seed,b.seed);
-	float s_ac = interpolateSeeds(a.seed,c.seed);
-	float s_bc = interpolateSeeds(b.seed,c.seed);
-
-	// create heights at edge midpoints
-	float h_ab = createHeight( s_ab, (a.pos.z+b.pos.z)/2, length(u)*0.5 );
-	float h_ac = createHeight( s_ac, (a.pos.z+c.pos.z)/2, length(v)*0.5 );
-	float h_bc = createHeight( s_bc, (b.pos.z+c.pos.z)/2, length(w)*0.5 );
-
-	// create edge midpoints
-	Vertex AB = Vertex( (a.pos.x+b.pos.x)*0.5, (a.pos.y+b.pos.y)*0.5, h_ab, s_ab );
-	Vertex AC = Vertex( (a.pos.x+c.pos.x)*0.5, (a.pos.y+c.pos.y)*0.5, h_ac, s_ac );
-	Vertex BC = Vertex( (c.pos.x+b.pos.x)*0.5, (c.pos.y+b.pos.y)*0.5, h_bc, s_bc );
+	Vertex AB, AC, BC;
+	splitTriangle(a,b,c,AB,AC,BC);
 
-	if( lambda+mue <= 0.5 )
+	SubTriangle sub = chooseSubTriangle(lambda,mue);
+	if( sub == SUB_A )
 	{
 		// "lower left" triangle (at point a)
 		return _getHeightAt(x,y,a,AB,AC,depth-1);
 	}
-	if( lambda > 0.5 )
+	if( sub == SUB_B )
 	{
 		// "lower right" triangle (at point b)
 		return _getHeightAt(x,y,AB,b,BC,depth-1);
 	}
-	if( mue > 0.5 )
+	if( sub == SUB_C )
 	{
 		// "top" triangle (at point c)
 		return _getHeightAt(x,y,AC,BC,c,depth-1);
@@ -185,99 +162,162 @@ float DynamicTriangleGrid::_getHeightAt(float x, float y,
 		// middle triangle
 		return _getHeightAt(x,y,AB,AC,BC,depth-1);
 	}
-
 }
 
 //-----------------------------------------------------------------------------
 
-/**	Blurs the image.
- *	This function assigns to each pixel the average of all surrounding pixels.
- *	This is repeated <blur_amount> times.
- */
-void blurImage(SDL_Surface* image, int blur_amount)
+void DynamicTriangleGrid::splitTriangle( const Vertex& a, const Vertex& b, 
+										 const Vertex& c, Vertex& AB, 
+										 Vertex& AC, Vertex& BC )
 {
-	LogManager::log("blurring image",true);
-
-	for(int i=0; i<blur_amount; i++)
-		for(int y=1; y<image->h-1; y++)
-			for(int x=1; x<image->w-1; x++)
-			{
-				int sum=0;
-				int nr_of_samples=0;
-
-				for(int yy=y-1; yy<=y+1; yy++)
-				{
-					for(int xx=x-1; xx<=x+1; xx++)
-					{
-						int ofs = xx + yy * image->pitch;
-						sum += ((Uint8*)image->pixels)[ofs];
-						nr_of_samples++;
-					}
-				}
-
-				int ofs = x+y*image->pitch;
-				((Uint8*)image->pixels)[ofs] = (sum/nr_of_samples);
-			}
+	Vec2f u = b.pos2D()-a.pos2D();
+	Vec2f v = c.pos2D()-a.pos2D();
+	Vec2f w = c.pos2D()-b.pos2D();
+
+	// create seeds at edge midpoints
+	int s_ab = interpolateSeeds(a.seed,b.seed);
+	int s_ac = interpolateSeeds(a.seed,c.seed);
+	int s_bc = interpolateSeeds(b.seed,c.seed);
+
+	// create heights at edge midpoints
+	float h_ab = createHeight( s_ab, (a.pos.z+b.pos.z)/2, length(u)*0.5 );
+	float h_ac = createHeight( s_ac, (a.pos.z+c.pos.z)/2, length(v)*0.5 );
+	float h_bc = createHeight( s_bc, (b.pos.z+c.pos.z)/2, length(w)*0.5 );
+
+	// create edge midpoints
+	AB = Vertex( (a.pos.x+b.pos.x)*0.5, (a.pos.y+b.pos.y)*0.5, h_ab, s_ab );
+	AC = Vertex( (a.pos.x+c.pos.x)*0.5, (a.pos.y+c.pos.y)*0.5, h_ac, s_ac );
+	BC = Vertex( (c.pos.x+b.pos.x)*0.5, (c.pos.y+b.pos.y)*0.5, h_bc, s_bc );
 }
 
 //-----------------------------------------------------------------------------
 
-void DynamicTriangleGrid::writeImage(const char *filename)
+//-----------------------------------------------------------------------------
+
+class DynamicTriangleGrid::Renderer : public TileRenderer
 {
-	SDL_Surface* image = SDL_CreateRGBSurface(SDL_SWSURFACE,width+1,height+1,8,
-											  0xff,0xff,0xff,0);
-	SDL_Surface* preview = SDL_CreateRGBSurface(SDL_SWSURFACE,width+1,height+1,
-												32,0,0,0,0);
-	
-	SDL_LockSurface(image);
-	SDL_LockSurface(preview);
+	DynamicTriangleGrid* grid;
+	int depth;	///< how often the base triangles are split
 
-	LogManager::log("creating heightmap",true);
+	Uint8 renderPixel(int x, int y)
+	{
+		return (Uint8)(int)grid->getHeightAt( (float)x, (float)y, depth );
+	}
 
-	// this is the only difference from the StaticTriangleGrid's writeImage()
-	for( int y=0; y<height+1; y++ )
-		for( int x=0; x<width+1; x++ )
-		{	
-			int h = (int) getHeightAt( (float)x, (float)y, detail );
-			int ofs = x + y * image->pitch;
-			((Uint8*)image->pixels)[ofs] = (Uint8)h;
+	void renderTile( Uint8* pixels, int pitch, 
+					 int x0, int y0, int x1, int y1 )
+	{
+		if( grid->generation_mode != RASTERIZE )
+		{
+			TileRenderer::renderTile(pixels,pitch,x0,y0,x1,y1);
+			return;
 		}
 
-	blurImage(image,blur);
+		TriangleRasterizer<Renderer,Vertex> rasterizer(*this,pixels,pitch);
+		rasterizer.rasterize( grid->A, grid->B, grid->C, grid->D, depth,
+							  x0, y0, x1, y1 );
+	}
 
-	LogManager::log("creating preview",true);
-	for(int y=0; y<height+1; y++)
-		for(int x=0; x<width+1; x++)
-		{
-			int ofs = x + y * image->pitch;
-			Uint8 h = ((Uint8*)image->pixels)[ofs];
-
-			Uint8 r,g,b;
-			if(h <= 83)
-			{
-				r = (100*h)/83;
-				g = (100*h)/83;
-				b = 150 + (100*h)/83;
-			}
-			else
-			{
-				h -= 83;
-				r = 80 + (40*h)/172;
-				g = 120 - (40*h)/172;
-				b = 30;
-			}
-			ofs = x + y * preview->pitch / 4;
-			((Uint32*)preview->pixels)[ofs] = SDL_MapRGB(preview->format,r,g,b);
-		}
+public:
+	Renderer(DynamicTriangleGrid* grid, Bitmap* image)
+	: TileRenderer(image),grid(grid),
+	  depth(grid->getTriangleDepth(grid->detail)) { }
+
+	Renderer(DynamicTriangleGrid* grid, int width, int height)
+	: TileRenderer(width,height),grid(grid),
+	  depth(grid->getTriangleDepth(grid->detail)) { }
+
+	// interface for the TriangleRasterizer
+	static float getX(const Vertex& v) { return v.pos.x; }
+	static float getY(const Vertex& v) { return v.pos.y; }
+
+	void splitTriangle( const Vertex& a, const Vertex& b, const Vertex& c,
+						Vertex& ab, Vertex& ac, Vertex& bc )
+	{
+		grid->splitTriangle(a,b,c,ab,ac,bc);
+	}
+
+	Uint8 getPixel( int x, int y, 
+					const Vertex& a, const Vertex& b, const Vertex& c )
+	{
+		return (Uint8)(int)grid->_getHeightAtTriangle( (float)x, (float)y,
+													   a, b, c );
+	}
+
+	struct Point
+	{
+		float x, y;
+	};
+
+	Point getPoint(int x, int y)
+	{
+		Point p = { (float)x, (float)y };
+		return p;
+	}
 
-	SDL_UnlockSurface(image);
-	SDL_UnlockSurface(preview);
+	bool pointsMove() const { return false; }
 
-	SDL_SaveBMP(image,filename);
-	SDL_SaveBMP(preview,"preview.bmp");
+	BaseTriangle chooseBaseTriangle(Point& p)
+	{
+		const DynamicTriangleGrid& g = *grid;
+		float lambda, mue;
+		barycentric( p.x, p.y, g.A.pos.x, g.A.pos.y, g.B.pos.x, g.B.pos.y,
+					 g.D.pos.x, g.D.pos.y, lambda, mue );
+		return ::chooseBaseTriangle(lambda,mue);
+	}
 
-	SDL_FreeSurface(image);
-	SDL_FreeSurface(preview);
+	SubTriangle chooseSubTriangle( Point& p, const Vertex& a, 
+								   const Vertex& b, const Vertex& c )
+	{
+		float lambda, mue;
+		barycentric( p.x, p.y, a.pos.x, a.pos.y, b.pos.x, b.pos.y,
+					 c.pos.x, c.pos.y, lambda, mue );
+		return ::chooseSubTriangle(lambda,mue);
+	}
+};
+
+//-----------------------------------------------------------------------------
+
+bool DynamicTriangleGrid::writeImage(const char *filename)
+{
+	BandResult bands = memory_budget > 0 ? writeBands(filename) 
+										 : BANDS_UNSUPPORTED;
+	if( bands != BANDS_UNSUPPORTED )
+		return bands == BANDS_WRITTEN;
+
+	// the bitmap is laid out like the file, so it is saved directly
+	Bitmap& image = createImage();
+	
+	LogManager::log("creating heightmap",true);
+	if( getTriangleDepth(detail) < detail )
+		SC4_LOG( "splitting the triangles " << getTriangleDepth(detail) 
+				 << " times instead of " << detail 
+				 << ", they are smaller than a pixel then" );
+
+	// this is the only difference from the StaticTriangleGrid's writeImage()
+	{
+		SC4_PROFILE("heightmap");
+		ThreadPool own_pool( thread_pool ? 1 : threads );
+		ThreadPool& pool = thread_pool ? *thread_pool : own_pool;
+		Renderer renderer(this,&image);
+		renderer.render(pool);
+	}
+
+	PostProcessor postprocessor(&image);
+	configure(postprocessor);
+	postprocessor.run();
+
+	bool written = image.save(filename);
+	return writePreview(image) && written;
+}
+
+//-----------------------------------------------------------------------------
+
+void DynamicTriangleGrid::renderBand( ThreadPool& pool, Uint8* rows, 
+									  int pitch, int y0, int y1 )
+{
+	Renderer renderer(this,width+1,height+1);
+	renderer.renderRows(pool,rows,pitch,y0,y1);
 }
 
 }
\ No newline at end of file
@@ -55,7 +55,7 @@ struct Vertex
 	Vertex() : seed(1) { }
 	Vertex( float x, float y, float z, int seed ) : pos(x,y,z),seed(seed) { }
 
-	Vec2f pos2D() { return Vec2f(pos.x,pos.y); }
+	Vec2f pos2D() const { return Vec2f(pos.x,pos.y); }
 };
 
 
@@ -95,12 +95,17 @@ class SC4RRC_API DynamicTriangleGrid : public SC4Landscape
 	 */
 	__inline int interpolateSeeds( int seed1, int seed2 )
 	{ 
+		if(random_mode == HASH_RANDOM)
+			return int(hashSeeds(seed1,seed2));
+
 		// If you just add the two seeds, the distribution of the random values
 		// is far from uniform. The 99 is just an arbitrary value, and the random
 		// values are still not really uniformly distributed but it's much 
 		// better than with any other number I tried and should really be 
 		// sufficient for our purposes.
-		return seed1+seed2+99;
+		// Older versions stored the result in a float, which rounds off the
+		// lower bits of large seeds. The legacy maps depend on that.
+		return (int)(float)(seed1+seed2+99);
 	}
 	
 	/**	Returns the terrain height at position (x|y).
@@ -125,10 +130,31 @@ class SC4RRC_API DynamicTriangleGrid : public SC4Landscape
 	 */
 	float _getHeightAtTriangle(float x, float y, Vertex a, Vertex b, Vertex c);
 
+	/**	Splits the triangle abc into four sub-triangles.
+	 *	Creates the midpoints of the edges and moves them up or down by a 
+	 *	random amount.
+	 *	@param ab,ac,bc		Receive the new vertices.
+	 */
+	void splitTriangle( const Vertex& a, const Vertex& b, const Vertex& c,
+						Vertex& ab, Vertex& ac, Vertex& bc );
+
+	/**	Computes the heightmap tile by tile, either using getHeightAt() or
+	 *	the TriangleRasterizer.
+	 */
+	class Renderer;
+	friend class Renderer;
+
+	/** The triangles can be rendered in any order, so bands just work. */
+	bool prepareBands(PostProcessor& /*postprocessor*/) { return true; }
+
+	void renderBand( ThreadPool& pool, Uint8* rows, int pitch, 
+					 int y0, int y1 );
+
 public:
 	/**	@param detail	
 	 *		Detail level for the triangle grid. Defines how often the base 
-	 *		triangles will be split. 
+	 *		triangles will be split. Triangles that are already smaller than
+	 *		a pixel are not split anymore, see setMinTriangleSize().
 	 *
 	 *	@param steepness
 	 *		Influences how "rough" the resulting landscape will be. The newly
@@ -143,19 +169,24 @@ public:
 	 *		you will always get the same landscape. This way, if you find a
 	 *		landscape with a shape that you like, you can adjust the level, 
 	 *		blur and steepness settings to give it that final touch.
+	 *
+	 *	@param random_mode
+	 *		Use LEGACY_RANDOM to get the same landscape for a seed as older
+	 *		versions did.
 	 */
 	DynamicTriangleGrid( int width, int height, int level, int blur,
-						 int detail, float steepness, int seed );
+						 int detail, float steepness, int seed,
+						 RandomMode random_mode = HASH_RANDOM );
 
 	virtual ~DynamicTriangleGrid() { }
 
 	/**	Creates a heightmap and a preview map and saves them. 
 	 *	The heightmap is saved as a 8-Bit BMP file with the given filename.
 	 *	The preview map that is only meant to give you a feel of what the 
-	 *	region will look like in the game will be saved as a 32-Bit BMP file
+	 *	region will look like in the game will be saved as a 24-Bit BMP file
 	 *	called preview.bmp.
 	 */
-	void writeImage(const char* filename);
+	bool writeImage(const char* filename);
 };
 
 } // namespace debugtriangle
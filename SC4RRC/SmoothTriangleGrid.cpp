@@ -29,28 +29,30 @@
 
 #include <SDL/SDL.h>
 
-#include "SmoothTriangleGrid.h"
+#include "Bitmap.h"
 #include "LogManager.h"
+#include "PacketTraversal.h"
+#include "PostProcessor.h"
+#include "SmoothTriangleGrid.h"
+#include "TileRenderer.h"
+#include "TriangleRasterizer.h"
 
 
-__inline float randf() { return (float)rand() / (float)RAND_MAX; }
 __inline int MAX(int a, int b) { return a>b?a:b; }
 __inline int MIN(int a, int b) { return a<b?a:b; }
 
-// implemented in TriangleGrid.cpp
-void blurImage(SDL_Surface* image, int blur_amount);
-
 //-----------------------------------------------------------------------------
 
 SmoothTriangleGrid::SmoothTriangleGrid( int width, int height, int level, 
 									    int blur, int detail, float steepness,
-										int seed )
-										: SC4Landscape(width,height,level,blur),
+										int seed, RandomMode random_mode )
+										: SC4Landscape(width,height,level,blur,
+													   random_mode),
 										  detail(detail),steepness(steepness),
 										  MAX_HEIGHT(255.0f), MIN_HEIGHT(0.0f)
 {
-	std::ostringstream* o = new std::ostringstream;
-	(*o) << "Settings: " << std::endl
+	std::ostringstream o;
+	o << "Settings: " << std::endl
 		 << "width = " << width << std::endl
 		 << "height = " << height << std::endl
 		 << "level = " << level << std::endl
@@ -58,15 +60,17 @@ SmoothTriangleGrid::SmoothTriangleGrid( int width, int height, int level,
 		 << "generator = SMOOTH TRIANGLE GRID" << std::endl
 		 << "steepness = " << steepness << std::endl
 		 << "detail level = " << detail << std::endl << std::endl
-		 << "seed = " << seed << std::endl;
+		 << "seed = " << seed << std::endl
+		 << "random = " << (random_mode==HASH_RANDOM ? "HASH" : "LEGACY") << std::endl;
 	LogManager::log(o,true);
 
-	srand(seed);
+	int seeds[4];
+	createCornerSeeds(seed,random_mode,seeds);
 
-	A = SmoothVertex( Vec3f(    0,       0,    0), Vec3f(0,0,1), rand() );
-	B = SmoothVertex( Vec3f(width*64,    0,	   0), Vec3f(0,0,1), rand() );
-	C = SmoothVertex( Vec3f(width*64,height*64,0), Vec3f(0,0,1), rand() );
-	D = SmoothVertex( Vec3f(	0,	 height*64,0), Vec3f(0,0,1), rand() );
+	A = SmoothVertex( Vec3f(    0,       0,    0), Vec3f(0,0,1), seeds[0] );
+	B = SmoothVertex( Vec3f(width*64,    0,	   0), Vec3f(0,0,1), seeds[1] );
+	C = SmoothVertex( Vec3f(width*64,height*64,0), Vec3f(0,0,1), seeds[2] );
+	D = SmoothVertex( Vec3f(	0,	 height*64,0), Vec3f(0,0,1), seeds[3] );
 
 	A.pos.z = displaceHeight( A.seed, (float)level, MAX_HEIGHT );
 	B.pos.z = displaceHeight( B.seed, (float)level, MAX_HEIGHT );
@@ -78,8 +82,7 @@ SmoothTriangleGrid::SmoothTriangleGrid( int width, int height, int level,
 
 float SmoothTriangleGrid::displaceHeight(int seed, float base, float max)
 {
-	srand(seed);
-	float deviation = max * randf() - max/2.0f;
+	float deviation = max * seedRandf(random_mode,seed) - max/2.0f;
 	return MAX(MIN_HEIGHT, MIN( MAX_HEIGHT, base + deviation ));
 }
 
@@ -88,14 +91,11 @@ float SmoothTriangleGrid::displaceHeight(int seed, float base, float max)
 float SmoothTriangleGrid::getHeightAt(int x, int y, int detail)
 {
 	// find out which top-level triangle the point is on
-	Vec2f u = B.pos2d()-A.pos2d();
-	Vec2f v = D.pos2d()-A.pos2d();
-	Vec2f p = Vec2f(x,y)-A.pos2d();
-
-	float lambda = ( p.x * v.y - p.y * v.x ) / ( u.x * v.y - u.y * v.x );
-	float mue =    ( p.y * u.x - p.x * u.y ) / ( u.x * v.y - u.y * v.x );
+	float lambda, mue;
+	barycentric( (float)x, (float)y, A.pos.x, A.pos.y, B.pos.x, B.pos.y,
+				 D.pos.x, D.pos.y, lambda, mue );
 
-	if( lambda+mue <= 1 )
+	if( chooseBaseTriangle(lambda,mue) == BASE_ABD )
 	{
 		// triangle ABD
 		return _getHeightAt(x,y,A,B,D,detail);
@@ -117,13 +117,47 @@ float SmoothTriangleGrid::_getHeightAt( int x, int y,
 {
 	if(depth==0) return _getHeightAtTriangle(x,y,a,b,c);
 
+	float lambda, mue;
+	barycentric( (float)x, (float)y, a.pos.x, a.pos.y, b.pos.x, b.pos.y,
+				 c.pos.x, c.pos.y, lambda, mue );
+
+	SmoothVertex AB, AC, BC;
+	splitTriangle(a,b,c,AB,AC,BC);
+
+	SubTriangle sub = chooseSubTriangle(lambda,mue);
+	if( sub == SUB_A )
+	{
+		// "lower left" triangle (at point a)
+		return _getHeightAt(x,y,a,AB,AC,depth-1);
+	}
+	if( sub == SUB_B )
+	{
+		// "lower right" triangle (at point b)
+		return _getHeightAt(x,y,AB,b,BC,depth-1);
+	}
+	if( sub == SUB_C )
+	{
+		// "top" triangle (at point c)
+		return _getHeightAt(x,y,AC,BC,c,depth-1);
+	}
+	else
+	{
+		// middle triangle
+		return _getHeightAt(x,y,AB,AC,BC,depth-1);
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+void SmoothTriangleGrid::splitTriangle( const SmoothVertex& a, 
+										const SmoothVertex& b,
+										const SmoothVertex& c, 
+										SmoothVertex& AB, SmoothVertex& AC,
+										SmoothVertex& BC )
+{
 	Vec3f u = b.pos-a.pos;
 	Vec3f v = c.pos-a.pos;
 	Vec3f w = c.pos-b.pos;
-	Vec3f p = Vec3f(x,y,0) - a.pos;
-
-	float lambda = ( p.x * v.y - p.y * v.x ) / ( u.x * v.y - u.y * v.x );
-	float mue =	   ( p.y * u.x - p.x * u.y ) / ( u.x * v.y - u.y * v.x );
 
 	// create seeds at edge midpoints
 	int s_ab = interpolateSeeds(a.seed,b.seed);
@@ -144,30 +178,9 @@ float SmoothTriangleGrid::_getHeightAt( int x, int y,
 	bc.z = displaceHeight( s_bc, bc.z, length(w)*steepness );
 
 	// create edge midpoints
-	SmoothVertex AB = SmoothVertex( ab, Normalize((a.normal+b.normal)*0.5), s_ab );
-	SmoothVertex AC = SmoothVertex( ac, Normalize((a.normal+c.normal)*0.5), s_ac );
-	SmoothVertex BC = SmoothVertex( bc, Normalize((c.normal+b.normal)*0.5), s_bc );
-
-	if( lambda+mue <= 0.5 )
-	{
-		// "lower left" triangle (at point a)
-		return _getHeightAt(x,y,a,AB,AC,depth-1);
-	}
-	if( lambda > 0.5 )
-	{
-		// "lower right" triangle (at point b)
-		return _getHeightAt(x,y,AB,b,BC,depth-1);
-	}
-	if( mue > 0.5 )
-	{
-		// "top" triangle (at point c)
-		return _getHeightAt(x,y,AC,BC,c,depth-1);
-	}
-	else
-	{
-		// middle triangle
-		return _getHeightAt(x,y,AB,AC,BC,depth-1);
-	}
+	AB = SmoothVertex( ab, Normalize((a.normal+b.normal)*0.5), s_ab );
+	AC = SmoothVertex( ac, Normalize((a.normal+c.normal)*0.5), s_ac );
+	BC = SmoothVertex( bc, Normalize((c.normal+b.normal)*0.5), s_bc );
 }
 
 //-----------------------------------------------------------------------------
@@ -178,15 +191,9 @@ float SmoothTriangleGrid::_getHeightAtTriangle( int x, int y,
 												SmoothVertex c)
 {
 	// find position on triangle using barycentric coordinates
-	float ux = b.pos.x - a.pos.x;
-	float uy = b.pos.y - a.pos.y;
-	float vx = c.pos.x - a.pos.x;
-	float vy = c.pos.y - a.pos.y;
-	float px = (float)x - a.pos.x;
-	float py = (float)y - a.pos.y;
-
-	float lambda = (px*vy-py*vx)/(ux*vy-uy*vx);
-	float mue = (py*ux-px*uy)/(ux*vy-uy*vx);
+	float lambda, mue;
+	barycentric( (float)x, (float)y, a.pos.x, a.pos.y, b.pos.x, b.pos.y,
+				 c.pos.x, c.pos.y, lambda, mue );
 
 	// interpolate height values of the vertices
 	return (1-lambda-mue)*a.pos.z + lambda*b.pos.z + mue*c.pos.z;
@@ -194,62 +201,207 @@ float SmoothTriangleGrid::_getHeightAtTriangle( int x, int y,
 
 //-----------------------------------------------------------------------------
 
-
-// this is identical to DynamicTriangleGrid::writeImage()
-void SmoothTriangleGrid::writeImage(const char *filename)
+class SmoothTriangleGrid::Renderer : public TileRenderer
 {
-	SDL_Surface* image = SDL_CreateRGBSurface(SDL_SWSURFACE,width+1,height+1,8,
-											  0x000000ff,0x000000ff,0x000000ff,0);
-	SDL_Surface* preview = SDL_CreateRGBSurface(SDL_SWSURFACE,width+1,height+1,
-												32,0,0,0,0);
-	
-	SDL_LockSurface(image);
-	SDL_LockSurface(preview);
+	SmoothTriangleGrid* grid;
 
-	LogManager::log("creating heightmap",true);
+	/** The splits of every tile, for CACHE_TOP_LEVELS. */
+	std::vector<CacheCounts> cache_counts;
+
+	Uint8 renderPixel(int x, int y)
+	{
+		int h = (int)grid->getHeightAt(x,y,grid->detail);
+		return (Uint8)MIN(255,MAX(0,h));
+	}
+
+	/** Looks up the first splits of a pixel in the cache and counts them. */
+	Uint8 renderCached(int x, int y, CacheCounts& counts)
+	{
+		SmoothVertex a, b, c;
+		int levels = grid->cache.find(*this,(float)x,(float)y,a,b,c);
+		counts.lookups += levels;
+		counts.splits += grid->detail-levels;
+		int h = (int)grid->_getHeightAt(x,y,a,b,c,grid->detail-levels);
+		return (Uint8)MIN(255,MAX(0,h));
+	}
 
-	for( int y=0; y<height+1; y++ )
-		for( int x=0; x<width+1; x++ )
-		{	
-			int h = getHeightAt(x,y,detail);
-			h = MIN(255,MAX(0,h));
-			int ofs = x + y * image->pitch;
-			((Uint8*)image->pixels)[ofs] = (Uint8)h;
+	/** Builds the cache if it is used and doesn't fit the detail yet. */
+	void prepareCache()
+	{
+		if( grid->generation_mode != CACHE_TOP_LEVELS )
+			return;
+
+		int levels = TriangleCache<SmoothVertex>::chooseLevels(grid->detail);
+		if( grid->cache.getLevels() != levels )
+		{
+			grid->cache.build(*this,grid->A,grid->B,grid->C,grid->D,levels);
+			SC4_LOG( "storing the first " << levels << " of " << grid->detail
+					 << " splits in a table of " 
+					 << grid->cache.getTriangles() << " triangles (" 
+					 << grid->cache.getBytes() / 1024 << " KB)" );
 		}
+	}
 
-	blurImage(image,blur);
+	void beginTiles(int nr_of_tiles)
+	{
+		if( grid->generation_mode == CACHE_TOP_LEVELS )
+			cache_counts.assign( nr_of_tiles, CacheCounts() );
+	}
+
+	/** Logs how many of the splits of all pixels the cache saved. */
+	void endTiles(bool always)
+	{
+		if( grid->generation_mode != CACHE_TOP_LEVELS )
+			return;
 
-	LogManager::log("creating preview",true);
-	for(int y=0; y<height+1; y++)
-		for(int x=0; x<width+1; x++)
+		CacheCounts total;
+		for( size_t i=0; i<cache_counts.size(); i++ )
 		{
-			int ofs = x + y * image->pitch;
-			Uint8 h = ((Uint8*)image->pixels)[ofs];
-
-			Uint8 r,g,b;
-			if(h <= 83)
-			{
-				r = (100*h)/83;
-				g = (100*h)/83;
-				b = 150 + (100*h)/83;
-			}
-			else
-			{
-				h -= 83;
-				r = 80 + (40*h)/172;
-				g = 120 - (40*h)/172;
-				b = 30;
-			}
-			ofs = x + y * preview->pitch / 4;
-			((Uint32*)preview->pixels)[ofs] = SDL_MapRGB(preview->format,r,g,b);
+			total.lookups += cache_counts[i].lookups;
+			total.splits += cache_counts[i].splits;
 		}
+		Uint64 all = total.lookups + total.splits;
+
+		std::ostringstream o;
+		o << "looked up " << total.lookups << " of " << all 
+		  << " splits in the table (" 
+		  << (all ? 100.0 * double(total.lookups) / double(all) : 100.0) 
+		  << "%), split " << total.splits << " triangles on the fly";
+		LogManager::log(o.str(),always);
+	}
+
+	void renderTile( Uint8* pixels, int pitch, 
+					 int x0, int y0, int x1, int y1 )
+	{
+		if( grid->generation_mode == PACKETS )
+		{
+			renderPackets( grid->packet_width, *this, pixels, pitch,
+						   grid->A, grid->B, grid->C, grid->D, grid->detail,
+						   x0, y0, x1, y1 );
+			return;
+		}
+
+		if( grid->generation_mode == CACHE_TOP_LEVELS )
+		{
+			// every tile counts into its own entry, so this needs no locking
+			CacheCounts& counts = cache_counts[ getTile(x0,y0) ];
+			for( int y=y0; y<y1; y++ )
+				for( int x=x0; x<x1; x++ )
+					pixels[x + y*pitch] = renderCached(x,y,counts);
+			return;
+		}
+
+		if( grid->generation_mode != RASTERIZE )
+		{
+			TileRenderer::renderTile(pixels,pitch,x0,y0,x1,y1);
+			return;
+		}
+
+		TriangleRasterizer<Renderer,SmoothVertex> rasterizer(*this,pixels,pitch);
+		rasterizer.rasterize( grid->A, grid->B, grid->C, grid->D, grid->detail,
+							  x0, y0, x1, y1 );
+	}
+
+public:
+	Renderer(SmoothTriangleGrid* grid, Bitmap* image)
+	: TileRenderer(image),grid(grid) 
+	{ 
+		prepareCache();
+	}
+
+	Renderer(SmoothTriangleGrid* grid, int width, int height)
+	: TileRenderer(width,height),grid(grid) 
+	{ 
+		prepareCache();
+	}
+
+	// interface for the TriangleRasterizer
+	static float getX(const SmoothVertex& v) { return v.pos.x; }
+	static float getY(const SmoothVertex& v) { return v.pos.y; }
+
+	void splitTriangle( const SmoothVertex& a, const SmoothVertex& b, 
+						const SmoothVertex& c, SmoothVertex& ab, 
+						SmoothVertex& ac, SmoothVertex& bc )
+	{
+		grid->splitTriangle(a,b,c,ab,ac,bc);
+	}
 
-	SDL_UnlockSurface(image);
-	SDL_UnlockSurface(preview);
+	Uint8 getPixel( int x, int y, const SmoothVertex& a, 
+					const SmoothVertex& b, const SmoothVertex& c )
+	{
+		int h = (int)grid->_getHeightAtTriangle(x,y,a,b,c);
+		return (Uint8)MIN(255,MAX(0,h));
+	}
+
+	// interface for the PacketTraversal and the TriangleRasterizer
+	struct Point
+	{
+		float x, y;
+	};
+
+	Point getPoint(int x, int y)
+	{
+		Point p = { (float)x, (float)y };
+		return p;
+	}
+
+	bool pointsMove() const { return false; }
 
-	SDL_SaveBMP(image,filename);
-	SDL_SaveBMP(preview,"preview.bmp");
+	BaseTriangle chooseBaseTriangle(Point& p)
+	{
+		const SmoothTriangleGrid& g = *grid;
+		float lambda, mue;
+		barycentric( p.x, p.y, g.A.pos.x, g.A.pos.y, g.B.pos.x, g.B.pos.y,
+					 g.D.pos.x, g.D.pos.y, lambda, mue );
+		return ::chooseBaseTriangle(lambda,mue);
+	}
+
+	SubTriangle chooseSubTriangle( Point& p, const SmoothVertex& a, 
+								   const SmoothVertex& b, 
+								   const SmoothVertex& c )
+	{
+		float lambda, mue;
+		barycentric( p.x, p.y, a.pos.x, a.pos.y, b.pos.x, b.pos.y,
+					 c.pos.x, c.pos.y, lambda, mue );
+		return ::chooseSubTriangle(lambda,mue);
+	}
+};
+
+//-----------------------------------------------------------------------------
 
-	SDL_FreeSurface(image);
-	SDL_FreeSurface(preview);
+// this is identical to DynamicTriangleGrid::writeImage()
+bool SmoothTriangleGrid::writeImage(const char *filename)
+{
+	BandResult bands = memory_budget > 0 ? writeBands(filename) 
+										 : BANDS_UNSUPPORTED;
+	if( bands != BANDS_UNSUPPORTED )
+		return bands == BANDS_WRITTEN;
+
+	// the bitmap is laid out like the file, so it is saved directly
+	Bitmap& image = createImage();
+	
+	LogManager::log("creating heightmap",true);
+	{
+		SC4_PROFILE("heightmap");
+		ThreadPool own_pool( thread_pool ? 1 : threads );
+		ThreadPool& pool = thread_pool ? *thread_pool : own_pool;
+		Renderer renderer(this,&image);
+		renderer.render(pool);
+	}
+
+	PostProcessor postprocessor(&image);
+	configure(postprocessor);
+	postprocessor.run();
+
+	bool written = image.save(filename);
+	return writePreview(image) && written;
+}
+
+//-----------------------------------------------------------------------------
+
+void SmoothTriangleGrid::renderBand( ThreadPool& pool, Uint8* rows, 
+									 int pitch, int y0, int y1 )
+{
+	Renderer renderer(this,width+1,height+1);
+	renderer.renderRows(pool,rows,pitch,y0,y1);
 }
\ No newline at end of file
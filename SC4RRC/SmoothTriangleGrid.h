@@ -28,6 +28,7 @@
 
 #include "config.hpp"
 #include "SC4Landscape.h"
+#include "TriangleCache.h"
 #include "Vec3f.h"
 
 /** Square function for floats. */
@@ -116,6 +117,9 @@ class SC4RRC_API SmoothTriangleGrid : public SC4Landscape
 	 */
 	__inline int interpolateSeeds( int seed1, int seed2 )
 	{ 
+		if(random_mode == HASH_RANDOM)
+			return int(hashSeeds(seed1,seed2));
+
 		// If you just add the two seeds, the distribution of the random values
 		// is far from being uniform. The 99 is just an arbitrary value, and 
 		// the random values are still not really uniformly distributed but 
@@ -154,6 +158,30 @@ class SC4RRC_API SmoothTriangleGrid : public SC4Landscape
 	float _getHeightAtTriangle( int x, int y, 
 								SmoothVertex a, SmoothVertex b, SmoothVertex c);
 
+	/**	Splits the triangle abc into four sub-triangles.
+	 *	The new vertices are placed on the curved edges and displaced by a
+	 *	random amount.
+	 *	@param ab,ac,bc		Receive the new vertices.
+	 */
+	void splitTriangle( const SmoothVertex& a, const SmoothVertex& b,
+						const SmoothVertex& c, SmoothVertex& ab,
+						SmoothVertex& ac, SmoothVertex& bc );
+
+	/** The top levels of the triangles for CACHE_TOP_LEVELS. */
+	TriangleCache<SmoothVertex> cache;
+
+	/**	Computes the heightmap tile by tile, using getHeightAt(), the 
+	 *	TriangleRasterizer, the TriangleCache or the PacketTraversal.
+	 */
+	class Renderer;
+	friend class Renderer;
+
+	/** The triangles can be rendered in any order, so bands just work. */
+	bool prepareBands(PostProcessor& /*postprocessor*/) { return true; }
+
+	void renderBand( ThreadPool& pool, Uint8* rows, int pitch, 
+					 int y0, int y1 );
+
 	/** Computes a point on the triangle from the viewpoint of vertex A.
 	 *	You must interpolate the viewpoints of all three vertices to get a
 	 *	continuous surface.
@@ -195,19 +223,24 @@ public:
 	 *		you will always get the same landscape. This way, if you find a
 	 *		landscape with a shape that you like, you can adjust the level, 
 	 *		blur and steepness settings to give it that final touch.
+	 *
+	 *	@param random_mode
+	 *		Use LEGACY_RANDOM to get the same landscape for a seed as older
+	 *		versions did.
 	 */
 	SmoothTriangleGrid( int width, int height, int level, int blur,
-						int detail, float steepness, int seed );
+						int detail, float steepness, int seed,
+						RandomMode random_mode = HASH_RANDOM );
 
 	~SmoothTriangleGrid() { }
 
 	/**	Creates a heightmap and a preview map and saves them. 
 	 *	The heightmap is saved as an 8-Bit BMP file with the given filename.
 	 *	The preview map that is only meant to give you a feel of what the 
-	 *	region will look like in the game will be saved as a 32-Bit BMP file
+	 *	region will look like in the game will be saved as a 24-Bit BMP file
 	 *	called preview.bmp.
 	 */
-	void writeImage(const char* filename);
+	bool writeImage(const char* filename);
 };
 
 
@@ -0,0 +1,148 @@
+/******************************************************************************
+ *	file: ThreadPool.cpp
+ *
+ *	Copyright (c) 2007, Benjamin Schug
+ *
+ *	This file is part of the SimCity 4 Random Region Creator (SC4RRC).
+ *
+ *	Sim City is a registered trademark of Electronic Arts.
+ *	This program is in no way associated with Maxis or Electronic Arts.
+ *
+ *	SC4RRC is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	SC4RRC is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#define SC4RRC_LIB
+
+#ifdef _WIN32
+#	define WIN32_LEAN_AND_MEAN
+#	include <windows.h>
+#else
+#	include <unistd.h>
+#endif
+
+#include <SDL/SDL_thread.h>
+
+#include "ThreadPool.h"
+
+//-----------------------------------------------------------------------------
+
+ThreadPool::ThreadPool(int nr_of_threads)
+: task(NULL),nr_of_items(0),next_item(0),finished_items(0),shutdown(false)
+{
+	if(nr_of_threads <= 0) nr_of_threads = getNrOfCPUs();
+
+	mutex = SDL_CreateMutex();
+	work_available = SDL_CreateCond();
+	work_done = SDL_CreateCond();
+
+	// the thread calling run() is the first worker
+	for(int i=1; i<nr_of_threads; i++)
+		workers.push_back(SDL_CreateThread(workerMain,this));
+}
+
+//-----------------------------------------------------------------------------
+
+ThreadPool::~ThreadPool()
+{
+	SDL_mutexP(mutex);
+	shutdown = true;
+	SDL_CondBroadcast(work_available);
+	SDL_mutexV(mutex);
+
+	for(size_t i=0; i<workers.size(); i++)
+		SDL_WaitThread(workers[i],NULL);
+
+	SDL_DestroyCond(work_done);
+	SDL_DestroyCond(work_available);
+	SDL_DestroyMutex(mutex);
+}
+
+//-----------------------------------------------------------------------------
+
+int ThreadPool::workerMain(void* pool)
+{
+	ThreadPool* self = static_cast<ThreadPool*>(pool);
+
+	SDL_mutexP(self->mutex);
+	while(!self->shutdown)
+	{
+		if(self->next_item < self->nr_of_items)
+			self->processItems();
+		else
+			SDL_CondWait(self->work_available,self->mutex);
+	}
+	SDL_mutexV(self->mutex);
+
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+
+void ThreadPool::processItems()
+{
+	while(next_item < nr_of_items)
+	{
+		// As long as there are items left, the task can't be finished, so
+		// it is safe to work on it after releasing the lock.
+		ParallelTask* current = task;
+		int item = next_item++;
+
+		SDL_mutexV(mutex);
+		current->execute(item);
+		SDL_mutexP(mutex);
+
+		if(++finished_items == nr_of_items)
+			SDL_CondSignal(work_done);
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+void ThreadPool::run(ParallelTask& task, int nr_of_items)
+{
+	SDL_mutexP(mutex);
+
+	this->task = &task;
+	this->nr_of_items = nr_of_items;
+	next_item = 0;
+	finished_items = 0;
+	SDL_CondBroadcast(work_available);
+
+	processItems();
+
+	// wait for the items that are still being processed by other threads
+	while(finished_items < nr_of_items)
+		SDL_CondWait(work_done,mutex);
+
+	this->task = NULL;
+	this->nr_of_items = 0;
+	next_item = 0;
+
+	SDL_mutexV(mutex);
+}
+
+//-----------------------------------------------------------------------------
+
+int ThreadPool::getNrOfCPUs()
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	int cpus = int(info.dwNumberOfProcessors);
+#else
+	int cpus = int(sysconf(_SC_NPROCESSORS_ONLN));
+#endif
+	return cpus > 0 ? cpus : 1;
+}
@@ -0,0 +1,115 @@
+/******************************************************************************
+ *	file: ThreadPool.h
+ *
+ *	Copyright (c) 2007, Benjamin Schug
+ *
+ *	This file is part of the SimCity 4 Random Region Creator (SC4RRC).
+ *
+ *	Sim City is a registered trademark of Electronic Arts.
+ *	This program is in no way associated with Maxis or Electronic Arts.
+ *
+ *	SC4RRC is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	SC4RRC is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#ifndef SC4RRC__THREADPOOL_H
+#define SC4RRC__THREADPOOL_H
+
+#include <vector>
+
+#include "config.hpp"
+
+// forward declarations
+struct SDL_Thread;
+struct SDL_mutex;
+struct SDL_cond;
+
+
+/**	A piece of work that can be split into independent work items.
+ *	The items of a task are handed out to the threads of a ThreadPool one at
+ *	a time, so the order in which they are executed is undefined. Derived
+ *	classes must make sure that execute() doesn't modify any state that is
+ *	shared between the work items.
+ */
+class SC4RRC_API ParallelTask
+{
+public:
+	virtual ~ParallelTask() { }
+
+	/**	Processes a single work item.
+	 *	This is called concurrently from all threads of the pool.
+	 *	@param index	Number of the work item, between 0 and the
+	 *					nr_of_items that were passed to ThreadPool::run().
+	 */
+	virtual void execute(int index) = 0;
+};
+
+
+/**	A fixed set of worker threads that process ParallelTasks.
+ *	The work items are not assigned to the threads in advance. Instead, every
+ *	thread fetches the next unprocessed item as soon as it is done with the
+ *	previous one, so threads that got cheap items automatically help out with
+ *	the expensive ones.
+ *	The threads are created once and sleep while there is nothing to do, so
+ *	the same pool can be used for many tasks.
+ */
+class SC4RRC_API ThreadPool
+{
+	std::vector<SDL_Thread*> workers;
+
+	SDL_mutex* mutex;
+	SDL_cond* work_available;	///< signalled when a new task is started
+	SDL_cond* work_done;		///< signalled when the last item is finished
+
+	ParallelTask* task;	///< the task that is currently processed
+	int nr_of_items;	///< number of items of the current task
+	int next_item;		///< the next item that has not been started yet
+	int finished_items;	///< number of items that have been completed
+	bool shutdown;		///< tells the workers to terminate
+
+	/** Entry point of the worker threads. */
+	static int workerMain(void* pool);
+
+	/**	Processes items of the current task until there are none left.
+	 *	The mutex must be locked when calling this, and it will be locked
+	 *	again when it returns.
+	 */
+	void processItems();
+
+	// not copyable
+	ThreadPool(const ThreadPool&);
+	ThreadPool& operator=(const ThreadPool&);
+
+public:
+	/**	@param nr_of_threads	The number of threads that work on a task,
+	 *							including the thread that calls run(). If this
+	 *							is 0 or less, one thread per CPU is used.
+	 */
+	explicit ThreadPool(int nr_of_threads = 0);
+
+	~ThreadPool();
+
+	/**	Processes all items of a task and returns when they are done.
+	 *	The calling thread works on the task as well.
+	 */
+	void run(ParallelTask& task, int nr_of_items);
+
+	/** Returns the number of threads working on a task. */
+	int getNrOfThreads() const { return int(workers.size()) + 1; }
+
+	/** Returns the number of CPUs available on this machine. */
+	static int getNrOfCPUs();
+};
+
+#endif // SC4RRC__THREADPOOL_H
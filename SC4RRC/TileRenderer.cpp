@@ -0,0 +1,149 @@
+/******************************************************************************
+ *	file: TileRenderer.cpp
+ *
+ *	Copyright (c) 2007, Benjamin Schug
+ *
+ *	This file is part of the SimCity 4 Random Region Creator (SC4RRC).
+ *
+ *	Sim City is a registered trademark of Electronic Arts.
+ *	This program is in no way associated with Maxis or Electronic Arts.
+ *
+ *	SC4RRC is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	SC4RRC is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#define SC4RRC_LIB
+
+#include <SDL/SDL.h>
+
+#include "Bitmap.h"
+#include "LogManager.h"
+#include "TileRenderer.h"
+
+__inline int MIN(int a, int b) { return a<b?a:b; }
+
+//-----------------------------------------------------------------------------
+
+TileRenderer::TileRenderer(Bitmap* image, int tile_size)
+: image(image),width(image->getWidth()),height(image->getHeight()),
+  pixels(NULL),pitch(0),
+  first_row(0),last_row(0),tile_size(tile_size),tiles_x(0),tiles_y(0)
+{
+}
+
+//-----------------------------------------------------------------------------
+
+TileRenderer::TileRenderer(int width, int height, int tile_size)
+: image(NULL),width(width),height(height),pixels(NULL),pitch(0),
+  first_row(0),last_row(0),tile_size(tile_size),tiles_x(0),tiles_y(0)
+{
+}
+
+//-----------------------------------------------------------------------------
+
+void TileRenderer::execute(int index)
+{
+	Uint32 start = SDL_GetTicks();
+
+	int x0 = (index % tiles_x) * tile_size;
+	int y0 = first_row + (index / tiles_x) * tile_size;
+	int x1 = MIN( x0 + tile_size, width );
+	int y1 = MIN( y0 + tile_size, last_row );
+
+	renderTile(pixels,pitch,x0,y0,x1,y1);
+
+	// every item writes its own entry, so this needs no locking
+	tile_ticks[index] = SDL_GetTicks() - start;
+}
+
+//-----------------------------------------------------------------------------
+
+void TileRenderer::renderTile( Uint8* pixels, int pitch,
+							   int x0, int y0, int x1, int y1 )
+{
+	for( int y=y0; y<y1; y++ )
+		for( int x=x0; x<x1; x++ )
+			pixels[x + y*pitch] = renderPixel(x,y);
+}
+
+//-----------------------------------------------------------------------------
+
+void TileRenderer::render(ThreadPool& pool)
+{
+	pixels = image->getPixels();
+	pitch = image->getPitch();
+	first_row = 0;
+	last_row = height;
+	renderTiles(pool);
+}
+
+//-----------------------------------------------------------------------------
+
+void TileRenderer::renderRows( ThreadPool& pool, Uint8* rows, int pitch, 
+							   int y0, int y1 )
+{
+	// The renderers address the pixels by their position in the image.
+	pixels = rows - y0*pitch;
+	this->pitch = pitch;
+	first_row = y0;
+	last_row = y1;
+	renderTiles(pool);
+}
+
+//-----------------------------------------------------------------------------
+
+void TileRenderer::renderTiles(ThreadPool& pool)
+{
+	tiles_x = (width + tile_size - 1) / tile_size;
+	tiles_y = (last_row - first_row + tile_size - 1) / tile_size;
+	tile_ticks.resize(tiles_x*tiles_y);
+	int nr_of_tiles = tiles_x*tiles_y;
+	if( nr_of_tiles == 0 ) return;
+
+	// bands are rendered many times, so they are only logged in detail
+	bool always = image != NULL;
+
+	std::ostringstream o;
+	o << "rendering " << tiles_x << " x " << tiles_y << " tiles of "
+	  << tile_size << " pixels on " << pool.getNrOfThreads() << " threads";
+	LogManager::log(o.str(),always);
+
+	beginTiles(nr_of_tiles);
+
+	Uint32 start = SDL_GetTicks();
+	pool.run(*this,nr_of_tiles);
+	Uint32 total = SDL_GetTicks() - start;
+
+	Uint32 min_ticks = tile_ticks[0];
+	Uint32 max_ticks = tile_ticks[0];
+	Uint32 sum_ticks = 0;
+	for( int i=0; i<nr_of_tiles; i++ )
+	{
+		SC4_DBG( "tile " << i % tiles_x << "|" << i / tiles_x << ": "
+				 << tile_ticks[i] << " ms" );
+
+		min_ticks = tile_ticks[i] < min_ticks ? tile_ticks[i] : min_ticks;
+		max_ticks = tile_ticks[i] > max_ticks ? tile_ticks[i] : max_ticks;
+		sum_ticks += tile_ticks[i];
+	}
+
+	o.str("");
+	o << "rendered " << nr_of_tiles << " tiles in " << total << " ms "
+	  << "(per tile: min " << min_ticks << " ms, avg "
+	  << float(sum_ticks) / float(nr_of_tiles) << " ms, max "
+	  << max_ticks << " ms)";
+	LogManager::log(o.str(),always);
+
+	endTiles(always);
+}
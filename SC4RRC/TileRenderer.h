@@ -0,0 +1,134 @@
+/******************************************************************************
+ *	file: TileRenderer.h
+ *
+ *	Copyright (c) 2007, Benjamin Schug
+ *
+ *	This file is part of the SimCity 4 Random Region Creator (SC4RRC).
+ *
+ *	Sim City is a registered trademark of Electronic Arts.
+ *	This program is in no way associated with Maxis or Electronic Arts.
+ *
+ *	SC4RRC is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	SC4RRC is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#ifndef SC4RRC__TILERENDERER_H
+#define SC4RRC__TILERENDERER_H
+
+#include <vector>
+
+#include <SDL/SDL_types.h>
+
+#include "config.hpp"
+#include "ThreadPool.h"
+
+// forward declaration
+class Bitmap;
+
+
+/**	Renders an 8-bit heightmap in square tiles on a ThreadPool.
+ *	This is meant for terrain generators that can compute the height of
+ *	every pixel independently from all other pixels. Every tile is written
+ *	by exactly one thread, and the result doesn't depend on the number of
+ *	threads or the order in which the tiles are processed - as long as
+ *	renderPixel() only depends on its coordinates.
+ */
+class SC4RRC_API TileRenderer : public ParallelTask
+{
+	Bitmap* image;
+	int width;
+	int height;
+
+	/** Points to where the pixel (0|0) of the rows that are rendered is. */
+	Uint8* pixels;
+	int pitch;
+
+	int first_row;	///< the first row that is rendered
+	int last_row;	///< the row after the last one that is rendered
+
+	int tile_size;
+	int tiles_x;	///< number of tiles in x direction
+	int tiles_y;	///< number of tiles in y direction
+
+	/** How long it took to render each tile, in milliseconds. */
+	std::vector<Uint32> tile_ticks;
+
+	void execute(int index);
+
+	/** Renders all tiles between first_row and last_row. */
+	void renderTiles(ThreadPool& pool);
+
+protected:
+	/**	Returns the height value of the pixel (x|y).
+	 *	This is called concurrently from several threads, so it must not
+	 *	modify any shared state.
+	 */
+	virtual Uint8 renderPixel(int x, int y) = 0;
+
+	/**	Renders all pixels from (x0|y0) up to, but not including, (x1|y1).
+	 *	The default implementation calls renderPixel() for every pixel.
+	 *	@param pixels	Points to the pixel (0|0) of the image.
+	 *	@param pitch	Number of bytes from one row to the next, negative
+	 *					if the rows are stored bottom-up.
+	 */
+	virtual void renderTile( Uint8* pixels, int pitch,
+							 int x0, int y0, int x1, int y1 );
+
+	/**	Returns the number of the tile whose upper left pixel is (x0|y0),
+	 *	between 0 and the number of tiles that was passed to beginTiles().
+	 */
+	int getTile(int x0, int y0) const 
+	{ 
+		return (y0 - first_row) / tile_size * tiles_x + x0 / tile_size; 
+	}
+
+	/**	Called before the tiles are rendered. Derived classes that count 
+	 *	something per tile can make room for every tile here, so that 
+	 *	renderTile() can fill in its own entry without locking.
+	 */
+	virtual void beginTiles(int /*nr_of_tiles*/) { }
+
+	/**	Called after all tiles have been rendered, to sum up the counts.
+	 *	@param always	false for bands, which are only logged in detail.
+	 */
+	virtual void endTiles(bool /*always*/) { }
+
+public:
+	/**	@param image		An 8-bit bitmap.
+	 *	@param tile_size	Width and height of the tiles in pixels. The
+	 *						default value is the size of a small city.
+	 */
+	TileRenderer(Bitmap* image, int tile_size = 64);
+
+	/**	Creates a renderer that only renders bands of rows with 
+	 *	renderRows(), for images that don't fit into memory.
+	 *	@param width	Width of the whole image in pixels
+	 *	@param height	Height of the whole image in pixels
+	 */
+	TileRenderer(int width, int height, int tile_size = 64);
+
+	virtual ~TileRenderer() { }
+
+	/**	Renders all tiles of the image and logs how long it took. */
+	void render(ThreadPool& pool);
+
+	/**	Renders the rows y0 up to, but not including, y1 of the image.
+	 *	The pixels are the same as if the whole image was rendered.
+	 *	@param rows		Receives the rows, starting with row y0.
+	 *	@param pitch	Number of bytes per row.
+	 */
+	void renderRows(ThreadPool& pool, Uint8* rows, int pitch, int y0, int y1);
+};
+
+#endif // SC4RRC__TILERENDERER_H
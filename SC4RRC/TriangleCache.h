@@ -0,0 +1,233 @@
+/******************************************************************************
+ *	file: TriangleCache.h
+ *
+ *	Copyright (c) 2007, Benjamin Schug
+ *
+ *	This file is part of the SimCity 4 Random Region Creator (SC4RRC).
+ *
+ *	Sim City is a registered trademark of Electronic Arts.
+ *	This program is in no way associated with Maxis or Electronic Arts.
+ *
+ *	SC4RRC is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	SC4RRC is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+
+#ifndef SC4RRC__TRIANGLECACHE_H
+#define SC4RRC__TRIANGLECACHE_H
+
+#include <vector>
+
+#include <SDL/SDL_types.h>
+
+#include "TriangleRasterizer.h"
+
+
+/**	Counts the splits of the pixels of one tile: the ones that were looked
+ *	up in a TriangleCache and the ones that were computed on the fly below
+ *	the table.
+ */
+struct CacheCounts
+{
+	Uint64 lookups;
+	Uint64 splits;
+
+	CacheCounts() : lookups(0),splits(0) { }
+};
+
+/**	Keeps the top levels of a dynamic triangle grid in memory.
+ *	Computing each pixel on its own splits every triangle on the way down
+ *	from the base triangles again, although the few triangles of the top
+ *	levels are shared by thousands of pixels. The cache splits them once and
+ *	stores their edge midpoints, so a pixel only has to choose its way 
+ *	through the first levels and splits the triangles of the remaining levels
+ *	on the fly, just like before. The table is small enough to stay in the
+ *	L2 cache of the CPU, while precomputing the whole mesh like the 
+ *	StaticTriangleGrid does would need far too much memory on high detail
+ *	levels.
+ *
+ *	The midpoints are created by the same splitTriangle() and the way through
+ *	the table is chosen with the same chooseBaseTriangle() and 
+ *	chooseSubTriangle() calls on the same vertices, so the result is exactly
+ *	the same as without the cache.
+ *
+ *	The Generator must provide these members:
+ *	- static float getX(const V& v) and getY(const V& v), the position of a
+ *	  vertex
+ *	- void splitTriangle(const V& a, const V& b, const V& c,
+ *	  V& ab, V& ac, V& bc), which creates the edge midpoints of abc
+ */
+template<class V>
+class TriangleCache
+{
+	/** The edge midpoints of a triangle that has been split. */
+	struct Node
+	{
+		V ab, ac, bc;
+	};
+
+	/**	Level l has 2*4^l nodes. The sub-triangle sub of node i of a level is
+	 *	the node 4*i+sub of the next level. The nodes of the base triangles
+	 *	come first.
+	 */
+	std::vector<Node> nodes;
+
+	V A, B, C, D;	///< corners of the map
+
+	int levels;		///< how many levels are stored, -1 before build()
+
+	/** Returns the index of the first node of level l. */
+	static size_t levelOffset(int l) { return ((size_t(2) << (2*l)) - 2) / 3; }
+
+	/** Sets abc to a base triangle and returns its index. */
+	size_t getBase( BaseTriangle base, V& a, V& b, V& c ) const
+	{
+		if( base == BASE_ABD )
+		{
+			a = A; b = B; c = D;
+		}
+		else
+		{
+			a = C; b = D; c = B;
+		}
+		return base;
+	}
+
+	/**	Replaces the triangle abc with its sub-triangle sub.
+	 *	@param level,index	the node of abc
+	 *	@return	the index of the sub-triangle on the next level
+	 */
+	size_t getSub( int level, size_t index, SubTriangle sub, 
+				   V& a, V& b, V& c ) const
+	{
+		const Node& node = nodes[ levelOffset(level) + index ];
+		switch( sub )
+		{
+		case SUB_A:
+			b = node.ab; c = node.ac; 
+			break;
+		case SUB_B:
+			a = node.ab; c = node.bc; 
+			break;
+		case SUB_C:
+			a = node.ac; b = node.bc; 
+			break;
+		default:
+			a = node.ab; b = node.ac; c = node.bc; 
+			break;
+		}
+		return 4*index + sub;
+	}
+
+	template<class Generator>
+	void build( Generator& generator, const V& a, const V& b, const V& c,
+				int level, size_t index )
+	{
+		if( level == levels )
+			return;
+
+		Node& node = nodes[ levelOffset(level) + index ];
+		generator.splitTriangle(a,b,c,node.ab,node.ac,node.bc);
+
+		index *= 4;
+		build( generator, a, node.ab, node.ac, level+1, index+SUB_A );
+		build( generator, node.ab, b, node.bc, level+1, index+SUB_B );
+		build( generator, node.ac, node.bc, c, level+1, index+SUB_C );
+		build( generator, node.ab, node.ac, node.bc, level+1, 
+			   index+SUB_MIDDLE );
+	}
+
+public:
+	/** The size of the table that fits into the L2 cache of most CPUs. */
+	static const size_t DEFAULT_BYTES = 256*1024;
+
+	TriangleCache() : levels(-1) { }
+
+	/**	Returns the number of levels whose nodes fit into the given number of
+	 *	bytes, but not more than depth.
+	 */
+	static int chooseLevels(int depth, size_t bytes = DEFAULT_BYTES)
+	{
+		int k = 0;
+		while( k < depth && levelOffset(k+1) * sizeof(Node) <= bytes )
+			k++;
+		return k;
+	}
+
+	/** Returns how many levels are stored, -1 if none have been built. */
+	int getLevels() const { return levels; }
+
+	/** Returns the number of triangles that are stored. */
+	size_t getTriangles() const { return nodes.size(); }
+
+	/** Returns the size of the table in bytes. */
+	size_t getBytes() const { return nodes.size() * sizeof(Node); }
+
+	/**	Splits the base triangles ABD and CDB of the map ABCD levels times and
+	 *	stores all midpoints.
+	 */
+	template<class Generator>
+	void build( Generator& generator, const V& A, const V& B, const V& C, 
+				const V& D, int levels )
+	{
+		this->A = A;
+		this->B = B;
+		this->C = C;
+		this->D = D;
+		this->levels = levels;
+
+		nodes.resize( levelOffset(levels) );
+		build(generator,A,B,D,0,BASE_ABD);
+		build(generator,C,D,B,0,BASE_CDB);
+	}
+
+	/**	Finds the triangle abc that the point (x|y) lies on after splitting 
+	 *	the base triangles getLevels() times.
+	 *	@return	getLevels(), the number of splits that have been looked up
+	 */
+	template<class Generator>
+	int find( Generator& generator, float x, float y, V& a, V& b, V& c ) const
+	{
+		float lambda, mue;
+		barycentric( x, y, generator.getX(A), generator.getY(A),
+					 generator.getX(B), generator.getY(B),
+					 generator.getX(D), generator.getY(D), lambda, mue );
+
+		size_t index = getBase( chooseBaseTriangle(lambda,mue), a, b, c );
+		for( int l=0; l<levels; l++ )
+		{
+			barycentric( x, y, generator.getX(a), generator.getY(a),
+						 generator.getX(b), generator.getY(b),
+						 generator.getX(c), generator.getY(c), lambda, mue );
+
+			index = getSub( l, index, chooseSubTriangle(lambda,mue), a, b, c );
+		}
+		return levels;
+	}
+
+	/**	Finds the triangle abc that the point p lies on after splitting the
+	 *	base triangles getLevels() times, for grids whose vertices lie on the
+	 *	lattice of the map. Afterwards, p is the point on that triangle.
+	 *	@return	getLevels(), the number of splits that have been looked up
+	 */
+	int find( GridPoint& p, V& a, V& b, V& c ) const
+	{
+		size_t index = getBase( p.chooseBaseTriangle(A,B,D), a, b, c );
+		for( int l=0; l<levels; l++ )
+			index = getSub( l, index, p.chooseSubTriangle(a,b,c), a, b, c );
+		return levels;
+	}
+};
+
+#endif // SC4RRC__TRIANGLECACHE_H
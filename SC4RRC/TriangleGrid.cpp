@@ -30,39 +30,29 @@
 #include <SDL/SDL.h>
 #include <assert.h>
 
+#include "Bitmap.h"
 #include "LogManager.h"
+#include "PacketTraversal.h"
+#include "PostProcessor.h"
+#include "Random.h"
+#include "TileRenderer.h"
 #include "TriangleGrid.h"
-#include "postprocessing.h"
+#include "TriangleRasterizer.h"
 
 #pragma warning(disable:4244)
 
-__inline float randf() { return (float)rand() / (float)RAND_MAX; }
 __inline int MAX(int a, int b) { return a>b?a:b; }
 __inline int MIN(int a, int b) { return a<b?a:b; }
 
-const int COLORDEPTH = 32;
-const int BYTESPERPIXEL = 4;
-#if SDL_BYTEORDER == SDL_BIG_ENDIAN
-	const uint RMASK = 0xff000000;
-	const uint GMASK = 0x00ff0000;
-	const uint BMASK = 0x0000ff00;
-	const uint AMASK = 0x00000000;
-#else
-	const Uint32 RMASK = 0x000000ff;
-	const Uint32 GMASK = 0x0000ff00;
-	const Uint32 BMASK = 0x00ff0000;
-	const Uint32 AMASK = 0x00000000;
-#endif
-
 //-----------------------------------------------------------------------------
 
 DynamicTriangleGrid::DynamicTriangleGrid(int width, int height, int level, 
 										 int blur, int detail, float steepness,
-										 int seed)
-: SC4Landscape(width,height,level,blur),steepness(steepness),detail(detail)
+										 int seed, RandomMode random_mode)
+: SC4Landscape(width,height,level,blur,random_mode),steepness(steepness),detail(detail)
 {
-	std::ostringstream* o = new std::ostringstream;
-	(*o) << "Settings: " << std::endl
+	std::ostringstream o;
+	o << "Settings: " << std::endl
 		 << "width = " << width << std::endl
 		 << "height = " << height << std::endl
 		 << "level = " << level << std::endl
@@ -70,15 +60,17 @@ DynamicTriangleGrid::DynamicTriangleGrid(int width, int height, int level,
 		 << "generator = DYNAMIC TRIANGLE GRID" << std::endl
 		 << "steepness = " << steepness << std::endl
 		 << "detail level = " << detail << std::endl << std::endl
-		 << "seed = " << seed << std::endl;
+		 << "seed = " << seed << std::endl
+		 << "random = " << (random_mode==HASH_RANDOM ? "HASH" : "LEGACY") << std::endl;
 	LogManager::log(o,true);
 
-	srand(seed);
+	int seeds[4];
+	createCornerSeeds(seed,random_mode,seeds);
 
-	A = Vertex(        0,         0, 0, rand() );
-	B = Vertex( width*64,         0, 0, rand() );
-	C = Vertex( width*64, height*64, 0, rand() );
-	D = Vertex(        0, height*64, 0, rand() );
+	A = Vertex(        0,         0, 0, seeds[0] );
+	B = Vertex( width*64,         0, 0, seeds[1] );
+	C = Vertex( width*64, height*64, 0, seeds[2] );
+	D = Vertex(        0, height*64, 0, seeds[3] );
 
 	A.z = createHeight( A.seed, level, MAX_HEIGHT );
 	B.z = createHeight( B.seed, level, MAX_HEIGHT );
@@ -90,11 +82,11 @@ DynamicTriangleGrid::DynamicTriangleGrid(int width, int height, int level,
 
 StaticTriangleGrid::StaticTriangleGrid(int width, int height, int level, 
 									   int blur, int detail, float steepness,
-									   int seed)
-: SC4Landscape(width,height,level,blur),steepness(steepness),detail(detail)
+									   int seed, RandomMode random_mode)
+: SC4Landscape(width,height,level,blur,random_mode),steepness(steepness),detail(detail)
 {
-	std::ostringstream* o = new std::ostringstream;
-	(*o) << "Settings: " << std::endl
+	std::ostringstream o;
+	o << "Settings: " << std::endl
 		 << "width = " << width << std::endl
 		 << "height = " << height << std::endl
 		 << "level = " << level << std::endl
@@ -102,15 +94,17 @@ StaticTriangleGrid::StaticTriangleGrid(int width, int height, int level,
 		 << "generator = STATIC TRIANGLE GRID" << std::endl
 		 << "steepness = " << steepness << std::endl
 		 << "detail level = " << detail << std::endl << std::endl
-		 << "seed = " << seed << std::endl;
+		 << "seed = " << seed << std::endl
+		 << "random = " << (random_mode==HASH_RANDOM ? "HASH" : "LEGACY") << std::endl;
 	LogManager::log(o,true);
 
-	srand(seed);
+	int seeds[4];
+	createCornerSeeds(seed,random_mode,seeds);
 
-	A = Vertex(        0,         0, 0, rand() );
-	B = Vertex( width*64,         0, 0, rand() );
-	C = Vertex( width*64, height*64, 0, rand() );
-	D = Vertex(        0, height*64, 0, rand() );
+	A = Vertex(        0,         0, 0, seeds[0] );
+	B = Vertex( width*64,         0, 0, seeds[1] );
+	C = Vertex( width*64, height*64, 0, seeds[2] );
+	D = Vertex(        0, height*64, 0, seeds[3] );
 
 	A.z = createHeight( A.seed, level, MAX_HEIGHT );
 	B.z = createHeight( B.seed, level, MAX_HEIGHT );
@@ -122,8 +116,8 @@ StaticTriangleGrid::StaticTriangleGrid(int width, int height, int level,
 
 int StaticTriangleGrid::createHeight( int seed, int base, int max )
 {
-	srand(seed);
-	int deviation = (float)max * steepness * randf() - (max*steepness)/2;
+	int deviation = (float)max * steepness * seedRandf(random_mode,seed)
+				  - (max*steepness)/2;
 	return MAX(0, MIN( MAX_HEIGHT, base + deviation ));
 }
 
@@ -131,8 +125,8 @@ int StaticTriangleGrid::createHeight( int seed, int base, int max )
 
 int DynamicTriangleGrid::createHeight( int seed, int base, int max )
 {
-	srand(seed);
-	int deviation = (float)max * steepness * randf() - (max*steepness)/2;
+	int deviation = (float)max * steepness * seedRandf(random_mode,seed)
+				  - (max*steepness)/2;
 	return MAX(0, MIN( MAX_HEIGHT, base + deviation ));
 }
 
@@ -141,25 +135,17 @@ int DynamicTriangleGrid::createHeight( int seed, int base, int max )
 int DynamicTriangleGrid::getHeightAt(int x, int y, int detail)
 {
 	// find out which top-level triangle the point is on
-	float ux = B.x - A.x;
-	float uy = B.y - A.y;
-	float vx = D.x - A.x;
-	float vy = D.y - A.y;
-	float px = (float)x - A.x;
-	float py = (float)y - A.y;
-
-	float lambda = (px*vy-py*vx)/(ux*vy-uy*vx);
-	float mue = (py*ux-px*uy)/(ux*vy-uy*vx);
+	GridPoint p(x,y,width,height,random_mode == HASH_RANDOM);
 
-	if( lambda+mue <= 1 )
+	if( p.chooseBaseTriangle(A,B,D) == BASE_ABD )
 	{
 		// triangle ABD
-		return _getHeightAt(x,y,A,B,D,detail);
+		return _getHeightAt(x,y,p,A,B,D,detail);
 	}
 	else
 	{
 		// triangle CDB
-		return _getHeightAt(x,y,C,D,B,detail);
+		return _getHeightAt(x,y,p,C,D,B,detail);
 	}
 }
 
@@ -169,15 +155,8 @@ int DynamicTriangleGrid::_getHeightAtTriangle(int x, int y,
 											  Vertex a, Vertex b, Vertex c)
 {
 	// find position on triangle using barycentric coordinates
-	float ux = b.x - a.x;
-	float uy = b.y - a.y;
-	float vx = c.x - a.x;
-	float vy = c.y - a.y;
-	float px = (float)x - a.x;
-	float py = (float)y - a.y;
-
-	float lambda = (px*vy-py*vx)/(ux*vy-uy*vx);
-	float mue = (py*ux-px*uy)/(ux*vy-uy*vx);
+	float lambda, mue;
+	barycentric((float)x,(float)y,a.x,a.y,b.x,b.y,c.x,c.y,lambda,mue);
 
 	// interpolate height values of the vertices
 	return (1-lambda-mue)*a.z + lambda*b.z + mue*c.z;
@@ -185,31 +164,78 @@ int DynamicTriangleGrid::_getHeightAtTriangle(int x, int y,
 
 //-----------------------------------------------------------------------------
 
-int DynamicTriangleGrid::_getHeightAt(int x, int y, 
+int DynamicTriangleGrid::_getHeightAt(int x, int y, GridPoint p,
 									  Vertex a, Vertex b, Vertex c, int depth)
 {
 	if(depth==0) return _getHeightAtTriangle(x,y,a,b,c);
 
+	Vertex AB, AC, BC;
+	splitTriangle(a,b,c,AB,AC,BC);
+
+	SubTriangle sub = p.chooseSubTriangle(a,b,c);
+	if( sub == SUB_A )
+	{
+		// "lower left" triangle (at point a)
+		return _getHeightAt(x,y,p,a,AB,AC,depth-1);
+	}
+	if( sub == SUB_B )
+	{
+		// "lower right" triangle (at point b)
+		return _getHeightAt(x,y,p,AB,b,BC,depth-1);
+	}
+	if( sub == SUB_C )
+	{
+		// "top" triangle (at point c)
+		return _getHeightAt(x,y,p,AC,BC,c,depth-1);
+	}
+	else
+	{
+		// middle triangle
+		return _getHeightAt(x,y,p,AB,AC,BC,depth-1);
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+void DynamicTriangleGrid::splitTriangle( const Vertex& a, const Vertex& b, 
+										 const Vertex& c, Vertex& AB, 
+										 Vertex& AC, Vertex& BC )
+{
 	float ux = b.x - a.x;
 	float uy = b.y - a.y;
 	float vx = c.x - a.x;
 	float vy = c.y - a.y;
 	float wx = c.x - b.x;
 	float wy = c.y - b.y;
-	float px = (float)x - a.x;
-	float py = (float)y - a.y;
 
-	float ab_length = sqrt(ux*ux+uy*uy);
-	float ac_length = sqrt(vx*vx+vy*vy);
-	float bc_length = sqrt(wx*wx+wy*wy);
+	float ab_square = ux*ux+uy*uy;
+	float ac_square = vx*vx+vy*vy;
+	float bc_square = wx*wx+wy*wy;
+
+	// createHeight() truncates the deviation to an int, and it stays below 1
+	// as long as half the edge times the steepness is below 2. Then all 
+	// midpoint heights are just the averages, and the same holds for every 
+	// sub-triangle since their edges are only half as long. So the seeds, 
+	// random numbers and square roots are skipped, the result is the same.
+	// (A bit of headroom below the exact bound of 16 absorbs rounding.)
+	float steep_square = steepness*steepness;
+	if( ab_square*steep_square < 15.0f && ac_square*steep_square < 15.0f 
+		&& bc_square*steep_square < 15.0f )
+	{
+		AB = Vertex( (a.x+b.x)*0.5, (a.y+b.y)*0.5, (a.z+b.z)/2, 0 );
+		AC = Vertex( (a.x+c.x)*0.5, (a.y+c.y)*0.5, (a.z+c.z)/2, 0 );
+		BC = Vertex( (c.x+b.x)*0.5, (c.y+b.y)*0.5, (b.z+c.z)/2, 0 );
+		return;
+	}
 
-	float lambda = (px*vy-py*vx)/(ux*vy-uy*vx);
-	float mue = (py*ux-px*uy)/(ux*vy-uy*vx);
+	float ab_length = sqrt(ab_square);
+	float ac_length = sqrt(ac_square);
+	float bc_length = sqrt(bc_square);
 
 	// create seeds at edge midpoints
-	float s_ab = interpolateSeeds(a.seed,b.seed);
-	float s_ac = interpolateSeeds(a.seed,c.seed);
-	float s_bc = interpolateSeeds(b.seed,c.seed);
+	int s_ab = interpolateSeeds(a.seed,b.seed);
+	int s_ac = interpolateSeeds(a.seed,c.seed);
+	int s_bc = interpolateSeeds(b.seed,c.seed);
 
 	// create heights at edge midpoints
 	float h_ab = createHeight( s_ab, (a.z+b.z)/2, ab_length*0.5 );
@@ -217,222 +243,387 @@ int DynamicTriangleGrid::_getHeightAt(int x, int y,
 	float h_bc = createHeight( s_bc, (b.z+c.z)/2, bc_length*0.5 );
 
 	// create edge midpoints
-	Vertex AB = Vertex( (a.x+b.x)*0.5, (a.y+b.y)*0.5, h_ab, s_ab );
-	Vertex AC = Vertex( (a.x+c.x)*0.5, (a.y+c.y)*0.5, h_ac, s_ac );
-	Vertex BC = Vertex( (c.x+b.x)*0.5, (c.y+b.y)*0.5, h_bc, s_bc );
-
-	if( lambda+mue <= 0.5 )
-	{
-		// "lower left" triangle (at point a)
-		return _getHeightAt(x,y,a,AB,AC,depth-1);
-	}
-	if( lambda > 0.5 )
-	{
-		// "lower right" triangle (at point b)
-		return _getHeightAt(x,y,AB,b,BC,depth-1);
-	}
-	if( mue > 0.5 )
-	{
-		// "top" triangle (at point c)
-		return _getHeightAt(x,y,AC,BC,c,depth-1);
-	}
-	else
-	{
-		// middle triangle
-		return _getHeightAt(x,y,AB,AC,BC,depth-1);
-	}
-
+	AB = Vertex( (a.x+b.x)*0.5, (a.y+b.y)*0.5, h_ab, s_ab );
+	AC = Vertex( (a.x+c.x)*0.5, (a.y+c.y)*0.5, h_ac, s_ac );
+	BC = Vertex( (c.x+b.x)*0.5, (c.y+b.y)*0.5, h_bc, s_bc );
 }
 
 //-----------------------------------------------------------------------------
 
-void StaticTriangleGrid::writeImage(const char *filename)
+bool StaticTriangleGrid::writeImage(const char *filename)
 {
-	// 8-bit grayscale surface for the heightmap
-	SDL_Surface* image = SDL_CreateRGBSurface(SDL_SWSURFACE,width+1,height+1,8,
-											  0x000000ff,0x000000ff,0x000000ff,0);
-	// 32-bit color surface for the preview image
-	SDL_Surface* preview = SDL_CreateRGBSurface(SDL_SWSURFACE,width+1,height+1,
-												32,RMASK,GMASK,BMASK,AMASK);
+	// the bitmap is laid out like the file, so it is saved directly
+	Bitmap& image = createImage();
 	
 	LogManager::log("building triangle mesh",true);
-	FractalTriangle* abd = buildTriangleMesh(A,B,D,detail);
-	FractalTriangle* cdb = buildTriangleMesh(C,D,B,detail);
-	FractalTriangle* current;
-
-	SDL_LockSurface(image);
-	SDL_LockSurface(preview);
-
-	LogManager::log("creating heightmap",true);
+	Uint32 start = SDL_GetTicks();
 
-	for( int y=0; y<height+1; y++ )
-		for( int x=0; x<width+1; x++ )
-		{	
-			// choose which base triangle the point is lying on
-			float lambda = (x-A.x)/(B.x-A.x);
-			float mue = (y-A.y)/(C.y-A.y);
-			if(lambda+mue < 1)
-				current = abd;
-			else
-				current = cdb;
-
-			// use height value as pixel color
-			int h = current->getHeightAt(x,y);
-			int ofs = x + y * image->pitch;
-			((Uint8*)image->pixels)[ofs] = (Uint8)h;
+	// level l has 2*4^l triangles, the last level is not stored at all
+	size_t nr_of_triangles = 0;
+	{
+		SC4_PROFILE("triangle mesh");
+		level_offset.resize(detail);
+		for( int l=0; l<detail; l++ )
+		{
+			level_offset[l] = nr_of_triangles;
+			nr_of_triangles += size_t(2) << (2*l);
 		}
+		height_ab.resize(nr_of_triangles);
+		height_ac.resize(nr_of_triangles);
+		height_bc.resize(nr_of_triangles);
 
-	blurImage(image,blur);
+		buildTriangleMesh(A,B,D,0,0);
+		buildTriangleMesh(C,D,B,0,1);
+	}
 
-	LogManager::log("creating preview",true);
+	SC4_LOG( "built " << nr_of_triangles << " triangles in " 
+			 << SDL_GetTicks() - start << " ms (3 bytes per triangle, " 
+			 << nr_of_triangles * 3 / 1024 << " KB)" );
 
-	for(int y=0; y<height+1; y++)
-		for(int x=0; x<width+1; x++)
-		{
-			// get height value from the grayscale heightmap
-			int ofs = x + y * image->pitch;
-			Uint8 h = ((Uint8*)image->pixels)[ofs];
-
-			// choose color depending on terrain height
-			Uint8 r,g,b;
-			if(h <= 83)
-			{
-				// water is blue - the deeper, the darker
-				r = (100*h)/83;
-				g = (100*h)/83;
-				b = 150 + (100*h)/83;
-			}
-			else
-			{
-				// land color goes from green (low) to red (mountains)
-				h -= 83;
-				r = 80 + (40*h)/172;
-				g = 120 - (40*h)/172;
-				b = 30;
+	LogManager::log("creating heightmap",true);
+	start = SDL_GetTicks();
+
+	{
+		SC4_PROFILE("heightmap");
+		for( int y=0; y<height+1; y++ )
+			for( int x=0; x<width+1; x++ )
+			{	
+				// use height value as pixel color
+				int h = getHeightAt(x,y);
+				image.getPixels()[x + y * image.getPitch()] = (Uint8)h;
 			}
-			ofs = x + y * preview->pitch / 4;
-			((Uint32*)preview->pixels)[ofs] = SDL_MapRGB(preview->format,r,g,b);
-		}
+	}
 
-	SDL_UnlockSurface(image);
-	SDL_UnlockSurface(preview);
+	Uint32 ticks = SDL_GetTicks() - start;
+	SC4_LOG( "created heightmap in " << ticks << " ms (" 
+			 << ticks * 1000000.0 / ((width+1)*(height+1)) 
+			 << " ns per pixel)" );
 
-	SDL_SaveBMP(image,filename);
-	SDL_SaveBMP(preview,"preview.bmp");
+	PostProcessor postprocessor(&image);
+	configure(postprocessor);
+	postprocessor.run();
 
-	SDL_FreeSurface(image);
-	SDL_FreeSurface(preview);
+	bool written = image.save(filename);
+	written = writePreview(image) && written;
 
 	LogManager::log("unloading triangle mesh",true);
-	delete abd;
-	delete cdb;
+	std::vector<Uint8>().swap(height_ab);
+	std::vector<Uint8>().swap(height_ac);
+	std::vector<Uint8>().swap(height_bc);
+	return written;
 }
 
 //-----------------------------------------------------------------------------
 
-void DynamicTriangleGrid::writeImage(const char *filename)
+class DynamicTriangleGrid::Renderer : public TileRenderer
 {
-	SDL_Surface* image = SDL_CreateRGBSurface(SDL_SWSURFACE,width+1,height+1,8,
-											  0x000000ff,0x000000ff,0x000000ff,0);
-	SDL_Surface* preview = SDL_CreateRGBSurface(SDL_SWSURFACE,width+1,height+1,
-												32,RMASK,GMASK,BMASK,AMASK);
-	
-	SDL_LockSurface(image);
-	SDL_LockSurface(preview);
+	DynamicTriangleGrid* grid;
+	int depth;	///< how often the base triangles are split
 
-	LogManager::log("creating heightmap",true);
+	/** The splits of every tile, for CACHE_TOP_LEVELS. */
+	std::vector<CacheCounts> cache_counts;
 
-	// this is the only difference from the StaticTriangleGrid's writeImage()
-	for( int y=0; y<height+1; y++ )
-		for( int x=0; x<width+1; x++ )
-		{	
-			int h = getHeightAt(x,y,detail);
-			int ofs = x + y * image->pitch;
-			((Uint8*)image->pixels)[ofs] = (Uint8)h;
+	Uint8 renderPixel(int x, int y)
+	{
+		return (Uint8)grid->getHeightAt(x,y,depth);
+	}
+
+	/** Looks up the first splits of a pixel in the cache and counts them. */
+	Uint8 renderCached(int x, int y, CacheCounts& counts)
+	{
+		Point p = getPoint(x,y);
+		Vertex a, b, c;
+		int levels = grid->cache.find(p,a,b,c);
+		counts.lookups += levels;
+		counts.splits += depth-levels;
+		return (Uint8)grid->_getHeightAt(x,y,p,a,b,c,depth-levels);
+	}
+
+	/** Builds the cache if it is used and doesn't fit the depth yet. */
+	void prepareCache()
+	{
+		if( grid->generation_mode != CACHE_TOP_LEVELS )
+			return;
+
+		int levels = TriangleCache<Vertex>::chooseLevels(depth);
+		if( grid->cache.getLevels() != levels )
+		{
+			grid->cache.build(*this,grid->A,grid->B,grid->C,grid->D,levels);
+			SC4_LOG( "storing the first " << levels << " of " << depth
+					 << " splits in a table of " 
+					 << grid->cache.getTriangles() << " triangles (" 
+					 << grid->cache.getBytes() / 1024 << " KB)" );
 		}
+	}
 
-	blurImage(image,blur);
+	void beginTiles(int nr_of_tiles)
+	{
+		if( grid->generation_mode == CACHE_TOP_LEVELS )
+			cache_counts.assign( nr_of_tiles, CacheCounts() );
+	}
 
-	LogManager::log("creating preview",true);
-	for(int y=0; y<height+1; y++)
-		for(int x=0; x<width+1; x++)
+	/** Logs how many of the splits of all pixels the cache saved. */
+	void endTiles(bool always)
+	{
+		if( grid->generation_mode != CACHE_TOP_LEVELS )
+			return;
+
+		CacheCounts total;
+		for( size_t i=0; i<cache_counts.size(); i++ )
 		{
-			int ofs = x + y * image->pitch;
-			Uint8 h = ((Uint8*)image->pixels)[ofs];
-
-			Uint8 r,g,b;
-			if(h <= 83)
-			{
-				r = (100*h)/83;
-				g = (100*h)/83;
-				b = 150 + (100*h)/83;
-			}
-			else
-			{
-				h -= 83;
-				r = 80 + (40*h)/172;
-				g = 120 - (40*h)/172;
-				b = 30;
-			}
-			ofs = x + y * preview->pitch / 4;
-			((Uint32*)preview->pixels)[ofs] = SDL_MapRGB(preview->format,r,g,b);
+			total.lookups += cache_counts[i].lookups;
+			total.splits += cache_counts[i].splits;
+		}
+		Uint64 all = total.lookups + total.splits;
+
+		std::ostringstream o;
+		o << "looked up " << total.lookups << " of " << all 
+		  << " splits in the table (" 
+		  << (all ? 100.0 * double(total.lookups) / double(all) : 100.0) 
+		  << "%), split " << total.splits << " triangles on the fly";
+		LogManager::log(o.str(),always);
+	}
+
+	void renderTile( Uint8* pixels, int pitch, 
+					 int x0, int y0, int x1, int y1 )
+	{
+		if( grid->generation_mode == PACKETS )
+		{
+			renderPackets( grid->packet_width, *this, pixels, pitch,
+						   grid->A, grid->B, grid->C, grid->D, depth,
+						   x0, y0, x1, y1 );
+			return;
 		}
 
-	SDL_UnlockSurface(image);
-	SDL_UnlockSurface(preview);
+		if( grid->generation_mode == CACHE_TOP_LEVELS )
+		{
+			// every tile counts into its own entry, so this needs no locking
+			CacheCounts& counts = cache_counts[ getTile(x0,y0) ];
+			for( int y=y0; y<y1; y++ )
+				for( int x=x0; x<x1; x++ )
+					pixels[x + y*pitch] = renderCached(x,y,counts);
+			return;
+		}
 
-	SDL_SaveBMP(image,filename);
-	SDL_SaveBMP(preview,"preview.bmp");
+		if( grid->generation_mode != RASTERIZE )
+		{
+			TileRenderer::renderTile(pixels,pitch,x0,y0,x1,y1);
+			return;
+		}
 
-	SDL_FreeSurface(image);
-	SDL_FreeSurface(preview);
-}
+		TriangleRasterizer<Renderer,Vertex> rasterizer(*this,pixels,pitch);
+		rasterizer.rasterize( grid->A, grid->B, grid->C, grid->D, depth,
+							  x0, y0, x1, y1 );
+	}
+
+public:
+	Renderer(DynamicTriangleGrid* grid, Bitmap* image)
+	: TileRenderer(image),grid(grid),
+	  depth(grid->getTriangleDepth(grid->detail)) 
+	{ 
+		prepareCache();
+	}
+
+	Renderer(DynamicTriangleGrid* grid, int width, int height)
+	: TileRenderer(width,height),grid(grid),
+	  depth(grid->getTriangleDepth(grid->detail)) 
+	{ 
+		prepareCache();
+	}
+
+	// interface for the TriangleRasterizer
+	static float getX(const Vertex& v) { return v.x; }
+	static float getY(const Vertex& v) { return v.y; }
+
+	void splitTriangle( const Vertex& a, const Vertex& b, const Vertex& c,
+						Vertex& ab, Vertex& ac, Vertex& bc )
+	{
+		grid->splitTriangle(a,b,c,ab,ac,bc);
+	}
+
+	Uint8 getPixel( int x, int y, 
+					const Vertex& a, const Vertex& b, const Vertex& c )
+	{
+		return (Uint8)grid->_getHeightAtTriangle(x,y,a,b,c);
+	}
+
+	// interface for the PacketTraversal and the TriangleRasterizer
+	typedef GridPoint Point;
+
+	Point getPoint(int x, int y) 
+	{ 
+		return GridPoint( x, y, grid->width, grid->height, 
+						  grid->random_mode == HASH_RANDOM ); 
+	}
+
+	bool pointsMove() const { return grid->random_mode == HASH_RANDOM; }
+
+	BaseTriangle chooseBaseTriangle(Point& p) 
+	{ 
+		return p.chooseBaseTriangle(grid->A,grid->B,grid->D); 
+	}
+
+	SubTriangle chooseSubTriangle( Point& p, const Vertex& a, 
+								   const Vertex& b, const Vertex& c )
+	{
+		return p.chooseSubTriangle(a,b,c);
+	}
+};
 
 //-----------------------------------------------------------------------------
 
-int StaticTriangleGrid::CompositeTriangle::getHeightAt(float x, float y)
+bool DynamicTriangleGrid::writeImage(const char *filename)
 {
-	float lambda = (x-A.x)/(B.x-A.x);
-	float mue = (y-A.y)/(C.y-A.y);
+	BandResult bands = memory_budget > 0 ? writeBands(filename) 
+										 : BANDS_UNSUPPORTED;
+	if( bands != BANDS_UNSUPPORTED )
+		return bands == BANDS_WRITTEN;
 
-	if(lambda+mue < 0.5) return tri_I->getHeightAt(x,y);
-	if(lambda > 0.5) return tri_II->getHeightAt(x,y);
-	if(mue > 0.5) return tri_III->getHeightAt(x,y);
-	return tri_IV->getHeightAt(x,y);
+	// the bitmap is laid out like the file, so it is saved directly
+	Bitmap& image = createImage();
+	
+	LogManager::log("creating heightmap",true);
+	if( getTriangleDepth(detail) < detail )
+		SC4_LOG( "splitting the triangles " << getTriangleDepth(detail) 
+				 << " times instead of " << detail 
+				 << ", they are smaller than a pixel then" );
+
+	// this is the only difference from the StaticTriangleGrid's writeImage()
+	// The tiles don't depend on each other, so they can be rendered in
+	// parallel.
+	{
+		SC4_PROFILE("heightmap");
+		ThreadPool own_pool( thread_pool ? 1 : threads );
+		ThreadPool& pool = thread_pool ? *thread_pool : own_pool;
+		Renderer renderer(this,&image);
+		renderer.render(pool);
+	}
+
+	PostProcessor postprocessor(&image);
+	configure(postprocessor);
+	postprocessor.run();
+
+	bool written = image.save(filename);
+	return writePreview(image) && written;
 }
 
 //-----------------------------------------------------------------------------
 
-int StaticTriangleGrid::AtomicTriangle::getHeightAt(float x, float y)
+void DynamicTriangleGrid::renderBand( ThreadPool& pool, Uint8* rows, 
+									  int pitch, int y0, int y1 )
 {
-	float lambda = (x-A.x)/(B.x-A.x);
-	float mue = (y-A.y)/(C.y-A.y);
-
-	return (1-lambda-mue)*A.z + lambda*B.z + mue*C.z;
+	Renderer renderer(this,width+1,height+1);
+	renderer.renderRows(pool,rows,pitch,y0,y1);
 }
 
 //-----------------------------------------------------------------------------
 
-StaticTriangleGrid::CompositeTriangle::~CompositeTriangle()
+int StaticTriangleGrid::getHeightAt(int x, int y)
 {
-	delete tri_I;
-	delete tri_II;
-	delete tri_III;
-	delete tri_IV;
+	// lambda and mue of the point on the triangle ABC, times n
+	Sint64 n = Sint64(width) * height;
+	Sint64 lambda = Sint64(x) * height;
+	Sint64 mue = Sint64(y) * width;
+
+	// choose which base triangle the point is lying on
+	bool exact = random_mode == HASH_RANDOM;
+	bool upper = exact ? lambda+mue < n 
+					   : (x-A.x)/(B.x-A.x) + (y-A.y)/(C.y-A.y) < 1;
+	Vertex A, B, C;
+	size_t index;
+	if(upper)
+	{
+		A = this->A;
+		B = this->B;
+		C = this->D;
+		index = 0;
+	}
+	else
+	{
+		A = this->C;
+		B = this->D;
+		C = this->B;
+		lambda = n - lambda;
+		mue = n - mue;
+		index = 1;
+	}
+
+	for( int level=0; level<detail; level++ )
+	{
+		size_t ofs = level_offset[level] + index;
+		Vertex AB( (A.x+B.x)*0.5, A.y, height_ab[ofs], 0 );
+		Vertex AC( A.x, (A.y+C.y)*0.5, height_ac[ofs], 0 );
+		Vertex BC( (B.x+C.x)*0.5, (B.y+C.y)*0.5, height_bc[ofs], 0 );
+
+		// the integers are tracked in both modes, they can't overflow on
+		// the few levels of the mesh
+		int sub;
+		if(exact)
+		{
+			sub = 2*(lambda+mue) < n ? 0 : 2*lambda > n ? 1 : 2*mue > n ? 2 : 3;
+		}
+		else
+		{
+			float s = (x-A.x)/(B.x-A.x);
+			float t = (y-A.y)/(C.y-A.y);
+			sub = s+t < 0.5 ? 0 : s > 0.5 ? 1 : t > 0.5 ? 2 : 3;
+		}
+
+		index *= 4;
+		if( sub == 0 )
+		{
+			// sub-triangle I
+			B = AB;
+			C = AC;
+			lambda *= 2;
+			mue *= 2;
+		}
+		else if( sub == 1 )
+		{
+			// sub-triangle II
+			A = AB;
+			C = BC;
+			lambda = 2*lambda - n;
+			mue *= 2;
+			index += 1;
+		}
+		else if( sub == 2 )
+		{
+			// sub-triangle III
+			A = AC;
+			B = BC;
+			lambda *= 2;
+			mue = 2*mue - n;
+			index += 2;
+		}
+		else
+		{
+			// sub-triangle IV
+			A = BC;
+			B = AC;
+			C = AB;
+			lambda = n - 2*lambda;
+			mue = n - 2*mue;
+			index += 3;
+		}
+	}
+
+	// interpolate the heights of the corners
+	float s = (x-A.x)/(B.x-A.x);
+	float t = (y-A.y)/(C.y-A.y);
+
+	return (1-s-t)*A.z + s*B.z + t*C.z;
 }
 
 //-----------------------------------------------------------------------------
 
-StaticTriangleGrid::FractalTriangle* 
-StaticTriangleGrid::buildTriangleMesh(Vertex A, Vertex B, Vertex C, int depth)
+void StaticTriangleGrid::buildTriangleMesh( Vertex A, Vertex B, Vertex C, 
+											int level, size_t index )
 {
 	// this works only for axis-aligned rectangular triangles
 	assert(A.x==C.x && A.y==B.y);
 
-	if( depth==0 )
-	{
-		return new AtomicTriangle(A,B,C);
-	}
+	if( level==detail ) return;
 
 	int s_ab = interpolateSeeds(A.seed,B.seed);
 	int s_ac = interpolateSeeds(A.seed,C.seed);
@@ -446,13 +637,13 @@ StaticTriangleGrid::buildTriangleMesh(Vertex A, Vertex B, Vertex C, int depth)
 	Vertex AC( A.x, (A.y+C.y)*0.5, h_ac, s_ac );
 	Vertex BC( (B.x+C.x)*0.5, (B.y+C.y)*0.5, h_bc, s_bc );
 
-	CompositeTriangle* tri = new CompositeTriangle;
-	tri->A = A;
-	tri->B = B;
-	tri->C = C;
-	tri->tri_I = buildTriangleMesh(A,AB,AC,depth-1);
-	tri->tri_II = buildTriangleMesh(AB,B,BC,depth-1);
-	tri->tri_III = buildTriangleMesh(AC,BC,C,depth-1);
-	tri->tri_IV = buildTriangleMesh(BC,AC,AB,depth-1);
-	return tri;
+	size_t ofs = level_offset[level] + index;
+	height_ab[ofs] = (Uint8)h_ab;
+	height_ac[ofs] = (Uint8)h_ac;
+	height_bc[ofs] = (Uint8)h_bc;
+
+	buildTriangleMesh(A,AB,AC,level+1,4*index);
+	buildTriangleMesh(AB,B,BC,level+1,4*index+1);
+	buildTriangleMesh(AC,BC,C,level+1,4*index+2);
+	buildTriangleMesh(BC,AC,AB,level+1,4*index+3);
 }
\ No newline at end of file
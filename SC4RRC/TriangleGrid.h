@@ -35,8 +35,11 @@
 #ifndef TRIANGLEGRID_H
 #define TRIANGLEGRID_H
 
+#include <vector>
+
 #include "config.hpp"
 #include "SC4Landscape.h"
+#include "TriangleCache.h"
 
 /**	A vertex of a FractalTriangle.
  *	It stores the coordinates and a seed. The seed is necessary to ensure that
@@ -65,9 +68,11 @@ struct Vertex
  *	and again, applying a random shift to the newly created vertices each time.
  *
  *	This terrain generator has a few weaknesses, however: The most problematic
- *	one is its enormous memory hunger, especially on higher detail levels. This
- *	is because it pre-builds the whole random triangle grid and keeps it in 
- *	memory until the intial (unfiltered) heightmap has been drawn. The other 
+ *	one is its memory hunger, especially on higher detail levels. This is 
+ *	because it pre-builds the whole random triangle grid and keeps it in 
+ *	memory until the intial (unfiltered) heightmap has been drawn. It only 
+ *	needs 3 bytes per triangle, but the number of triangles still grows by 
+ *	a factor of 4 with every detail level. The other 
  *	problem is that the resulting landscape often still looks quite "edgy",
  *	even after blurring it. This is a problem of the underlying triangle grid
  *	algorithm.
@@ -79,59 +84,47 @@ struct Vertex
 class SC4RRC_API StaticTriangleGrid : public SC4Landscape
 {
 	///////////////////////////////////////////////////////////////////////////
-	//			Classes used by StaticTriangleGrid
+	//			the triangle mesh
 	///////////////////////////////////////////////////////////////////////////
 
-	/** Base class for the static fractal triangle mesh. */
-	struct FractalTriangle
-	{
-		virtual ~FractalTriangle() { };
-		virtual int getHeightAt(float x, float y) = 0;
-	};
+	// The mesh is a complete tree: Each triangle that is not on the last 
+	// level is split into the four sub-triangles I (at point A), II (at 
+	// point B), III (at point C) and IV (in the middle). So the triangles
+	// don't have to be stored explicitly. Triangle i of a level has the
+	// children 4i to 4i+3 on the next level, and the base triangles ABD and
+	// CDB are the triangles 0 and 1 of level 0.
+	// The positions of the vertices are computed while walking down the 
+	// tree, so the only thing that has to be stored per triangle are the 
+	// heights of its three split points.
+
+	/** Offsets of the levels in the height arrays. */
+	std::vector<size_t> level_offset;
+
+	std::vector<Uint8> height_ab;	///< heights of the split points on edge AB
+	std::vector<Uint8> height_ac;	///< heights of the split points on edge AC
+	std::vector<Uint8> height_bc;	///< heights of the split points on edge BC
 
-	/** FractalTriangle that is split into smaller triangles.
-	 *	You can see the triangle mesh as a tree where the CompositeTriangles are
-	 *	the inner nodes and the AtomicTriangles are the leafs. 
+	/** Builds the triangle mesh statically.
+	 *	@param A,B,C	the corners of the triangle.
+	 *	@param level	the level of the triangle.
+	 *	@param index	the number of the triangle on its level.
+	 */
+	void buildTriangleMesh(Vertex A, Vertex B, Vertex C, int level, size_t index);
+
+	/**	Returns the height of pixel (x|y) on the mesh.
+	 *	In HASH_RANDOM mode, the triangles are chosen in exact integer 
+	 *	arithmetic like a LatticePoint does, but the sub-triangles of this 
+	 *	mesh keep their right angle, and points on the edges belong to the
+	 *	sub-triangle further inside. LEGACY_RANDOM mode divides floats like
+	 *	older versions did.
 	 */
-	struct CompositeTriangle : public FractalTriangle
-	{
-		Vertex A;
-		Vertex B;
-		Vertex C;
-
-		FractalTriangle* tri_I;		///< sub-triangle at point A
-		FractalTriangle* tri_II;	///< sub-triangle at point B
-		FractalTriangle* tri_III;	///< sub-triangle at point C
-		FractalTriangle* tri_IV;	///< sub-triangle in the middle
-
-		virtual ~CompositeTriangle();
-		virtual int getHeightAt(float x, float y);
-	};
-
-	/** Triangles that are not split. */
-	struct AtomicTriangle : public FractalTriangle
-	{
-		Vertex A;
-		Vertex B;
-		Vertex C;
-
-		AtomicTriangle(Vertex A, Vertex B, Vertex C) : A(A),B(B),C(C) { }
-		virtual ~AtomicTriangle() { }
-		virtual int getHeightAt(float x, float y);
-	};
+	int getHeightAt(int x, int y);
 
 
 	///////////////////////////////////////////////////////////////////////////
 	//		member variables and functions
 	///////////////////////////////////////////////////////////////////////////
 
-	/** Builds the triangle mesh statically.
-	 *	@param A,B,C	the corners of the base triangle.
-	 *	@param depth	how often the triangle should be split.
-	 *	@return			a FractalTriangle containing the complete mesh.
-	 */
-	FractalTriangle* buildTriangleMesh(Vertex A,Vertex B,Vertex C,int depth);
-
 	Vertex A; ///< upper left corner
 	Vertex B; ///< upper right corner
 	Vertex C; ///< lower right corner
@@ -154,6 +147,9 @@ class SC4RRC_API StaticTriangleGrid : public SC4Landscape
 	 */
 	__inline int interpolateSeeds( int seed1, int seed2 )
 	{ 
+		if(random_mode == HASH_RANDOM)
+			return int(hashSeeds(seed1,seed2));
+
 		// If you just add the two seeds, the distribution of the random values
 		// is far from equal. The 99 is just an arbitrary value, and the random
 		// values are still not really uniformly distributed but it's much 
@@ -182,9 +178,14 @@ public:
 	 *		you will always get the same landscape. This way, if you find a
 	 *		landscape with a shape that you like, you can adjust the level, 
 	 *		blur and steepness settings to give it that final touch.
+	 *
+	 *	@param random_mode
+	 *		Use LEGACY_RANDOM to get the same landscape for a seed as older
+	 *		versions did.
 	 */
 	StaticTriangleGrid( int width, int height, int level, int blur,
-						int detail, float steepness, int seed );
+						int detail, float steepness, int seed,
+						RandomMode random_mode = HASH_RANDOM );
 
 	virtual ~StaticTriangleGrid() { }
 
@@ -192,7 +193,7 @@ public:
 	 *	This maps the height values from the triangle mesh to the pixels of the
 	 *	image. The size of the image is defined by the width and height values.
 	 */
-	void writeImage(const char* filename);
+	bool writeImage(const char* filename);
 };
 
 
@@ -232,12 +233,17 @@ class SC4RRC_API DynamicTriangleGrid : public SC4Landscape
 	 */
 	__inline int interpolateSeeds( int seed1, int seed2 )
 	{ 
+		if(random_mode == HASH_RANDOM)
+			return int(hashSeeds(seed1,seed2));
+
 		// If you just add the two seeds, the distribution of the random values
 		// is far from uniform. The 99 is just an arbitrary value, and the random
 		// values are still not really uniformly distributed but it's much 
 		// better than with any other number I tried and should really be 
 		// sufficient for our purposes.
-		return seed1+seed2+99;
+		// Older versions stored the result in a float, which rounds off the
+		// lower bits of large seeds. The legacy maps depend on that.
+		return (int)(float)(seed1+seed2+99);
 	}
 	
 	/**	Returns the terrain height at position (x|y).
@@ -252,20 +258,47 @@ class SC4RRC_API DynamicTriangleGrid : public SC4Landscape
 	 *	Recursively splits the triangle until the desired recursion depth is 
 	 *	reached. Then it calls _getHeightAtTriangle().
 	 *	@param x,y		The coordinates of the point of which you want to know the height.
+	 *	@param p		The same point on the current triangle.
 	 *	@param a,b,c	The corners of the current triangle.
 	 *	@param depth	How often the triangle has to be split.
 	 */
-	int _getHeightAt(int x, int y, Vertex a, Vertex b, Vertex c, int depth);
+	int _getHeightAt( int x, int y, GridPoint p, 
+					  Vertex a, Vertex b, Vertex c, int depth );
 
 	/**	Helper function for _getHeightAt().
 	 *	Returns the height value of the point (x|y) on the triangle abc.
 	 */
 	int _getHeightAtTriangle(int x, int y, Vertex a, Vertex b, Vertex c);
 
+	/**	Splits the triangle abc into four sub-triangles.
+	 *	Creates the midpoints of the edges and moves them up or down by a 
+	 *	random amount. Once the edges are too short for that amount to 
+	 *	reach a whole step, the midpoints just get the averaged heights.
+	 *	@param ab,ac,bc		Receive the new vertices.
+	 */
+	void splitTriangle( const Vertex& a, const Vertex& b, const Vertex& c,
+						Vertex& ab, Vertex& ac, Vertex& bc );
+
+	/** The top levels of the triangles for CACHE_TOP_LEVELS. */
+	TriangleCache<Vertex> cache;
+
+	/**	Computes the heightmap tile by tile, using getHeightAt(), the 
+	 *	TriangleRasterizer, the TriangleCache or the PacketTraversal.
+	 */
+	class Renderer;
+	friend class Renderer;
+
+	/** The triangles can be rendered in any order, so bands just work. */
+	bool prepareBands(PostProcessor& /*postprocessor*/) { return true; }
+
+	void renderBand( ThreadPool& pool, Uint8* rows, int pitch, 
+					 int y0, int y1 );
+
 public:
 	/**	@param detail	
 	 *		Detail level for the triangle grid. Defines how often the base 
-	 *		triangles will be split. 
+	 *		triangles will be split. Triangles that are already smaller than
+	 *		a pixel are not split anymore, see setMinTriangleSize().
 	 *
 	 *	@param steepness
 	 *		Influences how "rough" the resulting landscape will be. The newly
@@ -280,19 +313,24 @@ public:
 	 *		you will always get the same landscape. This way, if you find a
 	 *		landscape with a shape that you like, you can adjust the level, 
 	 *		blur and steepness settings to give it that final touch.
+	 *
+	 *	@param random_mode
+	 *		Use LEGACY_RANDOM to get the same landscape for a seed as older
+	 *		versions did.
 	 */
 	DynamicTriangleGrid( int width, int height, int level, int blur,
-						 int detail, float steepness, int seed );
+						 int detail, float steepness, int seed,
+						 RandomMode random_mode = HASH_RANDOM );
 
 	virtual ~DynamicTriangleGrid() { }
 
 	/**	Creates a heightmap and a preview map and saves them. 
 	 *	The heightmap is saved as a 8-Bit BMP file with the given filename.
 	 *	The preview map that is only meant to give you a feel of what the 
-	 *	region will look like in the game will be saved as a 32-Bit BMP file
+	 *	region will look like in the game will be saved as a 24-Bit BMP file
 	 *	called preview.bmp.
 	 */
-	void writeImage(const char* filename);
+	bool writeImage(const char* filename);
 };
 
 #endif // TRIANGLEGRID_H
\ No newline at end of file
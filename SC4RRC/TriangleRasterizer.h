@@ -0,0 +1,602 @@
+/******************************************************************************
+ *	file: TriangleRasterizer.h
+ *
+ *	Copyright (c) 2007, Benjamin Schug
+ *
+ *	This file is part of the SimCity 4 Random Region Creator (SC4RRC).
+ *
+ *	Sim City is a registered trademark of Electronic Arts.
+ *	This program is in no way associated with Maxis or Electronic Arts.
+ *
+ *	SC4RRC is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	SC4RRC is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+/** @file
+ *	Point location and scan conversion for the dynamic triangle grids.
+ *	The dynamic triangle grids find the triangle a pixel lies on by starting
+ *	at the base triangles and choosing one of the four sub-triangles again and
+ *	again. The functions in here make that choice. All generators use them, so
+ *	the TriangleRasterizer assigns every pixel to exactly the same triangle as
+ *	the per-pixel path does. The grids whose vertices lie on the lattice of
+ *	the map make the same choice with the exact integers of a LatticePoint,
+ *	except in LEGACY_RANDOM mode, see GridPoint.
+ */
+
+#ifndef SC4RRC__TRIANGLERASTERIZER_H
+#define SC4RRC__TRIANGLERASTERIZER_H
+
+#include <math.h>
+#include <vector>
+
+#include <SDL/SDL_types.h>
+
+/** The two triangles a rectangular map ABCD is split into first. */
+enum BaseTriangle
+{
+	BASE_ABD,	///< the triangle at the upper left corner
+	BASE_CDB	///< the triangle at the lower right corner
+};
+
+/** The four sub-triangles of a triangle abc. */
+enum SubTriangle
+{
+	SUB_A,		///< "lower left" triangle (at point a)
+	SUB_B,		///< "lower right" triangle (at point b)
+	SUB_C,		///< "top" triangle (at point c)
+	SUB_MIDDLE	///< middle triangle
+};
+
+/**	Computes the barycentric coordinates of the point (x|y) on the triangle
+ *	abc. The point is a + lambda*(b-a) + mue*(c-a).
+ */
+__inline void barycentric( float x, float y,
+						   float ax, float ay, float bx, float by,
+						   float cx, float cy, float& lambda, float& mue )
+{
+	float ux = bx - ax;
+	float uy = by - ay;
+	float vx = cx - ax;
+	float vy = cy - ay;
+	float px = x - ax;
+	float py = y - ay;
+
+	lambda = (px*vy-py*vx)/(ux*vy-uy*vx);
+	mue = (py*ux-px*uy)/(ux*vy-uy*vx);
+}
+
+/**	Chooses the base triangle of a point.
+ *	@param lambda,mue	barycentric coordinates of the point on triangle ABD
+ */
+__inline BaseTriangle chooseBaseTriangle(float lambda, float mue)
+{
+	return lambda+mue <= 1 ? BASE_ABD : BASE_CDB;
+}
+
+/**	Chooses the sub-triangle of a point when a triangle abc is split at the
+ *	midpoints of its edges.
+ *	@param lambda,mue	barycentric coordinates of the point on triangle abc
+ */
+__inline SubTriangle chooseSubTriangle(float lambda, float mue)
+{
+	if( lambda+mue <= 0.5 ) return SUB_A;
+	if( lambda > 0.5 ) return SUB_B;
+	if( mue > 0.5 ) return SUB_C;
+	return SUB_MIDDLE;
+}
+
+/**	A pixel on a triangle grid whose vertices lie on the dyadic lattice of
+ *	the map, for choosing the triangles without rounding errors.
+ *	The vertices of the static and dynamic triangle grids are the corners of
+ *	the map and the midpoints of the edges, so the barycentric coordinates of
+ *	a pixel only change by doubling and subtracting 1 from one level to the
+ *	next. This keeps them as integer numerators over the denominator
+ *	width*height and chooses the triangles with a few integer comparisons
+ *	instead of the divisions of barycentric(). The result is exact and 
+ *	doesn't depend on the compiler or the FPU.
+ *
+ *	The choices are the same as with barycentric(), chooseBaseTriangle() and
+ *	chooseSubTriangle() as long as the coordinates of the vertices are exact
+ *	floats, which they are until the triangles are much smaller than a 
+ *	pixel. Beyond that, the rounding errors of barycentric() can choose
+ *	differently for pixels that lie on the edge between two triangles, and
+ *	the two triangles can give them heights that are a step apart. So 
+ *	GridPoint only uses this in HASH_RANDOM mode.
+ */
+class LatticePoint
+{
+	Sint64 lambda;	///< lambda * n
+	Sint64 mue;		///< mue * n
+	Sint64 n;
+
+public:
+	/** A point that has to be assigned before it is used. */
+	LatticePoint() : lambda(0),mue(0),n(1) { }
+
+	/**	The pixel (x|y) on the triangle ABD of a map ABCD whose upper left 
+	 *	corner A is at (0|0) and whose lower right corner C is at 
+	 *	(width|height).
+	 */
+	LatticePoint(int x, int y, int width, int height)
+	: lambda( Sint64(x) * height ), mue( Sint64(y) * width ),
+	  n( Sint64(width) * height )
+	{ }
+
+	/**	Chooses the base triangle like chooseBaseTriangle() and moves on to
+	 *	its coordinates.
+	 */
+	BaseTriangle chooseBaseTriangle()
+	{
+		if( lambda+mue <= n ) 
+			return BASE_ABD;
+
+		// C is opposite to A, D to B and B to D
+		lambda = n - lambda;
+		mue = n - mue;
+		return BASE_CDB;
+	}
+
+	/**	Chooses the sub-triangle like chooseSubTriangle() and moves on to
+	 *	its coordinates.
+	 */
+	SubTriangle chooseSubTriangle()
+	{
+		if( 2*(lambda+mue) <= n )
+		{
+			lambda *= 2;
+			mue *= 2;
+			return SUB_A;
+		}
+		if( 2*lambda > n )
+		{
+			lambda = 2*lambda - n;
+			mue *= 2;
+			return SUB_B;
+		}
+		if( 2*mue > n )
+		{
+			lambda *= 2;
+			mue = 2*mue - n;
+			return SUB_C;
+		}
+
+		// the middle triangle AB,AC,BC is upside down
+		Sint64 l = n - 2*lambda;
+		mue = 2*(lambda+mue) - n;
+		lambda = l;
+		return SUB_MIDDLE;
+	}
+};
+
+/**	A pixel on a dynamic triangle grid.
+ *	In HASH_RANDOM mode, it chooses its triangles with the exact integers of
+ *	a LatticePoint. In LEGACY_RANDOM mode, it calls barycentric() on the 
+ *	vertices of every triangle like older versions did, because their maps
+ *	depend on the rounding errors of that on high detail levels.
+ *	The vertices must have the members x and y.
+ */
+class GridPoint
+{
+	LatticePoint lattice;
+	float x, y;
+	bool exact;
+
+public:
+	/** A point that has to be assigned before it is used. */
+	GridPoint() : x(0),y(0),exact(true) { }
+
+	/**	The pixel (x|y) on a map whose upper left corner is at (0|0) and 
+	 *	whose lower right corner is at (width|height).
+	 *	@param exact	true to use a LatticePoint
+	 */
+	GridPoint(int x, int y, int width, int height, bool exact)
+	: x((float)x),y((float)y),exact(exact)
+	{
+		if(exact) lattice = LatticePoint(x,y,width,height);
+	}
+
+	/**	Chooses the base triangle of the map ABCD and moves on to its 
+	 *	coordinates.
+	 */
+	template<class V>
+	BaseTriangle chooseBaseTriangle(const V& A, const V& B, const V& D)
+	{
+		if(exact) return lattice.chooseBaseTriangle();
+
+		float lambda, mue;
+		barycentric(x,y,A.x,A.y,B.x,B.y,D.x,D.y,lambda,mue);
+		return ::chooseBaseTriangle(lambda,mue);
+	}
+
+	/**	Chooses the sub-triangle of abc and moves on to its coordinates. */
+	template<class V>
+	SubTriangle chooseSubTriangle(const V& a, const V& b, const V& c)
+	{
+		if(exact) return lattice.chooseSubTriangle();
+
+		float lambda, mue;
+		barycentric(x,y,a.x,a.y,b.x,b.y,c.x,c.y,lambda,mue);
+		return ::chooseSubTriangle(lambda,mue);
+	}
+};
+
+
+/**	Renders a dynamic triangle grid by splitting every triangle only once.
+ *	Computing each pixel on its own means descending from the base triangles
+ *	and splitting every triangle on the way, although all pixels of a triangle
+ *	take the same way. The rasterizer splits the triangles top-down instead
+ *	and hands the pixels of each triangle down to its sub-triangles. Triangles
+ *	without any pixels are not split at all.
+ *
+ *	The result is exactly the same as with the per-pixel path. Pixels that are
+ *	far away from the edges of the sub-triangles are handed down in spans of a
+ *	row, which are computed in double precision. Pixels that are close to an
+ *	edge are handed down one by one after asking the generator, with the same
+ *	Point that the per-pixel path uses, because rounding errors or the exact
+ *	tests of a LatticePoint decide which side of the edge they are on.
+ *
+ *	The Generator must provide these members:
+ *	- static float getX(const V& v) and getY(const V& v), the position of a
+ *	  vertex
+ *	- void splitTriangle(const V& a, const V& b, const V& c,
+ *	  V& ab, V& ac, V& bc), which creates the edge midpoints of abc
+ *	- Uint8 getPixel(int x, int y, const V& a, const V& b, const V& c), the
+ *	  height value of pixel (x|y) on the triangle abc
+ *	- the Point interface of the PacketTraversal: a type Point, 
+ *	  Point getPoint(int x, int y), BaseTriangle chooseBaseTriangle(Point& p)
+ *	  and SubTriangle chooseSubTriangle(Point& p, const V& a, const V& b,
+ *	  const V& c)
+ *	- bool pointsMove() const, true if choosing a triangle moves the Point
+ *	  onto it. Then the Point of a pixel that leaves a span is moved down
+ *	  the triangles of the span first.
+ */
+template<class Generator, class V>
+class TriangleRasterizer
+{
+	typedef typename Generator::Point Point;
+
+	/** The pixels x0 <= x < x1 in row y. */
+	struct Span
+	{
+		int y, x0, x1;
+		Span(int y, int x0, int x1) : y(y),x0(x0),x1(x1) { }
+	};
+
+	/** A pixel with its position on the current triangle. */
+	struct Pixel
+	{
+		int x, y;
+		Point p;
+		Pixel(int x, int y, const Point& p) : x(x),y(y),p(p) { }
+	};
+
+	/** A triangle on the way down from a base triangle. */
+	struct Triangle
+	{
+		V a, b, c;
+		bool exact;	///< whether no vertex position has been rounded yet
+	};
+
+	/** The pixels that lie on a triangle. */
+	struct PixelSet
+	{
+		std::vector<Span> spans;	///< pixels far away from the edges
+		std::vector<Pixel> pixels;	///< pixels close to an edge
+
+		bool empty() const { return spans.empty() && pixels.empty(); }
+		void clear() { spans.clear(); pixels.clear(); }
+	};
+
+	/** An interval of pixels that all belong to the same sub-triangle. */
+	struct Run
+	{
+		int x0, x1;
+		int child;
+	};
+
+	Generator& generator;
+	Uint8* image;
+	int pitch;
+
+	/** Four pixel sets per recursion level, one for each sub-triangle. */
+	std::vector<PixelSet> sets;
+
+	/** The triangle of every recursion level that is being split. */
+	std::vector<Triangle> path;
+
+	/**	Restricts the interval [lo,hi] to the x for which f0 + x*fx <= t. */
+	static void clipBelow( double f0, double fx, double t,
+						   double& lo, double& hi )
+	{
+		if( fx > 0 )
+		{
+			double x = (t-f0)/fx;
+			if( x < hi ) hi = x;
+		}
+		else if( fx < 0 )
+		{
+			double x = (t-f0)/fx;
+			if( x > lo ) lo = x;
+		}
+		else if( f0 > t )
+		{
+			hi = lo - 1;
+		}
+	}
+
+	/**	Restricts the interval [lo,hi] to the x for which f0 + x*fx >= t. */
+	static void clipAbove( double f0, double fx, double t,
+						   double& lo, double& hi )
+	{
+		clipBelow(-f0,-fx,-t,lo,hi);
+	}
+
+	/**	Distributes the pixels of the triangle abc among its sub-triangles.
+	 *	@param level	The recursion level of abc, or -1 if abc is the base
+	 *					triangle ABD. Then, the pixels are distributed among 
+	 *					ABD (children[0]) and CDB (children[1]) instead of
+	 *					the sub-triangles.
+	 */
+	void split( const PixelSet& set, const V& a, const V& b, const V& c,
+				int level, PixelSet* children )
+	{
+		bool base = level < 0;
+		float ax = Generator::getX(a);
+		float ay = Generator::getY(a);
+		float bx = Generator::getX(b);
+		float by = Generator::getY(b);
+		float cx = Generator::getX(c);
+		float cy = Generator::getY(c);
+
+		for( size_t i=0; i<set.pixels.size(); i++ )
+		{
+			Pixel p = set.pixels[i];
+			children[ choose(p.p,a,b,c,base) ].pixels.push_back(p);
+		}
+
+		// The edge vectors are rounded exactly like in barycentric().
+		float ux = bx - ax;
+		float uy = by - ay;
+		float vx = cx - ax;
+		float vy = cy - ay;
+		double det = (double)ux*vy - (double)uy*vx;
+
+		// Pixels closer than this to an edge (in barycentric coordinates) are
+		// checked one by one. barycentric() is accurate to about k * 1e-7,
+		// where k depends on the shape of the triangle. For the triangles of
+		// the grids, k is below 10 unless they are much smaller than a pixel.
+		const double margin = 1e-4;
+
+		double max_px = MAXF( fabs(bx-ax), fabs(cx-ax) ) + 2.0;
+		double max_py = MAXF( fabs(by-ay), fabs(cy-ay) ) + 2.0;
+		double k = 1.0 + MAXF( max_px*fabs(vy) + max_py*fabs(vx),
+							   max_py*fabs(ux) + max_px*fabs(uy) ) / fabs(det);
+
+		// Moving Points decide without rounding errors, and the spans only 
+		// agree with them while the vertices are exactly where they belong.
+		bool exact = base || !generator.pointsMove() || path[level].exact;
+		if( !(det != 0 && k < 64 && exact) )
+		{
+			for( size_t i=0; i<set.spans.size(); i++ )
+			{
+				const Span& s = set.spans[i];
+				for( int x=s.x0; x<s.x1; x++ )
+					handDown(x,s.y,a,b,c,level,children);
+			}
+			return;
+		}
+
+		// Along a row, lambda = l0 + x*lx and mue = m0 + x*mx.
+		double lx = vy/det;
+		double mx = -uy/det;
+
+		for( size_t i=0; i<set.spans.size(); i++ )
+		{
+			const Span& s = set.spans[i];
+			double py = s.y - ay;
+			double l0 = (-ax*(double)vy - py*vx)/det;
+			double m0 = (py*ux + ax*(double)uy)/det;
+
+			Run runs[4];
+			int nr_of_runs = 0;
+			for( int child=0; child<(base?2:4); child++ )
+			{
+				double lo = s.x0;
+				double hi = s.x1 - 1;
+				if( base )
+				{
+					if(child==0) clipBelow(l0+m0,lx+mx,1-margin,lo,hi);
+					else		 clipAbove(l0+m0,lx+mx,1+margin,lo,hi);
+				}
+				else if( child==SUB_A )
+				{
+					clipBelow(l0+m0,lx+mx,0.5-margin,lo,hi);
+				}
+				else
+				{
+					clipAbove(l0+m0,lx+mx,0.5+margin,lo,hi);
+					if(child==SUB_B)
+					{
+						clipAbove(l0,lx,0.5+margin,lo,hi);
+					}
+					else
+					{
+						clipBelow(l0,lx,0.5-margin,lo,hi);
+						if(child==SUB_C) clipAbove(m0,mx,0.5+margin,lo,hi);
+						else			 clipBelow(m0,mx,0.5-margin,lo,hi);
+					}
+				}
+				if( lo > hi ) continue;
+
+				Run run;
+				run.x0 = (int)ceil(lo);
+				run.x1 = (int)floor(hi) + 1;
+				run.child = child;
+				if( run.x0 >= run.x1 ) continue;
+
+				// keep the runs sorted by x
+				int j = nr_of_runs++;
+				for( ; j>0 && runs[j-1].x0 > run.x0; j-- )
+					runs[j] = runs[j-1];
+				runs[j] = run;
+			}
+
+			// everything between the runs is close to an edge
+			int x = s.x0;
+			for( int j=0; j<nr_of_runs; j++ )
+			{
+				int x0 = runs[j].x0 > x ? runs[j].x0 : x;
+				if( x0 >= runs[j].x1 ) continue;
+				for( ; x<x0; x++ )
+					handDown(x,s.y,a,b,c,level,children);
+				children[runs[j].child].spans.push_back(Span(s.y,x0,runs[j].x1));
+				x = runs[j].x1;
+			}
+			for( ; x<s.x1; x++ )
+				handDown(x,s.y,a,b,c,level,children);
+		}
+	}
+
+	/**	Chooses the sub-triangle of a single pixel, just like the generator,
+	 *	and moves its Point onto it.
+	 */
+	int choose( Point& p, const V& a, const V& b, const V& c, bool base )
+	{
+		return base ? (int)generator.chooseBaseTriangle(p)
+					: (int)generator.chooseSubTriangle(p,a,b,c);
+	}
+
+	/**	Takes the pixel (x|y) out of a span of the triangle abc on the given
+	 *	level and hands it down on its own.
+	 */
+	void handDown( int x, int y, const V& a, const V& b, const V& c, 
+				   int level, PixelSet* children )
+	{
+		Point p = generator.getPoint(x,y);
+		if( level >= 0 && generator.pointsMove() )
+		{
+			// the span was on the triangles of the path for sure
+			generator.chooseBaseTriangle(p);
+			for( int l=0; l<level; l++ )
+				generator.chooseSubTriangle(p,path[l].a,path[l].b,path[l].c);
+		}
+		int child = choose(p,a,b,c,level < 0);
+		children[child].pixels.push_back(Pixel(x,y,p));
+	}
+
+	static double MAXF(double a, double b) { return a>b?a:b; }
+
+	/** Writes the height values of all pixels of a triangle. */
+	void fill( const PixelSet& set, const V& a, const V& b, const V& c )
+	{
+		for( size_t i=0; i<set.spans.size(); i++ )
+		{
+			const Span& s = set.spans[i];
+			Uint8* row = image + s.y*pitch;
+			for( int x=s.x0; x<s.x1; x++ )
+				row[x] = generator.getPixel(x,s.y,a,b,c);
+		}
+		for( size_t i=0; i<set.pixels.size(); i++ )
+		{
+			const Pixel& p = set.pixels[i];
+			image[p.x + p.y*pitch] = generator.getPixel(p.x,p.y,a,b,c);
+		}
+	}
+
+	/** Returns true if m is exactly the midpoint of pq. */
+	static bool isMidpoint( const V& p, const V& q, const V& m )
+	{
+		return 2.0 * Generator::getX(m) == 
+				   (double)Generator::getX(p) + Generator::getX(q) &&
+			   2.0 * Generator::getY(m) == 
+				   (double)Generator::getY(p) + Generator::getY(q);
+	}
+
+	/**	Splits the triangle abc and passes its pixels on to the sub-triangles
+	 *	until the detail level is reached.
+	 *	@param level	The recursion level. The pixels of the sub-triangles
+	 *					are stored in the sets of the next level.
+	 *	@param exact	Whether a,b and c have been computed without rounding.
+	 */
+	void rasterize( const V& a, const V& b, const V& c, int depth,
+					const PixelSet& set, int level, bool exact )
+	{
+		if( depth==0 )
+		{
+			fill(set,a,b,c);
+			return;
+		}
+
+		V ab, ac, bc;
+		generator.splitTriangle(a,b,c,ab,ac,bc);
+
+		path[level].a = a;
+		path[level].b = b;
+		path[level].c = c;
+		path[level].exact = exact;
+
+		PixelSet* children = &sets[4*(level+1)];
+		for( int i=0; i<4; i++ ) children[i].clear();
+		split(set,a,b,c,level,children);
+
+		exact = exact && isMidpoint(a,b,ab) && isMidpoint(a,c,ac) 
+					  && isMidpoint(b,c,bc);
+		if( !children[SUB_A].empty() )
+			rasterize(a,ab,ac,depth-1,children[SUB_A],level+1,exact);
+		if( !children[SUB_B].empty() )
+			rasterize(ab,b,bc,depth-1,children[SUB_B],level+1,exact);
+		if( !children[SUB_C].empty() )
+			rasterize(ac,bc,c,depth-1,children[SUB_C],level+1,exact);
+		if( !children[SUB_MIDDLE].empty() )
+			rasterize(ab,ac,bc,depth-1,children[SUB_MIDDLE],level+1,exact);
+	}
+
+	// not copyable
+	TriangleRasterizer(const TriangleRasterizer&);
+	TriangleRasterizer& operator=(const TriangleRasterizer&);
+
+public:
+	/**	@param image	Points to the pixel (0|0) of an 8-bit image.
+	 *	@param pitch	Number of bytes from one row to the next, negative
+	 *					if the rows are stored bottom-up.
+	 */
+	TriangleRasterizer(Generator& generator, Uint8* image, int pitch)
+	: generator(generator),image(image),pitch(pitch) { }
+
+	/**	Renders the pixels from (x0|y0) up to, but not including, (x1|y1) of
+	 *	the map with the corners A,B,C,D.
+	 *	@param depth	How often the base triangles have to be split.
+	 */
+	void rasterize( const V& A, const V& B, const V& C, const V& D, int depth,
+					int x0, int y0, int x1, int y1 )
+	{
+		sets.resize(4*(depth+1));
+		path.resize(depth+1);
+
+		PixelSet tile;
+		for( int y=y0; y<y1; y++ )
+			tile.spans.push_back(Span(y,x0,x1));
+
+		PixelSet* base = &sets[0];
+		for( int i=0; i<4; i++ ) base[i].clear();
+		split(tile,A,B,D,-1,base);
+
+		if( !base[BASE_ABD].empty() )
+			rasterize(A,B,D,depth,base[BASE_ABD],0,true);
+		if( !base[BASE_CDB].empty() )
+			rasterize(C,D,B,depth,base[BASE_CDB],0,true);
+	}
+};
+
+#endif // SC4RRC__TRIANGLERASTERIZER_H
@@ -0,0 +1,920 @@
+/******************************************************************************
+ *	file: bench.cpp
+ *
+ *	Copyright (c) 2007, Benjamin Schug
+ *
+ *	This file is part of the SimCity 4 Random Region Creator (SC4RRC).
+ *
+ *	Sim City is a registered trademark of Electronic Arts.
+ *	This program is in no way associated with Maxis or Electronic Arts.
+ *
+ *	SC4RRC is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 3 of the License, or
+ *	(at your option) any later version.
+ *
+ *	SC4RRC is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *	
+ *****************************************************************************/
+
+
+/*	Benchmarks of the terrain generators, the post-processing steps and the
+ *	pseudo random functions.
+ *	Every case is run until it has taken at least the minimum time, and the
+ *	results are printed as JSON, so they can be compared between versions:
+ *
+ *	sc4rrc_bench [--quick] [--filter text] [--threads n] [--min-time ms]
+ *				 [--out file.json]
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <string>
+#include <sstream>
+#include <vector>
+
+#include <SDL/SDL.h>
+
+#include "Bitmap.h"
+#include "LogManager.h"
+#include "Perlin.h"
+#include "PerlinKernels.h"
+#include "postprocessing.h"
+#include "PostProcessor.h"
+#include "PreviewWriter.h"
+#include "Random.h"
+#include "Simd.h"
+#include "SmoothTriangleGrid.h"
+#include "ThreadPool.h"
+#include "TriangleGrid.h"
+
+#ifdef _WIN32
+#	define WIN32_LEAN_AND_MEAN
+#	include <windows.h>
+#else
+#	include <sys/time.h>
+#endif
+
+
+/** Returns the time in milliseconds, with a resolution of microseconds. */
+double now()
+{
+#ifdef _WIN32
+	LARGE_INTEGER counter, frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return 1000.0 * double(counter.QuadPart) / double(frequency.QuadPart);
+#else
+	timeval time;
+	gettimeofday(&time,NULL);
+	return 1000.0 * time.tv_sec + time.tv_usec / 1000.0;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+
+/**	A piece of work that is measured. prepare() is called before every run
+ *	and isn't measured, so it can restore the input that run() modifies.
+ */
+class Benchmark
+{
+public:
+	std::string name;
+	std::string params;		///< the parameters as the members of a JSON object
+	double pixels;			///< pixels per run, for the throughput
+
+	Benchmark(const std::string& name, const std::string& params, 
+			  double pixels)
+	: name(name),params(params),pixels(pixels)
+	{ }
+
+	virtual ~Benchmark() { }
+
+	virtual void prepare() { }
+	virtual void run() = 0;
+};
+
+//-----------------------------------------------------------------------------
+
+/** Generates a region with one of the terrain generators. */
+class GeneratorBenchmark : public Benchmark
+{
+	char generator;
+	int size;
+	int detail;
+	GenerationMode mode;
+	int packet_width;
+	ThreadPool* pool;
+
+public:
+	GeneratorBenchmark( char generator, int size, int detail, 
+						GenerationMode mode, ThreadPool* pool,
+						int packet_width = 8 )
+	: Benchmark( std::string("generator/") + name(generator) 
+				 + suffix(mode,packet_width),
+				 params(size,detail), pow(size*64.0+1.0,2.0) ),
+	  generator(generator),size(size),detail(detail),mode(mode),
+	  packet_width(packet_width),pool(pool)
+	{ }
+
+	static std::string suffix(GenerationMode mode, int packet_width)
+	{
+		std::ostringstream o;
+		switch(mode)
+		{
+		case RASTERIZE: o << "/rasterize"; break;
+		case CACHE_TOP_LEVELS: o << "/cache_levels"; break;
+		case PACKETS: o << "/packets" << packet_width; break;
+		default: break;
+		}
+		return o.str();
+	}
+
+	static const char* name(char generator)
+	{
+		switch(generator)
+		{
+		case 's': return "static_triangle_grid";
+		case 't': return "dynamic_triangle_grid";
+		case 'h': return "smooth_triangle_grid";
+		default:  return "perlin";
+		}
+	}
+
+	static std::string params(int size, int detail)
+	{
+		std::ostringstream o;
+		o << "\"width\": " << size << ", \"height\": " << size 
+		  << ", \"detail\": " << detail;
+		return o.str();
+	}
+
+	void run()
+	{
+		SC4Landscape* region;
+		switch(generator)
+		{
+		case 's': 
+			region = new StaticTriangleGrid(size,size,2,2,detail,0.5f,1); 
+			break;
+		case 't': 
+			region = new DynamicTriangleGrid(size,size,2,2,detail,0.5f,1); 
+			break;
+		case 'h': 
+			region = new SmoothTriangleGrid(size,size,2,2,detail,0.5f,1); 
+			break;
+		default:  
+			region = new Perlin(size,size,2,2,1,detail,0.5f,20,200,0.3f);
+			break;
+		}
+
+		region->setThreadPool(pool);
+		region->setGenerationMode(mode);
+		region->setPacketWidth(packet_width);
+		region->setPreviewFile("bench_preview.bmp");
+		region->writeImage("bench_region.bmp");
+		delete region;
+	}
+};
+
+//-----------------------------------------------------------------------------
+
+/**	Adds the octaves of Perlin Noise to a heightmap with the kernel of the
+ *	generator, on a single thread. Either all octaves are added to a row
+ *	before the next row, like Perlin::buildHeightmap() does, or every 
+ *	octave is added to the whole heightmap before the next octave, like
+ *	older versions did. The octaves have random grid values like in legacy
+ *	mode, with twice the frequency of the previous octave.
+ */
+class OctaveBenchmark : public Benchmark
+{
+	struct Octave
+	{
+		int columns;
+		std::vector<float> gridmap;
+		std::vector<int> cell;
+		std::vector<float> weight;
+		std::vector<int> row_cell;
+		std::vector<float> row_weight;
+	};
+
+	int size;
+	int detail;
+	bool per_row;
+	std::vector<float>& heightmap;
+	std::vector<Octave> octaves;
+	OctaveRowKernel addOctaveRow;
+
+	/** The grid cell and the smoothed weight of every pixel along an axis. */
+	static void createSteps( int frequency, int size, std::vector<int>& cell,
+							 std::vector<float>& weight )
+	{
+		float step = float(frequency) / float(size);
+		cell.resize(size);
+		weight.resize(size);
+		float g = 0.0f;
+		for(int i=0; i<size; i++)
+		{
+			cell[i] = int(g);
+			float w = g - cell[i];
+			weight[i] = w*w*(3.0f-2.0f*w);
+			g += step;
+		}
+	}
+
+	void createOctaves()
+	{
+		octaves.resize(detail);
+		int frequency = 1;
+		float amplitude = 1.0f;
+		for(int d=0; d<detail; d++)
+		{
+			Octave& octave = octaves[d];
+			octave.columns = frequency+1;
+			octave.gridmap.resize(octave.columns * octave.columns);
+			for(size_t i=0; i<octave.gridmap.size(); i++)
+				octave.gridmap[i] = (hashRandf( hashSeed(d+1,Uint32(i)) ) 
+									 - 0.5f) * amplitude;
+			createSteps(frequency,size,octave.cell,octave.weight);
+			createSteps(frequency,size,octave.row_cell,octave.row_weight);
+			frequency *= 2;
+			amplitude *= 0.5f;
+		}
+	}
+
+	void addOctave(const Octave& octave, float* row, int y)
+	{
+		const float* above = &octave.gridmap[octave.row_cell[y] 
+											 * octave.columns];
+		addOctaveRow( row, size, above, above + octave.columns, 
+					  &octave.cell[0], &octave.weight[0], 
+					  octave.row_weight[y] );
+	}
+
+public:
+	/** @param heightmap	Shared by all cases, it receives the sums. */
+	OctaveBenchmark( int size, int detail, bool per_row, 
+					 std::vector<float>& heightmap )
+	: Benchmark( per_row ? "perlin/octaves/per_row" 
+						 : "perlin/octaves/per_octave",
+				 params(size,detail), double(size) * size ),
+	  size(size),detail(detail),per_row(per_row),heightmap(heightmap),
+	  addOctaveRow( getOctaveRowKernel(getSimdLevel()) )
+	{ }
+
+	static std::string params(int size, int detail)
+	{
+		std::ostringstream o;
+		o << "\"width\": " << size << ", \"height\": " << size 
+		  << ", \"detail\": " << detail;
+		return o.str();
+	}
+
+	void prepare()
+	{
+		if( octaves.empty() )
+			createOctaves();
+		heightmap.resize( size_t(size) * size );
+	}
+
+	void run()
+	{
+		if(per_row)
+		{
+			std::vector<float> row(size);
+			for(int y=0; y<size; y++)
+			{
+				for(int x=0; x<size; x++)
+					row[x] = 0.0f;
+				for(int d=0; d<detail; d++)
+					addOctave(octaves[d],&row[0],y);
+				memcpy( &heightmap[size_t(y)*size], &row[0], 
+						size*sizeof(float) );
+			}
+		}
+		else
+		{
+			for(size_t i=0; i<heightmap.size(); i++)
+				heightmap[i] = 0.0f;
+			for(int d=0; d<detail; d++)
+			for(int y=0; y<size; y++)
+				addOctave(octaves[d],&heightmap[size_t(y)*size],y);
+		}
+	}
+};
+
+//-----------------------------------------------------------------------------
+
+/** Fills a bitmap with rolling hills and some noise. */
+void createTestImage(Bitmap& image)
+{
+	for(int y=0; y<image.getHeight(); y++)
+	{
+		Uint8* row = image.getPixels() + y * image.getPitch();
+		for(int x=0; x<image.getWidth(); x++)
+		{
+			float hills = 60.0f * sinf(x*0.02f) * cosf(y*0.03f);
+			float noise = 20.0f * hashRandf( hashLattice(1,x,y) );
+			row[x] = Uint8( 118.0f + hills + noise );
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+/** A pixel in the height list of sortWaterPercentage(). */
+struct HeightValue
+{
+	Uint8 value;
+	int pos;
+
+	HeightValue(Uint8 value, int pos) : value(value),pos(pos) { }
+
+	bool operator<(const HeightValue& v) const
+	{
+		return value < v.value;
+	}
+};
+
+/**	adjustWaterPercentage() as older versions did it, for comparison: all
+ *	pixels are sorted by height to find the water level, and the polynomial
+ *	is computed for every pixel.
+ */
+void sortWaterPercentage(Bitmap* image, float percentage)
+{
+	Uint8* pixels = image->getPixels();
+	int pitch = image->getPitch();
+
+	std::vector<HeightValue> heightlist;
+	for(int y=0; y < image->getHeight(); y++)
+	for(int x=0; x < image->getWidth(); x++)
+	{
+		int ofs = x + y * pitch;
+		heightlist.push_back( HeightValue(pixels[ofs],ofs) );
+	}
+	std::sort( heightlist.begin(), heightlist.end() );
+
+	int wpos = int( float(image->getWidth() * image->getHeight()) 
+					* percentage );
+	float w = heightlist[wpos].value;
+	float w2 = w*w;
+	float A = (83 - w) / (w2 - 255*w);
+	float B = (w2 - 21165) / (w2 - 255*w);
+
+	for(int y=0; y < image->getHeight(); y++)
+	for(int x=0; x < image->getWidth(); x++)
+	{
+		int ofs = x + y * pitch;
+		float h = pixels[ofs];
+		float v = A * h * h + B * h;
+		pixels[ofs] = v < 0 ? 0 : v > 255 ? 255 : Uint8(v);
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+/** Runs one of the post-processing steps on a test image. */
+class PostProcessingBenchmark : public Benchmark
+{
+	enum Step { BLUR, WATER, WATER_SORT, LEVELS, PIPELINE };
+
+	Step step;
+	const Bitmap& input;
+	Bitmap image;
+	int passes;
+	BlurMode mode;
+	ThreadPool* pool;
+
+	PostProcessingBenchmark( const std::string& name, 
+							 const std::string& params, Step step, 
+							 const Bitmap& input, int passes=0, 
+							 BlurMode mode=BLUR_SEPARABLE, 
+							 ThreadPool* pool=NULL )
+	: Benchmark( name, params, double(input.getWidth()) * input.getHeight() ),
+	  step(step),input(input),image(input.getWidth(),input.getHeight(),8),
+	  passes(passes),mode(mode),pool(pool)
+	{ }
+
+	/** Sets up the PostProcessor like a generator that blurs and adjusts
+	 *	the water and the levels.
+	 */
+	void configure(PostProcessor& postprocessor) const
+	{
+		postprocessor.setThreadPool(pool);
+		postprocessor.setBlur(passes,mode);
+		postprocessor.setWaterPercentage(0.3f);
+		postprocessor.setLevels(TERRACES_PLATEAU,1);
+	}
+
+public:
+	/** Blurs the image with the given number of passes, in place like
+	 *	older versions or with the separable blur.
+	 */
+	static Benchmark* blur(const Bitmap& input, int passes, BlurMode mode)
+	{
+		std::ostringstream o;
+		o << params(input) << ", \"passes\": " << passes;
+		return new PostProcessingBenchmark( mode == BLUR_IN_PLACE 
+												? "blurImage/in_place" 
+												: "blurImage/separable", 
+											o.str(), BLUR, input, passes, 
+											mode );
+	}
+
+	/**	Finds the water level with the histogram, or by sorting all pixels
+	 *	like older versions. The parameters tell how much memory the step
+	 *	needs besides the image: the histogram and the lookup table, or at
+	 *	least one HeightValue per pixel.
+	 */
+	static Benchmark* water(const Bitmap& input, bool sort=false)
+	{
+		double bytes = sort ? double(input.getWidth()) * input.getHeight() 
+								  * sizeof(HeightValue)
+							: 256 * (sizeof(Uint32) + sizeof(Uint8));
+		std::ostringstream o;
+		o << params(input) << ", \"temp_bytes\": " << std::fixed 
+		  << std::setprecision(0) << bytes;
+		return new PostProcessingBenchmark( sort ? "adjustWaterPercentage/sort" 
+												 : "adjustWaterPercentage", 
+											o.str(), sort ? WATER_SORT : WATER,
+											input );
+	}
+
+	static Benchmark* levels(const Bitmap& input)
+	{
+		return new PostProcessingBenchmark( "adjustLevels", params(input),
+											LEVELS, input );
+	}
+
+	/**	Runs all steps with the PostProcessor in its two passes, like the
+	 *	generators do. The parameters tell how many bytes each pass moved,
+	 *	and how many the blur, the water and the levels would move as 
+	 *	separate steps over the whole image.
+	 */
+	static Benchmark* pipeline(const Bitmap& input, int passes, 
+							   ThreadPool* pool)
+	{
+		PostProcessingBenchmark* benchmark = 
+			new PostProcessingBenchmark( "postprocess/pipeline", "", 
+										 PIPELINE, input, passes, 
+										 BLUR_SEPARABLE, pool );
+
+		// the bytes only depend on the settings, so one run tells them
+		benchmark->prepare();
+		PostProcessor postprocessor(&benchmark->image);
+		benchmark->configure(postprocessor);
+		postprocessor.run();
+		const PostProcessor::Traffic& traffic = postprocessor.getTraffic();
+
+		std::ostringstream o;
+		o << params(input) << ", \"passes\": " << passes << std::fixed 
+		  << std::setprecision(0) 
+		  << ", \"pass1_bytes\": " << traffic.pass1 
+		  << ", \"pass2_bytes\": " << traffic.pass2 
+		  << ", \"blur_bytes\": " << traffic.blur 
+		  << ", \"water_bytes\": " << traffic.water 
+		  << ", \"levels_bytes\": " << traffic.levels;
+		benchmark->Benchmark::params = o.str();
+		return benchmark;
+	}
+
+	static std::string params(const Bitmap& image)
+	{
+		std::ostringstream o;
+		o << "\"width\": " << image.getWidth() << ", \"height\": " 
+		  << image.getHeight();
+		return o.str();
+	}
+
+	void prepare()
+	{
+		// the steps change the image, so every run starts from the input
+		for(int y=0; y<image.getHeight(); y++)
+			memcpy( image.getPixels() + y * image.getPitch(), 
+					input.getPixels() + y * input.getPitch(), 
+					image.getWidth() );
+	}
+
+	void run()
+	{
+		switch(step)
+		{
+		case BLUR:	 blurImage(&image,passes,mode); break;
+		case WATER:	 adjustWaterPercentage(&image,0.3f); break;
+		case WATER_SORT: sortWaterPercentage(&image,0.3f); break;
+		case LEVELS: adjustLevels(&image,TERRACES_PLATEAU,1); break;
+		case PIPELINE:
+			{
+				PostProcessor postprocessor(&image);
+				configure(postprocessor);
+				postprocessor.run();
+			}
+			break;
+		}
+	}
+};
+
+//-----------------------------------------------------------------------------
+
+/** Colors and saves the preview of a test image. */
+class PreviewBenchmark : public Benchmark
+{
+	const Bitmap& image;
+	int scale;
+	bool compress;
+
+public:
+	PreviewBenchmark(const Bitmap& image, int scale, bool compress)
+	: Benchmark( std::string("preview") + (compress ? "/rle" : ""), 
+				 params(image,scale), 
+				 double(image.getWidth()) * image.getHeight() ),
+	  image(image),scale(scale),compress(compress)
+	{ }
+
+	static std::string params(const Bitmap& image, int scale)
+	{
+		std::ostringstream o;
+		o << PostProcessingBenchmark::params(image) << ", \"scale\": " 
+		  << scale;
+		return o.str();
+	}
+
+	void run()
+	{
+		PreviewWriter preview;
+		preview.open( "bench_preview.bmp", image.getWidth(), 
+					  image.getHeight(), scale, compress, NULL );
+		preview.pushRows( image.getPixels(), image.getPitch(), 
+						  image.getHeight() );
+		preview.close();
+	}
+};
+
+//-----------------------------------------------------------------------------
+
+/** Writes a batch of messages to the log, or filters them out. */
+class LogBenchmark : public Benchmark
+{
+	bool always;
+	int messages;
+
+public:
+	LogBenchmark(bool always, int messages)
+	: Benchmark( always ? "LogManager::log/written" 
+						: "LogManager::log/filtered", 
+				 params(messages), 0.0 ),
+	  always(always),messages(messages)
+	{ }
+
+	static std::string params(int messages)
+	{
+		std::ostringstream o;
+		o << "\"messages\": " << messages;
+		return o.str();
+	}
+
+	void run()
+	{
+		for(int i=0; i<messages; i++)
+		{
+			if(always)
+			{
+				SC4_LOG( "benchmark message " << i );
+			}
+			else
+			{
+				SC4_DBG( "benchmark message " << i );
+			}
+		}
+	}
+};
+
+//-----------------------------------------------------------------------------
+
+/** Keeps the compiler from optimizing the random benchmarks away. */
+volatile Uint32 random_sink;
+
+/**	Calls one of the pseudo random functions of the terrain generators, the
+ *	way createHeight() and interpolateSeeds() do: srand() and rand() of the
+ *	C runtime like older versions, their replacements in legacy mode, and
+ *	the hash functions.
+ */
+class RandomBenchmark : public Benchmark
+{
+public:
+	enum Function 
+	{ 
+		SRAND_RAND,		///< srand(seed), then rand()
+		LEGACY_RAND,	///< legacyRandf(seed)
+		LEGACY_SEQUENCE,///< LegacyRandom::next()
+		HASH_RAND,		///< hashRandf(seed)
+		HASH_LATTICE,	///< hashLattice(seed,x,y)
+		LEGACY_SEEDS,	///< (int)(float)(seed1+seed2+99)
+		HASH_SEEDS		///< hashSeeds(seed1,seed2)
+	};
+
+private:
+	Function function;
+	int calls;
+
+	static const char* name(Function function)
+	{
+		switch(function)
+		{
+		case SRAND_RAND:	  return "random/srand_rand";
+		case LEGACY_RAND:	  return "random/legacyRandf";
+		case LEGACY_SEQUENCE: return "random/LegacyRandom";
+		case HASH_RAND:		  return "random/hashRandf";
+		case HASH_LATTICE:	  return "random/hashLattice";
+		case LEGACY_SEEDS:	  return "random/interpolateSeeds/legacy";
+		default:			  return "random/interpolateSeeds/hash";
+		}
+	}
+
+	static std::string params(int calls)
+	{
+		std::ostringstream o;
+		o << "\"calls\": " << calls;
+		return o.str();
+	}
+
+public:
+	RandomBenchmark(Function function, int calls)
+	: Benchmark( name(function), params(calls), 0.0 ),
+	  function(function),calls(calls)
+	{ }
+
+	void run()
+	{
+		Uint32 sum = 0;
+		float sumf = 0.0f;
+		switch(function)
+		{
+		case SRAND_RAND:
+			for(int i=0; i<calls; i++)
+			{
+				srand(i);
+				sumf += (float)rand() / (float)RAND_MAX;
+			}
+			break;
+		case LEGACY_RAND:
+			for(int i=0; i<calls; i++)
+				sumf += legacyRandf(i);
+			break;
+		case LEGACY_SEQUENCE:
+		{
+			LegacyRandom random(1);
+			for(int i=0; i<calls; i++)
+				sum += random.next();
+			break;
+		}
+		case HASH_RAND:
+			for(int i=0; i<calls; i++)
+				sumf += hashRandf(Uint32(i));
+			break;
+		case HASH_LATTICE:
+			for(int i=0; i<calls; i++)
+				sum += hashLattice(1,i & 1023,i >> 10);
+			break;
+		case LEGACY_SEEDS:
+			for(int i=0; i<calls; i++)
+				sum += Uint32( (int)(float)(i + int(sum) + 99) );
+			break;
+		case HASH_SEEDS:
+			for(int i=0; i<calls; i++)
+				sum += hashSeeds(Uint32(i),sum);
+			break;
+		}
+		random_sink = sum + Uint32(sumf);
+	}
+};
+
+//-----------------------------------------------------------------------------
+
+/** The measurements of a benchmark. */
+struct Result
+{
+	const Benchmark* benchmark;
+	int iterations;
+	double min, mean, max;		///< milliseconds per run
+};
+
+//-----------------------------------------------------------------------------
+
+/** Runs a benchmark until it has taken at least min_time milliseconds. */
+Result measure(Benchmark& benchmark, double min_time)
+{
+	Result result = { &benchmark, 0, 0.0, 0.0, 0.0 };
+	double total = 0.0;
+	while( result.iterations == 0 || 
+		   (total < min_time && result.iterations < 1000) )
+	{
+		benchmark.prepare();
+		double start = now();
+		benchmark.run();
+		double time = now() - start;
+
+		result.min = result.iterations == 0 || time < result.min 
+				   ? time : result.min;
+		result.max = time > result.max ? time : result.max;
+		total += time;
+		result.iterations++;
+	}
+	result.mean = total / result.iterations;
+	return result;
+}
+
+//-----------------------------------------------------------------------------
+
+/** Writes the results as a JSON document. */
+void writeJson(FILE* out, const std::vector<Result>& results, int threads)
+{
+	fprintf( out, "{\n  \"threads\": %d,\n  \"simd\": \"%s\",\n"
+				  "  \"benchmarks\": [\n", 
+			 threads, getSimdName( getSimdLevel() ) );
+
+	for(size_t i=0; i<results.size(); i++)
+	{
+		const Result& r = results[i];
+		fprintf( out, "    { \"name\": \"%s\", \"params\": { %s }, "
+					  "\"iterations\": %d, \"min_ms\": %.4f, "
+					  "\"mean_ms\": %.4f, \"max_ms\": %.4f",
+				 r.benchmark->name.c_str(), r.benchmark->params.c_str(),
+				 r.iterations, r.min, r.mean, r.max );
+		if( r.benchmark->pixels > 0.0 && r.min > 0.0 )
+			fprintf( out, ", \"mpixels_per_s\": %.3f", 
+					 r.benchmark->pixels / (r.min * 1000.0) );
+		fprintf( out, " }%s\n", i+1 < results.size() ? "," : "" );
+	}
+
+	fprintf( out, "  ]\n}\n" );
+}
+
+//-----------------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+	SDL_Init(SDL_INIT_TIMER);
+	atexit(LogManager::shutdown);
+
+	bool quick = false;
+	std::string filter;
+	int threads = 0;
+	double min_time = 500.0;
+	std::string out_file;
+
+	for(int i=1; i<argc; i++)
+	{
+		std::string arg = argv[i];
+		if(arg=="--quick")
+			quick = true;
+		else if(arg=="--filter" && i+1 < argc)
+			filter = argv[++i];
+		else if(arg=="--threads" && i+1 < argc)
+			threads = atoi(argv[++i]);
+		else if(arg=="--min-time" && i+1 < argc)
+			min_time = atof(argv[++i]);
+		else if(arg=="--out" && i+1 < argc)
+			out_file = argv[++i];
+		else
+		{
+			fprintf( stderr, "usage: sc4rrc_bench [--quick] [--filter text] "
+					 "[--threads n] [--min-time ms] [--out file.json]\n" );
+			return -1;
+		}
+	}
+
+	// all generators share the threads, so creating them isn't measured
+	ThreadPool pool(threads);
+
+	// the region sizes in kilometers and the detail levels
+	std::vector<int> sizes;
+	sizes.push_back(4);
+	if(!quick) sizes.push_back(8);
+
+	std::vector<int> details;
+	details.push_back(5);
+	if(!quick) details.push_back(7);
+
+	std::vector<Benchmark*> benchmarks;
+	const char generators[] = "sthp";
+	for(size_t s=0; s<sizes.size(); s++)
+	for(size_t d=0; d<details.size(); d++)
+	for(int g=0; generators[g]; g++)
+	{
+		char generator = generators[g];
+		benchmarks.push_back( new GeneratorBenchmark( generator, sizes[s], 
+													  details[d], PER_PIXEL,
+													  &pool ) );
+		// the other modes only concern the dynamic triangle grids
+		if(generator != 't' && generator != 'h')
+			continue;
+
+		benchmarks.push_back( new GeneratorBenchmark( generator, sizes[s], 
+													  details[d], RASTERIZE,
+													  &pool ) );
+		benchmarks.push_back( new GeneratorBenchmark( generator, sizes[s], 
+													  details[d], 
+													  CACHE_TOP_LEVELS, 
+													  &pool ) );
+		for( int width=4; width<=16; width*=2 )
+			benchmarks.push_back( new GeneratorBenchmark( generator, sizes[s], 
+														  details[d], PACKETS,
+														  &pool, width ) );
+	}
+
+	// the octaves of Perlin Noise on a 64 x 64 km region, whose heightmap
+	// doesn't fit into the cache
+	std::vector<float> octave_heightmap;
+	for( int detail=4; detail<=12; detail++ )
+	{
+		int size = quick ? 1025 : 4097;
+		benchmarks.push_back( new OctaveBenchmark( size, detail, true, 
+												   octave_heightmap ) );
+		benchmarks.push_back( new OctaveBenchmark( size, detail, false, 
+												   octave_heightmap ) );
+	}
+
+	// a 16 x 16 km region
+	Bitmap image(1025,1025,8);
+	createTestImage(image);
+
+	// the in-place blur against the separable one, for a few blur amounts
+	const int blur_passes[] = { 1, 10, 20, 30 };
+	for(int b=0; b < (quick ? 2 : 4); b++)
+	{
+		benchmarks.push_back( PostProcessingBenchmark::blur( image, 
+															 blur_passes[b],
+															 BLUR_IN_PLACE ) );
+		benchmarks.push_back( PostProcessingBenchmark::blur( image, 
+															 blur_passes[b],
+															 BLUR_SEPARABLE ) );
+	}
+	benchmarks.push_back( PostProcessingBenchmark::water(image) );
+	benchmarks.push_back( PostProcessingBenchmark::water(image,true) );
+	benchmarks.push_back( PostProcessingBenchmark::levels(image) );
+
+	// the same steps in the two passes of the PostProcessor
+	benchmarks.push_back( PostProcessingBenchmark::pipeline(image,1,&pool) );
+	if(!quick)
+		benchmarks.push_back( PostProcessingBenchmark::pipeline(image,10,
+																&pool) );
+	benchmarks.push_back( new PreviewBenchmark(image,1,false) );
+	benchmarks.push_back( new PreviewBenchmark(image,1,true) );
+	benchmarks.push_back( new PreviewBenchmark(image,4,false) );
+	benchmarks.push_back( new LogBenchmark(false,100000) );
+	benchmarks.push_back( new LogBenchmark(true,100) );
+
+	// a 100 x 100 km region, where sorting needs hundreds of megabytes
+	Bitmap large;
+	if(!quick)
+	{
+		large.create(6401,6401,8);
+		createTestImage(large);
+		benchmarks.push_back( PostProcessingBenchmark::water(large) );
+		benchmarks.push_back( PostProcessingBenchmark::water(large,true) );
+	}
+
+	for( int f=RandomBenchmark::SRAND_RAND; f<=RandomBenchmark::HASH_SEEDS; f++ )
+		benchmarks.push_back( new RandomBenchmark( RandomBenchmark::Function(f),
+												   1000000 ) );
+
+	std::vector<Result> results;
+	for(size_t i=0; i<benchmarks.size(); i++)
+	{
+		Benchmark& benchmark = *benchmarks[i];
+		if( benchmark.name.find(filter) == std::string::npos )
+			continue;
+
+		fprintf( stderr, "running %s (%s)\n", benchmark.name.c_str(),
+				 benchmark.params.c_str() );
+		results.push_back( measure(benchmark,min_time) );
+	}
+
+	FILE* out = out_file.empty() ? stdout : fopen(out_file.c_str(),"w");
+	if(!out)
+	{
+		fprintf( stderr, "can't create %s\n", out_file.c_str() );
+		return -1;
+	}
+	writeJson(out,results,pool.getNrOfThreads());
+	if(out != stdout)
+		fclose(out);
+
+	for(size_t i=0; i<benchmarks.size(); i++)
+		delete benchmarks[i];
+
+	remove("bench_region.bmp");
+	remove("bench_preview.bmp");
+	return 0;
+}
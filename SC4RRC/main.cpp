@@ -23,7 +23,11 @@
  *	
  *****************************************************************************/
 
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sstream>
 #include <vector>
 #include <time.h>
 
@@ -33,6 +37,7 @@
 #include <SDL/SDL.h>
 #include <SDL/SDL_image.h>
 
+#include "Bitmap.h"
 #include "LogManager.h"
 #include "TriangleGrid.h"
 #include "SmoothTriangleGrid.h"
@@ -42,6 +47,8 @@
 #ifdef _WIN32
 #	define WIN32_LEAN_AND_MEAN
 #	include <windows.h>
+#	include <fcntl.h>
+#	include <io.h>
 
     int initSDL (Uint32 flags)
     {
@@ -51,16 +58,19 @@
         return result;
     }
 #else
+#	include <unistd.h>
+
     int initSDL (Uint32 flags) { return SDL_Init (flags); }
 #endif
 
 __inline float randf() { return (float)rand() / (float)RAND_MAX; }
 
 
-int main(int argc, char** argv)
-{
-	SDL_Init(SDL_INIT_TIMER);
+enum TerrainGenerator { NOT_SET, STATIC, DYNAMIC, PERLIN, HERMITE, DEBUG };
 
+/** The settings of one region, as they are given on the command line. */
+struct Settings
+{
 	// general options
 	int width;
 	int height;
@@ -68,8 +78,7 @@ int main(int argc, char** argv)
 	int blur;
 	int seed;
 
-	enum TerrainGenerator { NOT_SET, STATIC, DYNAMIC, PERLIN, HERMITE, DEBUG };
-	TerrainGenerator generator = NOT_SET;
+	TerrainGenerator generator;
 
 	// triangle-grid specific
 	float steepness;
@@ -80,31 +89,157 @@ int main(int argc, char** argv)
 	int bottom, peak;
 	float water;
 
-	int seed_arg_nr;
+	// number of threads, 0 means one per CPU
+	int threads;
+
+	// memory for the images in megabytes, 0 means no limit
+	int memory_budget;
+
+	// the preview is 1/preview_scale of the size of the heightmap
+	int preview_scale;
+	bool compress_preview;
+
+	// the pseudo random functions of the terrain generators
+	RandomMode random_mode;
+
+	// how the dynamic triangle grids compute the heightmap
+	GenerationMode generation_mode;
+
+	// the number of pixels that descend together with PACKETS
+	int packet_width;
+
+	// triangles smaller than this many pixels are not split anymore
+	float min_triangle_size;
+
+	// how the heightmap is blurred
+	BlurMode blur_mode;
+
+	// the levels that Perlin Noise cuts into the land
+	TerraceMode terrace_mode;
+
+	// position of the Perlin Noise map in the world, in kilometers
+	bool world;
+	int world_x, world_y, world_size;
+
+	Settings()
+	: width(0),height(0),level(0),blur(0),seed(0),generator(NOT_SET),
+	  steepness(0.0f),detail(0),roughness(0.0f),bottom(0),peak(0),
+	  water(0.0f),threads(0),memory_budget(0),preview_scale(1),
+	  compress_preview(false),random_mode(HASH_RANDOM),
+	  generation_mode(PER_PIXEL),packet_width(8),
+	  min_triangle_size(SC4Landscape::DEFAULT_MIN_TRIANGLE_SIZE),
+	  blur_mode(BLUR_SEPARABLE),
+	  terrace_mode(TERRACES_PLATEAU),world(false),world_x(0),world_y(0),
+	  world_size(0)
+	{ }
+};
+
+//-----------------------------------------------------------------------------
+
+/**	Applies the options starting with "--" to the settings.
+ *	They may appear anywhere on the command line, so they are removed from 
+ *	the arguments and the other arguments keep their positions.
+ */
+std::vector<std::string> parseSwitches( const std::vector<std::string>& args,
+										Settings& settings )
+{
+	std::vector<std::string> rest;
+	for(size_t i=0; i<args.size(); i++)
+	{
+		const std::string& arg = args[i];
+		if(arg=="--fullreport")
+		{
+			LogManager::setFullReport(true);
+		}
+		else if(arg=="--threads" && i+1 < args.size())
+		{
+			settings.threads = atoi(args[++i].c_str());
+		}
+		else if(arg=="--memory" && i+1 < args.size())
+		{
+			settings.memory_budget = atoi(args[++i].c_str());
+		}
+		else if(arg=="--preview" && i+1 < args.size())
+		{
+			settings.preview_scale = atoi(args[++i].c_str());
+		}
+		else if(arg=="--rle")
+		{
+			settings.compress_preview = true;
+		}
+		else if(arg=="--legacy")
+		{
+			settings.random_mode = LEGACY_RANDOM;
+			settings.blur_mode = BLUR_IN_PLACE;
+		}
+		else if(arg=="--rasterize")
+		{
+			settings.generation_mode = RASTERIZE;
+		}
+		else if(arg=="--cache-levels")
+		{
+			settings.generation_mode = CACHE_TOP_LEVELS;
+		}
+		else if(arg=="--packets" && i+1 < args.size())
+		{
+			settings.generation_mode = PACKETS;
+			settings.packet_width = atoi(args[++i].c_str());
+		}
+		else if(arg=="--min-triangle" && i+1 < args.size())
+		{
+			settings.min_triangle_size = (float)atof(args[++i].c_str());
+		}
+		else if(arg=="--terraces")
+		{
+			settings.terrace_mode = TERRACES_RANDOM;
+		}
+		else if(arg=="--world" && i+3 < args.size())
+		{
+			settings.world = true;
+			settings.world_x = atoi(args[++i].c_str());
+			settings.world_y = atoi(args[++i].c_str());
+			settings.world_size = atoi(args[++i].c_str());
+		}
+		else
+		{
+			rest.push_back(arg);
+		}
+	}
+	return rest;
+}
+
+//-----------------------------------------------------------------------------
+
+/**	Reads the general options, the generator options and the seed, in this
+ *	order.
+ *	@param interactive	If this is true, the user is asked to type in the
+ *						options that are missing. Otherwise, missing options
+ *						are an error.
+ *	@param with_seed	false if the seed is chosen elsewhere.
+ *	@return	false if the options are invalid.
+ */
+bool parseRegion( const std::vector<std::string>& args, Settings& settings,
+				  bool interactive, bool with_seed )
+{
+	size_t argc = args.size();
 
 	// General Options
 	// If the options are not given in the command line, we ask the user to
 	// type them in.
-	if(argc < 6)
+	if(argc < 5)
 	{
-		if(argc > 1)
-		{
-			if(std::string(argv[1])=="--fullreport")
-			{
-				LogManager::setFullReport(true);
-			}
-		}
+		if(!interactive) return false;
 
 		std::cout << "SC4 Random Region Creator" << std::endl;
 		std::cout << "See readme.txt for detailed instructions." << std::endl;
 		std::cout << "width: ";
-		std::cin >> width;
+		std::cin >> settings.width;
 		std::cout << "height: ";
-		std::cin >> height;
+		std::cin >> settings.height;
 		std::cout << "level: ";
-		std::cin >> level;
+		std::cin >> settings.level;
 		std::cout << "blur: ";
-		std::cin >> blur;
+		std::cin >> settings.blur;
 
 		std::string gen;
 		std::cout << "Select terrain generator:" << std::endl
@@ -112,146 +247,657 @@ int main(int argc, char** argv)
 				  << "  (h) Hermite Spline Triangle Grid" << std::endl
 				  << "  (p) Perlin Noise" << std::endl;
 		std::cin >> gen;
-		if(gen=="t") generator = DYNAMIC;
-		if(gen=="s") generator = STATIC;
-		if(gen=="p") generator = PERLIN;
-		if(gen=="h") generator = HERMITE;
-		if(gen=="d") generator = DEBUG;
+		if(gen=="t") settings.generator = DYNAMIC;
+		if(gen=="s") settings.generator = STATIC;
+		if(gen=="p") settings.generator = PERLIN;
+		if(gen=="h") settings.generator = HERMITE;
+		if(gen=="d") settings.generator = DEBUG;
 	}
 	else
 	{
-		width = atoi(argv[1]);
-		height = atoi(argv[2]);
-		level = atoi(argv[3]);
-		blur = atoi(argv[4]);
+		settings.width = atoi(args[0].c_str());
+		settings.height = atoi(args[1].c_str());
+		settings.level = atoi(args[2].c_str());
+		settings.blur = atoi(args[3].c_str());
 
-		if(argv[5][0]=='s') generator = STATIC;
-		if(argv[5][0]=='t') generator = DYNAMIC;
-		if(argv[5][0]=='p') generator = PERLIN;
-		if(argv[5][0]=='h') generator = HERMITE;
-		if(argv[5][0]=='d') generator = DEBUG;
+		if(args[4][0]=='s') settings.generator = STATIC;
+		if(args[4][0]=='t') settings.generator = DYNAMIC;
+		if(args[4][0]=='p') settings.generator = PERLIN;
+		if(args[4][0]=='h') settings.generator = HERMITE;
+		if(args[4][0]=='d') settings.generator = DEBUG;
 	}
 
+	TerrainGenerator generator = settings.generator;
+	size_t seed_arg_nr;
+
 	if(generator==NOT_SET)
 	{
-		std::cout << "Invalid command line arguments." << std::endl
-				  << "You need to specify a terrain generator." << std::endl
-				  << "See readme.txt for detailed instructions." << std::endl;
-		return -1;
+		// without a terminal, the caller reports the error
+		if(interactive)
+			std::cout << "Invalid command line arguments." << std::endl
+					  << "You need to specify a terrain generator." << std::endl
+					  << "See readme.txt for detailed instructions." << std::endl;
+		return false;
 	}
 	// Triangle Grid Options
 	else if(generator==DYNAMIC || generator==STATIC || generator==HERMITE || generator==DEBUG)
 	{
-		if(argc < 8)
+		if(argc < 7)
 		{
+			if(!interactive) return false;
+
 			std::cout << std::endl
 					  << "Triangle Grid settings:" << std::endl
 					  << "  steepness: ";
-			std::cin >> steepness;
+			std::cin >> settings.steepness;
 			std::cout << "  detail level: ";
-			std::cin >> detail;
+			std::cin >> settings.detail;
 		}
 		else
 		{
-			steepness = atof(argv[6]);
-			detail = atoi(argv[7]);
+			settings.steepness = float(atof(args[5].c_str()));
+			settings.detail = atoi(args[6].c_str());
 		}
 
-		seed_arg_nr = 8;
+		seed_arg_nr = 7;
 	}
-	else if( generator == PERLIN )
+	else
 	{
-		if(argc < 11)
+		if(argc < 10)
 		{
+			if(!interactive) return false;
+
 			std::cout << std::endl
 					  << "Perlin Noise settings:" << std::endl
 					  << "  roughness: ";
-			std::cin >> roughness;
+			std::cin >> settings.roughness;
 			std::cout << "  detail level: ";
-			std::cin >> detail;
+			std::cin >> settings.detail;
 			std::cout << "  peak: ";
-			std::cin >> peak;
+			std::cin >> settings.peak;
 			std::cout << "  bottom: ";
-			std::cin >> bottom;
+			std::cin >> settings.bottom;
 			std::cout << "  water percentage: ";
-			std::cin >> water;
+			std::cin >> settings.water;
 		}
 		else
 		{
-			roughness = atof(argv[6]);
-			detail = atoi(argv[7]);
-			bottom = atoi(argv[8]);
-			peak = atoi(argv[9]);
-			water = atof(argv[10]);
+			settings.roughness = float(atof(args[5].c_str()));
+			settings.detail = atoi(args[6].c_str());
+			settings.bottom = atoi(args[7].c_str());
+			settings.peak = atoi(args[8].c_str());
+			settings.water = float(atof(args[9].c_str()));
 		}
 
-		seed_arg_nr = 11;
+		seed_arg_nr = 10;
 	}
 
+	if(!with_seed)
+		return true;
 
 	// Let the user choose a seed or create one randomly.
 	std::string seed_str;
 
 	if(argc > seed_arg_nr)
 	{
-		seed_str = argv[seed_arg_nr];
+		seed_str = args[seed_arg_nr];
 	}
-	else
+	else if(interactive)
 	{
 		std::cout << "Seed (type 'r' for random seed): ";
 		std::cin >> seed_str; 
 	}	
+	else
+	{
+		return false;
+	}
 
 	if(seed_str == "r")
 	{
 #		ifdef WIN32
-			seed = GetTickCount();
+			settings.seed = GetTickCount();
 #		else
 			// if anyone knows a better way of doing this without 
 			// windows-specific functions, please tell me
-			seed = time(0);
+			settings.seed = time(0);
 #		endif
 	}
 	else
 	{
-		seed = atoi(seed_str.c_str());
+		settings.seed = atoi(seed_str.c_str());
 	}
 
-    if (argc > seed_arg_nr + 1)
-    {
-        if (std::string(argv[seed_arg_nr + 1])=="--fullreport")
-            LogManager::setFullReport (true);
-    }
-	
-	if(generator == STATIC)
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+
+/** Creates the terrain generator that the settings select. */
+SC4Landscape* createRegion(const Settings& s)
+{
+	SC4Landscape* region = NULL;
+
+	if(s.generator == STATIC)
+	{
+		region = new StaticTriangleGrid(s.width,s.height,s.level,s.blur,
+										s.detail,s.steepness,s.seed,
+										s.random_mode);
+	}
+
+	if(s.generator == DYNAMIC)
+	{
+		region = new DynamicTriangleGrid(s.width,s.height,s.level,s.blur,
+										 s.detail,s.steepness,s.seed,
+										 s.random_mode);
+	}
+
+	if(s.generator == PERLIN)
 	{
-		StaticTriangleGrid region(width,height,level,blur,detail,steepness,seed);
-		region.writeImage("region.bmp");
+		Perlin* perlin = new Perlin(s.width,s.height,s.level,s.blur,s.seed,
+									s.detail,s.roughness,s.bottom,s.peak,
+									s.water,s.random_mode);
+		perlin->setTerraceMode(s.terrace_mode);
+		if(s.world)
+			perlin->setWorld(s.world_x,s.world_y,s.world_size);
+		region = perlin;
 	}
 
-	if(generator == DYNAMIC)
+	if(s.generator == HERMITE)
 	{
-		DynamicTriangleGrid region(width,height,level,blur,detail,steepness,seed);
-		region.writeImage("region.bmp");
+		region = new SmoothTriangleGrid(s.width,s.height,s.level,s.blur,
+										s.detail,s.steepness,s.seed,
+										s.random_mode);
 	}
 
-	if(generator == PERLIN)
+	if(s.generator == DEBUG)
 	{
-		Perlin region(width,height,level,blur,seed,detail,roughness,bottom,peak,water);
-		region.writeImage("region.bmp");
+		region = new debugtriangle::DynamicTriangleGrid(s.width,s.height,
+														s.level,s.blur,
+														s.detail,s.steepness,
+														s.seed,s.random_mode);
 	}
 
-	if(generator == HERMITE)
+	if(region)
 	{
-		SmoothTriangleGrid region(width,height,level,blur,detail,steepness,seed);
-		region.writeImage("region.bmp");
+		region->setThreads(s.threads);
+		region->setMemoryBudget(s.memory_budget);
+		region->setPreview(s.preview_scale,s.compress_preview);
+		region->setGenerationMode(s.generation_mode);
+		region->setPacketWidth(s.packet_width);
+		region->setMinTriangleSize(s.min_triangle_size);
+		region->setBlurMode(s.blur_mode);
 	}
 
-	if(generator == DEBUG)
+	return region;
+}
+
+//-----------------------------------------------------------------------------
+
+/**	Generates many regions in a single process.
+ *	Every job is a work item, so independent regions are generated at the
+ *	same time on a ThreadPool, each of them with a share of the threads.
+ *	The heightmap bitmaps are handed from one job to the next one, so their
+ *	memory is only allocated once per thread.
+ */
+class Batch : public ParallelTask
+{
+	const std::vector<Settings>& jobs;
+	const std::vector<std::string>& names;	///< appended to the file names
+	int threads_per_job;
+
+	SDL_mutex* mutex;
+	std::vector<Bitmap*> images;			///< bitmaps no job is using
+
+public:
+	Batch( const std::vector<Settings>& jobs, 
+		   const std::vector<std::string>& names, int threads_per_job )
+	: jobs(jobs),names(names),threads_per_job(threads_per_job),
+	  mutex(SDL_CreateMutex())
+	{ }
+
+	~Batch()
 	{
-		debugtriangle::DynamicTriangleGrid region(width,height,level,blur,detail,steepness,seed);
-		region.writeImage("region.bmp");
+		for(size_t i=0; i<images.size(); i++)
+			delete images[i];
+		SDL_DestroyMutex(mutex);
 	}
 
+	void execute(int index)
+	{
+		SDL_mutexP(mutex);
+		Bitmap* image = NULL;
+		if(!images.empty())
+		{
+			image = images.back();
+			images.pop_back();
+		}
+		SDL_mutexV(mutex);
+
+		if(!image) image = new Bitmap();
+
+		SC4Landscape* region = createRegion(jobs[index]);
+		if(region)
+		{
+			SC4_PROFILE("region");
+			region->setThreads(threads_per_job);
+			region->setImageBuffer(image);
+			region->setPreviewFile("preview_" + names[index] + ".bmp");
+			std::string region_file = "region_" + names[index] + ".bmp";
+			if(!region->writeImage(region_file.c_str()))
+				SC4_LOG( "couldn't write " << region_file 
+						 << " and its preview" );
+			delete region;
+		}
+
+		SDL_mutexP(mutex);
+		images.push_back(image);
+		SDL_mutexV(mutex);
+	}
+};
+
+//-----------------------------------------------------------------------------
+
+/**	Generates all jobs and reports the throughput.
+ *	@param threads	The number of threads of all jobs together, 0 for one
+ *					per CPU.
+ */
+void runBatch( const std::vector<Settings>& jobs, 
+			   const std::vector<std::string>& names, int threads )
+{
+	if(threads <= 0)
+		threads = ThreadPool::getNrOfCPUs();
+
+	// one job per thread, unless there are fewer jobs than threads
+	int parallel_jobs = int(jobs.size()) < threads ? int(jobs.size()) 
+												   : threads;
+	if(parallel_jobs < 1) parallel_jobs = 1;
+	int threads_per_job = threads / parallel_jobs;
+
+	SC4_LOG( "batch of " << jobs.size() << " regions, " << parallel_jobs 
+			 << " at a time with " << threads_per_job << " threads each" );
+
+	Uint32 start = SDL_GetTicks();
+	{
+		Batch batch(jobs,names,threads_per_job);
+		ThreadPool pool(parallel_jobs);
+		pool.run(batch,int(jobs.size()));
+	}
+	double seconds = (SDL_GetTicks() - start) / 1000.0;
+
+	std::ostringstream report;
+	report << "generated " << jobs.size() << " regions in " << seconds 
+		   << " s (" << (seconds > 0.0 ? 60.0 * jobs.size() / seconds : 0.0)
+		   << " regions per minute)";
+	LogManager::log(report.str(),true);
+	std::cout << report.str() << std::endl;
+}
+
+//-----------------------------------------------------------------------------
+
+/** Splits a line into words. */
+std::vector<std::string> splitWords(const std::string& line)
+{
+	std::istringstream words(line);
+	std::vector<std::string> args;
+	std::string word;
+	while(words >> word)
+		args.push_back(word);
+	return args;
+}
+
+//-----------------------------------------------------------------------------
+
+/**	Reads a job file: every line holds the command line of one region,
+ *	including the seed. Empty lines and lines starting with # are skipped.
+ *	The switches of the real command line apply to all jobs, and the
+ *	switches on a line only to that job.
+ *	@return	false if the file can't be read or a line is invalid.
+ */
+bool readJobs( const char* filename, const Settings& defaults,
+			   std::vector<Settings>& jobs, std::vector<std::string>& names )
+{
+	std::ifstream file(filename);
+	if(!file)
+	{
+		std::cout << "Can't open the job file " << filename << std::endl;
+		return false;
+	}
+
+	std::string line;
+	for(int line_nr=1; std::getline(file,line); line_nr++)
+	{
+		std::vector<std::string> args = splitWords(line);
+		if(args.empty() || args[0][0]=='#')
+			continue;
+
+		Settings settings = defaults;
+		if(!parseRegion(parseSwitches(args,settings),settings,false,true))
+		{
+			std::cout << filename << ", line " << line_nr 
+					  << ": invalid options" << std::endl;
+			return false;
+		}
+
+		std::ostringstream name;
+		name << jobs.size() + 1;
+		jobs.push_back(settings);
+		names.push_back(name.str());
+	}
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+
+/** Reads a line without the line break. @return false at the end. */
+bool readLine(FILE* in, std::string& line)
+{
+	line.clear();
+	int c;
+	while((c = fgetc(in)) != EOF && c != '\n')
+		if(c != '\r')
+			line += char(c);
+	return c != EOF || !line.empty();
+}
+
+//-----------------------------------------------------------------------------
+
+/**	Generates regions on request until the input ends or says "quit".
+ *	Every request is a line with the command line of a region, including the
+ *	seed, just like a line of a job file. "--out name" chooses the names of
+ *	the files, which are region_name.bmp and preview_name.bmp. By default, 
+ *	name is the number of the request. The name can't contain slashes or
+ *	backslashes, so the files always end up in the working directory.
+ *	Every request is answered with a single line: "ok", the time it took in
+ *	milliseconds and the names of the files, or "error" and the reason.
+ *	The threads and the heightmap bitmap stay alive from one request to the
+ *	next, so only the first request pays for creating them.
+ *	@param defaults	The settings that apply to all requests.
+ */
+void serve(FILE* in, FILE* out, const Settings& defaults)
+{
+	ThreadPool pool(defaults.threads);
+	Bitmap image;
+
+	SC4_LOG( "serving requests on " << pool.getNrOfThreads() << " threads" );
+
+	std::string line;
+	for(int request=1; readLine(in,line); request++)
+	{
+		std::vector<std::string> args = splitWords(line);
+		if(args.empty() || args[0][0]=='#')
+			continue;
+		if(args[0]=="quit")
+			break;
+
+		std::ostringstream number;
+		number << request;
+		std::string name = number.str();
+		for(size_t i=0; i+1 < args.size(); i++)
+			if(args[i]=="--out")
+			{
+				name = args[i+1];
+				args.erase(args.begin()+i, args.begin()+i+2);
+				break;
+			}
+		if(name.find_first_of("/\\") != std::string::npos)
+		{
+			fprintf(out,"error invalid name %s\n",name.c_str());
+			fflush(out);
+			continue;
+		}
+
+		Settings settings = defaults;
+		SC4Landscape* region = NULL;
+		if(parseRegion(parseSwitches(args,settings),settings,false,true))
+			region = createRegion(settings);
+		if(!region)
+		{
+			fprintf(out,"error invalid options\n");
+			fflush(out);
+			continue;
+		}
+
+		Uint32 start = SDL_GetTicks();
+		SC4_PROFILE("region");
+
+		std::string region_file = "region_" + name + ".bmp";
+		std::string preview_file = "preview_" + name + ".bmp";
+		region->setThreadPool(&pool);
+		region->setImageBuffer(&image);
+		region->setPreviewFile(preview_file);
+		bool written = region->writeImage(region_file.c_str());
+		delete region;
+
+		if(!written)
+		{
+			fprintf( out, "error could not write %s %s\n", 
+					 region_file.c_str(), preview_file.c_str() );
+			fflush(out);
+			continue;
+		}
+		fprintf( out, "ok %u %s %s\n", unsigned(SDL_GetTicks() - start),
+				 region_file.c_str(), preview_file.c_str() );
+		fflush(out);
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+/** Creates a pipe. @return false if that is not possible. */
+bool createPipe(FILE*& read_end, FILE*& write_end)
+{
+	int fds[2];
+#ifdef _WIN32
+	if(_pipe(fds,65536,_O_BINARY) != 0)
+		return false;
+	read_end = _fdopen(fds[0],"rb");
+	write_end = _fdopen(fds[1],"wb");
+#else
+	if(pipe(fds) != 0)
+		return false;
+	read_end = fdopen(fds[0],"rb");
+	write_end = fdopen(fds[1],"wb");
+#endif
+	return read_end && write_end;
+}
+
+//-----------------------------------------------------------------------------
+
+/** The server side of benchmarkServer(). */
+struct LoopbackServer
+{
+	FILE* requests;
+	FILE* answers;
+	const Settings* defaults;
+
+	static int run(void* data)
+	{
+		LoopbackServer* server = static_cast<LoopbackServer*>(data);
+		serve(server->requests,server->answers,*server->defaults);
+		fclose(server->answers);
+		return 0;
+	}
+};
+
+//-----------------------------------------------------------------------------
+
+/**	Measures how long requests to a server take, from sending the request
+ *	to receiving the answer. The server runs on a thread of this process
+ *	and is connected through a pair of pipes, just like a server that is
+ *	fed by another program.
+ *	@param args		The command line of the region, without the seed. The
+ *					seed is counted up from settings.seed for every request.
+ */
+int benchmarkServer( const std::vector<std::string>& args,
+					 const Settings& settings, int nr_of_requests )
+{
+	LoopbackServer server;
+	FILE* requests;
+	FILE* answers;
+	if( !createPipe(server.requests,requests) || 
+		!createPipe(answers,server.answers) )
+	{
+		std::cout << "Can't create the pipes to the server." << std::endl;
+		return -1;
+	}
+	server.defaults = &settings;
+	SDL_Thread* thread = SDL_CreateThread(&LoopbackServer::run,&server);
+
+	Uint32 first = 0, min = 0, max = 0, total = 0;
+	char answer[1024];
+	for(int i=0; i<nr_of_requests; i++)
+	{
+		std::ostringstream request;
+		request << "--out bench";
+		for(size_t j=0; j<args.size(); j++)
+			request << " " << args[j];
+		request << " " << settings.seed + i << "\n";
+
+		Uint32 start = SDL_GetTicks();
+		fputs(request.str().c_str(),requests);
+		fflush(requests);
+		if(!fgets(answer,sizeof(answer),answers) || strncmp(answer,"ok",2))
+		{
+			std::cout << "The server failed: " << answer << std::endl;
+			break;
+		}
+		Uint32 latency = SDL_GetTicks() - start;
+
+		if(i == 0)
+		{
+			first = latency;
+			continue;
+		}
+		min = i == 1 || latency < min ? latency : min;
+		max = latency > max ? latency : max;
+		total += latency;
+	}
+
+	fputs("quit\n",requests);
+	fclose(requests);
+	SDL_WaitThread(thread,NULL);
+	fclose(answers);
+	fclose(server.requests);
+
+	std::ostringstream report;
+	report << "first request: " << first << " ms";
+	if(nr_of_requests > 1)
+		report << ", next " << nr_of_requests-1 << " requests: min " << min
+			   << " ms, avg " << double(total) / (nr_of_requests-1) 
+			   << " ms, max " << max << " ms";
+	LogManager::log(report.str(),true);
+	std::cout << report.str() << std::endl;
 	return 0;
+}
+
+//-----------------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+	SDL_Init(SDL_INIT_TIMER);
+	atexit(LogManager::shutdown);
+
+	// batch mode: a range of seeds or a job file
+	bool sweep = false;
+	int first_seed = 0, last_seed = 0;
+	std::string job_file;
+
+	// server mode, or a benchmark of it with this many requests
+	bool server = false;
+	int bench_requests = 0;
+
+	std::vector<std::string> args;
+	for(int i=1; i<argc; i++)
+	{
+		std::string arg = argv[i];
+		if(arg=="--batch" && i+2 < argc)
+		{
+			sweep = true;
+			first_seed = atoi(argv[++i]);
+			last_seed = atoi(argv[++i]);
+		}
+		else if(arg=="--jobs" && i+1 < argc)
+		{
+			job_file = argv[++i];
+		}
+		else if(arg=="--serve")
+		{
+			server = true;
+		}
+		else if(arg=="--serve-bench" && i+1 < argc)
+		{
+			bench_requests = atoi(argv[++i]);
+		}
+		else if(arg=="--profile" && i+1 < argc)
+		{
+			LogManager::enableProfiling(argv[++i]);
+		}
+		else
+		{
+			args.push_back(arg);
+		}
+	}
+
+	Settings settings;
+	args = parseSwitches(args,settings);
+
+	if(server)
+	{
+		serve(stdin,stdout,settings);
+		return 0;
+	}
+
+	if(bench_requests > 0)
+	{
+		if(!parseRegion(args,settings,false,true))
+		{
+			std::cout << "The benchmark needs the whole command line of a "
+						 "region." << std::endl;
+			return -1;
+		}
+
+		// everything but the seed
+		args.resize(settings.generator == PERLIN ? 10 : 7);
+		return benchmarkServer(args,settings,bench_requests);
+	}
+
+	if(!job_file.empty())
+	{
+		std::vector<Settings> jobs;
+		std::vector<std::string> names;
+		if(!readJobs(job_file.c_str(),settings,jobs,names))
+			return -1;
+		runBatch(jobs,names,settings.threads);
+		return 0;
+	}
+
+	if(!parseRegion(args,settings,true,!sweep))
+		return -1;
+
+	if(sweep)
+	{
+		std::vector<Settings> jobs;
+		std::vector<std::string> names;
+		for(int seed=first_seed; seed<=last_seed; seed++)
+		{
+			std::ostringstream name;
+			name << seed;
+			settings.seed = seed;
+			jobs.push_back(settings);
+			names.push_back(name.str());
+		}
+		runBatch(jobs,names,settings.threads);
+		return 0;
+	}
+
+	SC4Landscape* region = createRegion(settings);
+	bool written = true;
+	if(region)
+	{
+		SC4_PROFILE("region");
+		written = region->writeImage("region.bmp");
+		delete region;
+	}
+
+	return written ? 0 : 1;
 }
\ No newline at end of file
@@ -28,70 +28,123 @@
 #include <SDL/SDL.h>
 
 #include <algorithm>
+#include <string.h>
 #include <vector>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define SC4RRC_SSE2
+#	include <emmintrin.h>
+#endif
+
+#include "postprocessing.h"
+#include "Bitmap.h"
+#include "PostProcessor.h"
+#include "Random.h"
+
 #include <limits>
 using std::numeric_limits;
 
-struct HeightValue
+void blurRowInPlace(const Uint8* above, Uint8* row, const Uint8* below, int w)
 {
-	Uint8 value;
-	int pos;
+	// Pixels that have already been blurred are used again for their
+	// neighbours, so every pass blurs towards the lower right.
+	for (int x=1; x < w - 1; x++)
+	{
+		int sum = above[x-1] + above[x] + above[x+1]
+				+ row[x-1] + row[x] + row[x+1]
+				+ below[x-1] + below[x] + below[x+1];
+		row[x] = sum / 9;
+	}
+}
 
-	HeightValue(Uint8 value, int pos) : value(value),pos(pos) { }
 
-	bool operator<(const HeightValue& v) const
+void blurSumRow(const Uint8* src, Uint16* sum, int w)
+{
+	int x = 1;
+
+#ifdef SC4RRC_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	for( ; x+16 < w; x+=16 )
 	{
-		return value < v.value;
+		__m128i l = _mm_loadu_si128( (const __m128i*)(src+x-1) );
+		__m128i c = _mm_loadu_si128( (const __m128i*)(src+x) );
+		__m128i r = _mm_loadu_si128( (const __m128i*)(src+x+1) );
+
+		__m128i lo = _mm_add_epi16( _mm_unpacklo_epi8(l,zero),
+									_mm_unpacklo_epi8(c,zero) );
+		__m128i hi = _mm_add_epi16( _mm_unpackhi_epi8(l,zero),
+									_mm_unpackhi_epi8(c,zero) );
+		lo = _mm_add_epi16( lo, _mm_unpacklo_epi8(r,zero) );
+		hi = _mm_add_epi16( hi, _mm_unpackhi_epi8(r,zero) );
+
+		_mm_storeu_si128( (__m128i*)(sum+x), lo );
+		_mm_storeu_si128( (__m128i*)(sum+x+8), hi );
 	}
-};
+#endif
 
-__inline float randf () { return float(rand()) / float(RAND_MAX); }
-__inline int rand (int min, int max) { return min + int(randf() * max); }
+	for( ; x < w-1; x++ )
+		sum[x] = src[x-1] + src[x] + src[x+1];
+}
 
 
-/**	Blurs the image.
- *	This function assigns to each pixel the average of all surrounding pixels.
- *	This is repeated <blur_amount> times.
- */
-void blurImage(SDL_Surface* image, int blur_amount)
+void blurAverageRows( const Uint16* above, const Uint16* center,
+					  const Uint16* below, Uint8* dst, int w )
 {
+	int x = 1;
+
+#ifdef SC4RRC_SSE2
+	// The sums are at most 9*255, and for those, (s*7282)>>16 is exactly s/9.
+	const __m128i ninth = _mm_set1_epi16(7282);
+	for( ; x+16 < w; x+=16 )
+	{
+		__m128i lo = _mm_add_epi16(
+			_mm_add_epi16( _mm_loadu_si128((const __m128i*)(above+x)),
+						   _mm_loadu_si128((const __m128i*)(center+x)) ),
+			_mm_loadu_si128((const __m128i*)(below+x)) );
+		__m128i hi = _mm_add_epi16(
+			_mm_add_epi16( _mm_loadu_si128((const __m128i*)(above+x+8)),
+						   _mm_loadu_si128((const __m128i*)(center+x+8)) ),
+			_mm_loadu_si128((const __m128i*)(below+x+8)) );
+
+		lo = _mm_mulhi_epu16(lo,ninth);
+		hi = _mm_mulhi_epu16(hi,ninth);
+		_mm_storeu_si128( (__m128i*)(dst+x), _mm_packus_epi16(lo,hi) );
+	}
+#endif
+
+	for( ; x < w-1; x++ )
+		dst[x] = Uint8( (above[x] + center[x] + below[x]) / 9 );
+}
+
+
+void blurImage(Bitmap* image, int blur_amount, BlurMode mode)
+{
+	SC4_PROFILE("blur");
 	LogManager::log("blurring image",true);
+	Uint32 start = SDL_GetTicks();
 
-	for (int i=0; i < blur_amount; i++)
-    {
-		for (int y=1; y < image->h - 1; y++)
-		for (int x=1; x < image->w - 1; x++)
-		{
-			int sum = 0;
-			int nr_of_samples = 0;
-
-			for(int yy = y-1; yy <= y+1; yy++)
-			for(int xx = x-1; xx <= x+1; xx++)
-			{
-				int ofs = xx + yy * image->pitch;
-				sum += ((Uint8*)image->pixels)[ofs];
-				nr_of_samples++;
-			}
-
-			int ofs = x+y*image->pitch;
-			((Uint8*)image->pixels)[ofs] = (sum/nr_of_samples);
-		}
-    }
+	PostProcessor processor(image);
+	processor.setBlur(blur_amount,mode);
+	processor.run();
+
+	SC4_LOG( "blurred " << image->getWidth() << " x " << image->getHeight() << " pixels " 
+			 << blur_amount << " times in " << SDL_GetTicks() - start 
+			 << " ms (" << (mode == BLUR_IN_PLACE ? "in place" : "separable")
+			 << ")" );
 }
 
 
-void adjustMinMax(SDL_Surface* image, Uint8 bottom, Uint8 peak)
+void adjustMinMax(Bitmap* image, Uint8 bottom, Uint8 peak)
 {
-    Uint8 *pixels = static_cast <Uint8*> (image->pixels);
-    Uint16 pitch = image->pitch;
+    Uint8 *pixels = image->getPixels();
+    int pitch = image->getPitch();
 
 	// find min and max
 	Uint8 min = numeric_limits<Uint8>::max();
 	Uint8 max = numeric_limits<Uint8>::min();
 
-	for (int y=0; y < image->h; y++)
-    for (int x=0; x < image->w; x++)
+	for (int y=0; y < image->getHeight(); y++)
+    for (int x=0; x < image->getWidth(); x++)
 	{
         int ofs = x + y * pitch;
 		min = pixels[ofs] < min ? pixels[ofs] : min;
@@ -101,8 +154,8 @@ void adjustMinMax(SDL_Surface* image, Uint8 bottom, Uint8 peak)
 	// bring values to desired range
 	float factor = float(peak-bottom) / float(max-min);
 
-    for(int y=0; y < image->h; y++)
-    for(int x=0; x < image->w; x++)
+    for(int y=0; y < image->getHeight(); y++)
+    for(int x=0; x < image->getWidth(); x++)
 	{
         int ofs = x + y * pitch;
 		pixels[ofs] -= min;
@@ -112,107 +165,176 @@ void adjustMinMax(SDL_Surface* image, Uint8 bottom, Uint8 peak)
 }
 
 
+void buildHistogram(Bitmap* image, Uint32 histogram[256])
+{
+	const Uint8* pixels = image->getPixels();
+
+	memset( histogram, 0, 256*sizeof(Uint32) );
+	for(int y=0; y < image->getHeight(); y++)
+	{
+		const Uint8* row = pixels + y * image->getPitch();
+		for(int x=0; x < image->getWidth(); x++)
+			histogram[row[x]]++;
+	}
+}
+
+
+/**	Replaces every pixel value v by table[v]. */
+static void applyLookupTable(Bitmap* image, const Uint8 table[256])
+{
+	Uint8* pixels = image->getPixels();
+
+	for(int y=0; y < image->getHeight(); y++)
+	{
+		Uint8* row = pixels + y * image->getPitch();
+		for(int x=0; x < image->getWidth(); x++)
+			row[x] = table[row[x]];
+	}
+}
+
+
 /** Adjusts the water level.
- *	First, the values on the heightmap are sorted.
- *	Then the height value at the desired water percentage is retrieved.
+ *	First, the height value at the desired water percentage is looked up in
+ *	a histogram of the heightmap.
  *	Then the values are adjusted in such a way that the value at the
  *	desired position is just at sea level.
  *	This is done by appling a third-grade polynomial on the heightfield
  *	such that the min and max points are preserved and the water level
  *	is at the desired height.
+ *	The polynomial only depends on the height value, so it is evaluated
+ *	once for each of the 256 values and applied through a lookup table.
  */
-void adjustWaterPercentage (SDL_Surface *image, float percentage)
+void adjustWaterPercentage (Bitmap* image, float percentage)
 {
-	LogManager::log("Building heightlist");
+	SC4_PROFILE("water level");
+	LogManager::log("Building height histogram");
+	Uint32 start = SDL_GetTicks();
 
-    Uint8* pixels = static_cast <Uint8*> (image->pixels);
-    Uint16 pitch = image->pitch;
+	Uint32 histogram[256];
+	buildHistogram(image,histogram);
 
-	// sort height values in a list
-	std::vector<HeightValue> heightlist;
+	Uint8 table[256];
+	createWaterTable(histogram,percentage,table);
 
-    for(int y=0; y < image->h; y++)
-    for(int x=0; x < image->w; x++)
-	{
-        int ofs = x + y * pitch;
-		heightlist.push_back (HeightValue (pixels[ofs], ofs));
-	}
+	LogManager::log("adjusting height values");
+	applyLookupTable(image,table);
 
-	LogManager::log("Sorting heightlist");
-	std::sort (heightlist.begin(), heightlist.end());
-	
+	SC4_LOG( "adjusted water level of " << image->getWidth() * image->getHeight() 
+			 << " pixels in " << SDL_GetTicks() - start << " ms" );
+}
+
+
+void createWaterTable (const Uint32 histogram[256], float percentage, 
+					   Uint8 table[256])
+{
 	LogManager::log("Finding current water value");
-	// find current value at desired water percentage position
-	int wpos = int(float(image->w * image->h) * percentage);
-    float w = heightlist[wpos].value;
+	// find current value at desired water percentage position, i.e. the 
+	// value that a list of all pixels sorted by height has at wpos
+	int nr_of_pixels = 0;
+	for(int i=0; i < 256; i++)
+		nr_of_pixels += histogram[i];
+
+	int wpos = int(float(nr_of_pixels) * percentage);
+	wpos = wpos < 0 ? 0 : wpos >= nr_of_pixels ? nr_of_pixels-1 : wpos;
+
+	int value = 0;
+	for(Uint32 count = histogram[0]; count <= Uint32(wpos) && value < 255; )
+		count += histogram[++value];
+	float w = float(value);
 
 	// Compute coefficients for adjusting polynomial.
 	// The polynomial is of the form ax+bx+c and it must be 0 for x=0,
-    // 255 for x=255 and 83 for x=w.
-    // Since c must be 0, we ignore it.
-    float w2 = w*w;
+	// 255 for x=255 and 83 for x=w.
+	// Since c must be 0, we ignore it.
+	float w2 = w*w;
 	float A = (83 - w) / (w2 - 255*w);
 	float B = (w2 - 21165) / (w2 - 255*w);
 
-    std::ostringstream o;
-    o << "water value at position " << wpos << " is " << w << ", coefficients: A=" << A << ", B=" << B;
-    LogManager::log (o.str());
-
-	LogManager::log("adjusting height values");
+	std::ostringstream o;
+	o << "water value at position " << wpos << " is " << w << ", coefficients: A=" << A << ", B=" << B;
+	LogManager::log (o.str());
 
-    for(int y=0; y < image->h; y++)
-    for(int x=0; x < image->w; x++)
+	for(int i=0; i < 256; i++)
 	{
-        int ofs = x + y * pitch;
-        float h = pixels[ofs];
-        float v = A * h * h + B * h;
-        pixels[ofs] = v < 0 ? 0 : v > 255 ? 255 : Uint8(v);
-    }
+		float h = float(i);
+		float v = A * h * h + B * h;
+		table[i] = v < 0 ? 0 : v > 255 ? 255 : Uint8(v);
+	}
 }
 
 
 
-void adjustLevels (SDL_Surface* image)
+/**	Returns a random value between min and max, both inclusive.
+ *	@param index	Number of the value in the sequence of this seed.
+ */
+__inline int randomRange (int seed, int index, int min, int max)
+{
+	return min + int (hashRandf (hashSeed (Uint32 (seed), index)) * (max - min + 1));
+}
+
+
+void adjustLevels (Bitmap* image, TerraceMode mode, int seed)
+{
+    SC4_PROFILE ("levels");
+    Uint32 start = SDL_GetTicks();
+
+    Uint32 histogram[256];
+    buildHistogram (image, histogram);
+
+    Uint8 table[256];
+    createLevelsTable (histogram, mode, seed, table);
+    applyLookupTable (image, table);
+
+    SC4_LOG ("adjusted levels of " << image->getWidth() * image->getHeight() << " pixels in " << SDL_GetTicks() - start << " ms");
+}
+
+
+void createLevelsTable (const Uint32 histogram[256], TerraceMode mode, 
+                        int seed, Uint8 table[256])
 {
     const Uint8 MIN_LEVEL_HEIGHT = 20;
     const Uint8 MAX_LEVEL_HEIGHT = 100;
     const Uint8 MIN_LEVEL_DIST = 2;
     const Uint8 MAX_LEVEL_DIST = 10;
 
-    Uint8* pixels = static_cast <Uint8*> (image->pixels);
-    Uint16 pitch = image->pitch;
-
     typedef std::pair<Uint8, Uint8> LevelRegion;
     std::vector<LevelRegion> levels;
     
-    Uint8 levelStart = 83 + rand (0, 10);
     Uint8 cutOff = 0;
 
     std::ostringstream oss;
     oss << "Creating Levels at: ";
 
-/*
-    while (levelStart < 255)
+    if (mode == TERRACES_RANDOM)
     {
-        Uint8 height = rand (MIN_LEVEL_HEIGHT, MAX_LEVEL_HEIGHT);
-        if (levelStart > 255 - height) break;
+        int index = 0;
+        Uint8 levelStart = 83 + randomRange (seed, index++, 0, 10);
 
-        Uint8 levelEnd = levelStart + height;
-        levels.push_back (LevelRegion (levelStart, levelEnd));
-        oss << int(levelStart) << "-" << int(levelEnd);
-        
-        cutOff += levelEnd - levelStart;
+        while (levelStart < 255)
+        {
+            Uint8 height = randomRange (seed, index++, MIN_LEVEL_HEIGHT, MAX_LEVEL_HEIGHT);
+            if (levelStart > 255 - height) break;
 
-        Uint8 dist = rand (MIN_LEVEL_DIST, MAX_LEVEL_DIST);
-        if (levelEnd > 255 - dist * dist) break;
+            Uint8 levelEnd = levelStart + height;
+            if (!levels.empty()) oss << ", ";
+            levels.push_back (LevelRegion (levelStart, levelEnd));
+            oss << int(levelStart) << "-" << int(levelEnd);
+            
+            cutOff += levelEnd - levelStart;
 
-        levelStart = levelEnd + dist * dist;
-        oss << ", ";
-    }
-*/
+            Uint8 dist = randomRange (seed, index++, MIN_LEVEL_DIST, MAX_LEVEL_DIST);
+            if (levelEnd > 255 - dist * dist) break;
 
-    levels.push_back (LevelRegion (85, 255));
-    //levels.push_back (LevelRegion (175, 210));
+            levelStart = levelEnd + dist * dist;
+        }
+    }
+    else
+    {
+        // The height of the plateau is not cut off, so only the highest
+        // value of 255 stays above it.
+        levels.push_back (LevelRegion (85, 255));
+        oss << "85-255";
+    }
 
     // termination, to make things easier in the loop below
     levels.push_back (LevelRegion (255, 255));
@@ -220,46 +342,39 @@ void adjustLevels (SDL_Surface* image)
     oss << ", total cutoff: " << int(cutOff);
     LogManager::log (oss.str(), true);
 
-	// sort height values in a list
-	std::vector<HeightValue> heightlist;
-    for(int y=0; y < image->h; y++)
-    for(int x=0; x < image->w; x++)
-	{
-        int ofs = x + y * pitch;
-		heightlist.push_back (HeightValue (pixels[ofs], ofs));
-    }
-    std::sort (heightlist.begin(), heightlist.end());
+    int peak = 255;
+    while (peak > 0 && histogram[peak] == 0)
+        peak--;
 
-    typedef std::vector<LevelRegion>::const_iterator LevelIterator;
-    typedef std::vector<HeightValue>::const_iterator HeightListIterator;
-
-    // scale factor for maintaining the peak
-    float scale = float (heightlist.back().value) / float (heightlist.back().value - cutOff);
+    // Scale factor for maintaining the peak. Only the land is stretched,
+    // so the waterline stays where it is.
+    float scale = 1.0f;
+    if (peak - 83 > cutOff)
+        scale = float (peak - 83) / float (peak - 83 - cutOff);
     SC4_LOG ("scale factor: " << scale);
 
-    // base cutoff for maintaining water line
-    cutOff = Uint8(83 * scale) - 83;
-    SC4_LOG ("base cutoff: " << cutOff);
+    typedef std::vector<LevelRegion>::const_iterator LevelIterator;
 
+    // Walk through the height values from bottom to top, removing the
+    // height of every level that has been passed so far.
     LevelIterator level = levels.begin();
     cutOff = 0;
 
-    for (HeightListIterator it = heightlist.begin(); it != heightlist.end(); ++it)
+    for (int value = 0; value < 256; value++)
     {
-        int pos = it->pos;
-        Uint16 height = Uint16 (it->value * scale);
+        int height = value <= 83 ? value : 83 + int ((value - 83) * scale);
+        height = height > 255 ? 255 : height;
 
-        if (height > level->second)
+        while (height > level->second)
         {
             cutOff += level->second - level->first;
             ++level;
-            SC4_LOG ("reaching end of level at " << int(height) << ", cutOff = " << int(cutOff) << ", next level: " << int(level->first) << "-" << int(level->second));
+            SC4_LOG ("reaching end of level at " << height << ", cutOff = " << int(cutOff) << ", next level: " << int(level->first) << "-" << int(level->second));
         }
 
         if ((height > level->first) && (height < level->second))
             height = level->first;
 
-        pixels [pos] = height - cutOff;
+        table[value] = Uint8 (height - cutOff);
     }
-
-}
\ No newline at end of file
+}
@@ -25,9 +25,82 @@
 #ifndef POSTPROCESSING_H
 #define POSTPROCESSING_H
 
-void blurImage (SDL_Surface* image, int blur_amount);
-void adjustMinMax (SDL_Surface* image, int min, int max);
-void adjustWaterPercentage (SDL_Surface* image, float percentage);
-void adjustLevels (SDL_Surface* image);
+#include <SDL/SDL_types.h>
+
+// forward declaration
+class Bitmap;
+
+/** Selects how blurImage() works. */
+enum BlurMode
+{
+	BLUR_SEPARABLE,	///< every pass only reads the result of the previous pass
+	BLUR_IN_PLACE	///< reproduces the in-place blur of older versions
+};
+
+/** Selects the flat levels that adjustLevels() cuts into the terrain. */
+enum TerraceMode
+{
+	TERRACES_PLATEAU,	///< all land from height 85 up becomes one plateau
+	TERRACES_RANDOM		///< several terraces of random height and spacing
+};
+
+/**	Blurs the image.
+ *	Each pass assigns to every pixel the average of the 3x3 pixels around it.
+ *	The pixels on the border of the image are not changed.
+ *	@param blur_amount	The number of passes.
+ */
+void blurImage (Bitmap* image, int blur_amount, 
+				BlurMode mode = BLUR_SEPARABLE);
+void adjustMinMax (Bitmap* image, int min, int max);
+void adjustWaterPercentage (Bitmap* image, float percentage);
+
+/**	Cuts flat levels into the land above the waterline.
+ *	The new height only depends on the old one, so the levels are computed
+ *	as a lookup table from a histogram of the image and applied in a single
+ *	pass over the pixels.
+ *	@param seed	Chooses the terraces in TERRACES_RANDOM mode.
+ */
+void adjustLevels (Bitmap* image, TerraceMode mode = TERRACES_PLATEAU,
+				   int seed = 0);
+
+//-----------------------------------------------------------------------------
+//		building blocks of the functions above, used by the PostProcessor
+//-----------------------------------------------------------------------------
+
+/**	Sums up each interior pixel of a row with its left and right neighbour.
+ *	@param w	The width of the row. sum[0] and sum[w-1] are not written.
+ */
+void blurSumRow (const Uint8* src, Uint16* sum, int w);
+
+/**	Writes the average of three rows of horizontal sums to the interior
+ *	pixels of a row. This is one row of a separable blur pass.
+ */
+void blurAverageRows (const Uint16* above, const Uint16* center,
+					  const Uint16* below, Uint8* dst, int w);
+
+/**	Blurs the interior pixels of a row in place, like older versions did.
+ *	@param above	The row above, which has already been blurred.
+ *	@param row		The row itself, which is blurred from left to right.
+ *	@param below	The row below, which has not been blurred yet.
+ */
+void blurRowInPlace (const Uint8* above, Uint8* row, const Uint8* below, 
+					 int w);
+
+/**	Counts how many pixels there are of every height value.
+ *	@param histogram	Receives 256 counters.
+ */
+void buildHistogram (Bitmap* image, Uint32 histogram[256]);
+
+/**	Computes the lookup table of adjustWaterPercentage().
+ *	@param histogram	The histogram of the heightmap.
+ */
+void createWaterTable (const Uint32 histogram[256], float percentage, 
+					   Uint8 table[256]);
+
+/**	Computes the lookup table of adjustLevels().
+ *	@param histogram	The histogram of the heightmap.
+ */
+void createLevelsTable (const Uint32 histogram[256], TerraceMode mode, 
+						int seed, Uint8 table[256]);
 
 #endif
\ No newline at end of file